@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "assembler.hpp"
+#include "context.hpp"
+#include "corpus.hpp"
+#include "file_io.hpp"
+#include "source.hpp"
+
+namespace {
+    // Discards everything, so the measurement covers the assembler and not the disk
+    struct NullBuffer : std::streambuf {
+        int overflow(int c) override {
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char*, std::streamsize n) override {
+            return n;
+        }
+    };
+
+    struct BenchOptions {
+        size_t                  size;
+        size_t                  runs;
+        uint64_t                seed;
+        bool                    optimize;
+        bool                    use_files;
+        bool                    cold;           // the input is evicted from the page cache before every run
+        std::vector<CorpusKind> kinds;
+        std::vector<IOBackend>  backends;
+    };
+
+    struct RunResult {
+        bool        success;
+        double      seconds;
+        size_t      lines;
+        uint64_t    output_bytes;
+    };
+
+    static void print_usage() {
+        std::cerr << "Usage: aus_bench [--size <bytes>] [--runs <n>] [--seed <n>] [--corpus <kind>] [-O] [--files] [--io <backend>] [--cold]" << std::endl;
+        std::cerr << "       aus_bench --generate <kind> <bytes> <output file>" << std::endl;
+        std::cerr << "Corpus kinds:";
+        for (const auto& info : CORPUS_KINDS) {
+            std::cerr << " " << info.name;
+        }
+        std::cerr << std::endl;
+        std::cerr << "I/O backends, --io can be repeated and implies --files:";
+        for (const auto& info : IO_BACKENDS) {
+            std::cerr << " " << info.name;
+        }
+        std::cerr << std::endl;
+    }
+
+    // Dirty pages cannot be dropped, so the file is written back first
+    static void drop_page_cache(const std::filesystem::path& path) {
+#if !defined(_WIN32)
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+#endif
+    }
+
+    static RunResult run_once(
+        const BenchOptions& options,
+        const std::string& corpus,
+        const std::filesystem::path& input_path,
+        IOBackend backend
+    ) {
+        if (options.use_files && options.cold) {
+            drop_page_cache(input_path);
+        }
+
+        NullBuffer null_buffer;
+        std::ostream output_file(&null_buffer);
+        std::unique_ptr<std::streambuf> output_buffer;
+
+        SourceCache sources;
+        sources.io_backend = backend;
+        const auto start = std::chrono::steady_clock::now();
+
+        const SourceFile* input_file;
+        if (options.use_files) {
+            input_file = load_source(sources, input_path.string());
+            output_buffer = open_output_file(std::filesystem::path(input_path).replace_extension(".bin").string(), backend);
+            output_file.rdbuf(output_buffer.get());
+        }
+        else {
+            input_file = add_source(sources, "<corpus>", corpus);
+        }
+
+        if (input_file == nullptr || output_file.rdbuf() == nullptr) {
+            return RunResult { .success = false };
+        }
+
+        Context ctx = {
+            .b_mode         = M16,
+            .line_no        = 1,
+            .output_file    = &output_file,
+            .diagnostics    = &std::cerr,
+            .on_error       = false,
+            .optimize       = options.optimize
+        };
+        assemble_input(ctx, sources, *input_file);
+        output_file.flush();
+        output_buffer.reset();
+
+        const auto end = std::chrono::steady_clock::now();
+        return RunResult {
+            .success        = !ctx.on_error && (bool)output_file,
+            .seconds        = std::chrono::duration<double>(end - start).count(),
+            .lines          = input_file->lines.size(),
+            .output_bytes   = ctx.offset
+        };
+    }
+
+    static bool bench_corpus(const BenchOptions& options, const CorpusInfo& info) {
+        const std::string corpus = generate_corpus(info.kind, options.size, options.seed);
+
+        const std::filesystem::path input_path = std::filesystem::temp_directory_path() / std::format("aus_bench_{}.asm", info.name);
+        if (options.use_files) {
+            std::ofstream(input_path, std::ios::binary) << corpus;
+        }
+
+        for (const auto& io : IO_BACKENDS) {
+            // In-memory runs do no I/O, they are measured once
+            if (options.use_files
+                ? std::find(options.backends.begin(), options.backends.end(), io.backend) == options.backends.end()
+                : io.backend != IOBackend::DEFAULT
+            ) {
+                continue;
+            }
+
+            // The fastest run is the one least disturbed by the rest of the system
+            RunResult best = {};
+            for (size_t i = 0; i < options.runs; ++i) {
+                const RunResult result = run_once(options, corpus, input_path, io.backend);
+                if (!result.success) {
+                    std::cerr << std::format("Error: Assembling the `{}` corpus failed", info.name) << std::endl;
+                    return false;
+                }
+
+                if (i == 0 || result.seconds < best.seconds) {
+                    best = result;
+                }
+            }
+
+            constexpr double MB = 1024.0 * 1024.0;
+            std::cout << std::format(
+                "{:<16} {:<8} {:>10} {:>14.0f} {:>12.2f} {:>12.2f}",
+                info.name,
+                options.use_files ? io.name : "memory",
+                best.lines,
+                best.lines / best.seconds,
+                corpus.size() / MB / best.seconds,
+                best.output_bytes / MB / best.seconds
+            ) << std::endl;
+        }
+
+        if (options.use_files) {
+            std::filesystem::remove(input_path);
+            std::filesystem::remove(std::filesystem::path(input_path).replace_extension(".bin"));
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options = {
+        .size       = 8 << 20,
+        .runs       = 5,
+        .seed       = 1,
+        .optimize   = false,
+        .use_files  = false,
+        .cold       = false,
+        .kinds      = {},
+        .backends   = {}
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        if (arg == "--generate" && i + 3 < argc) {
+            CorpusKind kind;
+            if (!parse_corpus_kind(argv[i + 1], kind)) {
+                print_usage();
+                return -1;
+            }
+
+            std::ofstream output_file(argv[i + 3], std::ios::binary);
+            output_file << generate_corpus(kind, std::strtoull(argv[i + 2], nullptr, 10), options.seed);
+            return output_file ? 0 : -1;
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            options.size = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--corpus" && i + 1 < argc) {
+            CorpusKind kind;
+            if (!parse_corpus_kind(argv[++i], kind)) {
+                print_usage();
+                return -1;
+            }
+            options.kinds.push_back(kind);
+        }
+        else if (arg == "-O") {
+            options.optimize = true;
+        }
+        else if (arg == "--files") {
+            options.use_files = true;
+        }
+        else if (arg == "--io" && i + 1 < argc) {
+            IOBackend backend;
+            if (!parse_io_backend(argv[++i], backend)) {
+                print_usage();
+                return -1;
+            }
+            options.backends.push_back(backend);
+            options.use_files = true;
+        }
+        else if (arg == "--cold") {
+            options.cold = true;
+        }
+        else {
+            print_usage();
+            return -1;
+        }
+    }
+
+    if (options.backends.empty()) {
+        options.backends.push_back(IOBackend::DEFAULT);
+    }
+
+    std::cout << std::format(
+        "{} bytes per corpus, best of {} runs, {}",
+        options.size,
+        options.runs,
+        !options.use_files ? "in-memory input, null output sink" :
+        options.cold ? "file input and output, input evicted from the page cache before every run" :
+        "file input and output"
+    ) << std::endl;
+    if (options.use_files && std::find(options.backends.begin(), options.backends.end(), IOBackend::URING) != options.backends.end() && !io_uring_available()) {
+        std::cout << "io_uring is unavailable, the uring backend falls back to posix" << std::endl;
+    }
+    std::cout << std::format("{:<16} {:<8} {:>10} {:>14} {:>12} {:>12}", "corpus", "io", "lines", "lines/s", "MB/s in", "MB/s out") << std::endl;
+
+    for (const auto& info : CORPUS_KINDS) {
+        if (!options.kinds.empty() && std::find(options.kinds.begin(), options.kinds.end(), info.kind) == options.kinds.end()) {
+            continue;
+        }
+
+        if (!bench_corpus(options, info)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "corpus.hpp"
+
+namespace {
+    constexpr std::string_view ALU_OPS[] = { "ADC", "ADD", "AND", "CMP", "OR", "SBB", "SUB", "XOR" };
+
+    // Zero-operand instructions valid in every mode
+    constexpr std::string_view ZO_OPS[] = {
+        "CLC", "STC", "CMC", "CLD", "STD", "LAHF", "SAHF", "CWD", "CDQ", "CPUID", "RDTSC", "PAUSE",
+        "LFENCE", "MFENCE", "SFENCE", "MOVSB", "STOSB", "LODSB", "INT3", "LEAVE", "XLATB", "RET"
+    };
+
+    constexpr std::string_view REGS_8[]  = { "AL", "CL", "DL", "BL", "AH", "CH", "DH", "BH" };
+    constexpr std::string_view REGS_16[] = { "AX", "CX", "DX", "BX", "SP", "BP", "SI", "DI" };
+    constexpr std::string_view REGS_32[] = { "EAX", "ECX", "EDX", "EBX", "ESP", "EBP", "ESI", "EDI" };
+    constexpr std::string_view REGS_64[] = {
+        "RAX", "RCX", "RDX", "RBX", "RSP", "RBP", "RSI", "RDI",
+        "R8", "R9", "R10", "R11", "R12", "R13", "R14", "R15"
+    };
+
+    constexpr std::string_view BASES_16[]   = { "BX+SI", "BX+DI", "BP+SI", "BP+DI", "SI", "DI", "BX" };
+    constexpr std::string_view INDEXES_32[] = { "EAX", "ECX", "EDX", "EBX", "EBP", "ESI", "EDI" };
+    constexpr std::string_view SCALES[]     = { "", "2*", "4*", "8*" };
+
+    constexpr std::string_view COMMENTS[] = {
+        "save the flags before the next block",
+        "TODO: check the carry here",
+        "accumulate the checksum",
+        "see the calling convention notes above",
+        "bias the index by one element"
+    };
+
+    enum class Mode {
+        M16,
+        M32,
+        M64
+    };
+
+    struct Generator {
+        std::mt19937_64 rng;
+        std::string     out;
+
+        size_t below(size_t n) {
+            return (size_t)(rng() % n);
+        }
+
+        template<size_t N> std::string_view pick(const std::string_view (&items)[N]) {
+            return items[below(N)];
+        }
+
+        bool chance(unsigned percent) {
+            return below(100) < percent;
+        }
+    };
+
+    static std::string_view register_of_size(Generator& g, int size) {
+        switch (size) {
+            case 8:  return g.pick(REGS_8);
+            case 16: return g.pick(REGS_16);
+            case 32: return g.pick(REGS_32);
+            default: return g.pick(REGS_64);
+        }
+    }
+
+    static int operand_size(Generator& g, Mode mode) {
+        constexpr int sizes[] = { 8, 16, 32, 64 };
+        return sizes[g.below(mode == Mode::M64 ? 4 : 3)];
+    }
+
+    // Half of the immediates fit in a sign-extended imm8, which is what real code mostly uses
+    static std::string immediate(Generator& g, int size) {
+        if (g.chance(50)) {
+            return std::format("{}", (int)g.below(256) - 128);
+        }
+
+        const uint64_t mask = size >= 32 ? 0x7FFFFFFF : (1ull << size) - 1;
+        return std::format("0x{:X}", g.rng() & mask);
+    }
+
+    static void zo_line(Generator& g) {
+        g.out += g.pick(ZO_OPS);
+        g.out += '\n';
+    }
+
+    static void reg_reg_line(Generator& g, Mode mode) {
+        // Only the legacy 8-bit registers are used, so AH-BH never meet a REX prefix
+        const int size = operand_size(g, mode);
+        g.out += std::format("{} {}, {}\n", g.pick(ALU_OPS), register_of_size(g, size), register_of_size(g, size));
+    }
+
+    static void reg_imm_line(Generator& g, Mode mode) {
+        const int size = operand_size(g, mode);
+        g.out += std::format("{} {}, {}\n", g.pick(ALU_OPS), register_of_size(g, size), immediate(g, size));
+    }
+
+    static void mem_imm16_line(Generator& g) {
+        const bool word = g.chance(60);
+        const std::string_view base = g.pick(BASES_16);
+        const std::string disp = g.chance(60) ? std::format("+0x{:X}", g.below(g.chance(50) ? 0x80 : 0x8000)) : "";
+
+        g.out += std::format(
+            "{} {} [{}{}], {}\n",
+            g.pick(ALU_OPS),
+            word ? "%WORD" : "%BYTE",
+            base,
+            disp,
+            immediate(g, word ? 16 : 8)
+        );
+    }
+
+    static void mem_imm32_line(Generator& g) {
+        const bool dword = g.chance(70);
+        const bool has_base = g.chance(85);
+        const bool has_index = !has_base || g.chance(50);
+
+        std::string address;
+        if (has_base) {
+            address += g.pick(REGS_32);
+        }
+        if (has_index) {
+            address += std::format("{}{}{}", has_base ? "+" : "", g.pick(SCALES), g.pick(INDEXES_32));
+        }
+        if (g.chance(60)) {
+            address += std::format("+0x{:X}", g.below(g.chance(50) ? 0x80 : 0x100000));
+        }
+
+        g.out += std::format(
+            "{} {} [{}], {}\n",
+            g.pick(ALU_OPS),
+            dword ? "%DWORD" : "%BYTE",
+            address,
+            immediate(g, dword ? 32 : 8)
+        );
+    }
+
+    static void comment_line(Generator& g) {
+        g.out += std::format("{} {}\n", g.chance(50) ? ";" : "//", g.pick(COMMENTS));
+    }
+
+    static void mixed_bits_block(Generator& g) {
+        constexpr std::string_view headers[] = { "BITS 16\n", "BITS 32\n", "BITS 64\n" };
+        constexpr Mode modes[] = { Mode::M16, Mode::M32, Mode::M64 };
+
+        const size_t m = g.below(3);
+        g.out += headers[m];
+
+        for (size_t n = 8 + g.below(24); n > 0; --n) {
+            if (g.chance(50)) {
+                reg_reg_line(g, modes[m]);
+            }
+            else {
+                reg_imm_line(g, modes[m]);
+            }
+        }
+    }
+
+    static void commented_instruction(Generator& g) {
+        for (size_t n = g.below(4); n > 0; --n) {
+            comment_line(g);
+        }
+
+        switch (g.below(3)) {
+            case 0: reg_reg_line(g, Mode::M32); break;
+            case 1: reg_imm_line(g, Mode::M32); break;
+            default: mem_imm32_line(g); break;
+        }
+
+        if (g.chance(50)) {
+            g.out.pop_back();
+            g.out += std::format(" ; {}\n", g.pick(COMMENTS));
+        }
+    }
+
+    static void mixed_line(Generator& g) {
+        const size_t roll = g.below(100);
+
+        if (roll < 15) {
+            zo_line(g);
+        }
+        else if (roll < 45) {
+            reg_reg_line(g, Mode::M32);
+        }
+        else if (roll < 70) {
+            reg_imm_line(g, Mode::M32);
+        }
+        else if (roll < 90) {
+            mem_imm32_line(g);
+        }
+        else if (roll < 97) {
+            comment_line(g);
+        }
+        else {
+            g.out += "BITS 16\n";
+            for (size_t n = 4 + g.below(12); n > 0; --n) {
+                mem_imm16_line(g);
+            }
+            g.out += "BITS 32\n";
+        }
+    }
+}
+
+bool parse_corpus_kind(std::string_view name, CorpusKind& kind) {
+    for (const auto& info : CORPUS_KINDS) {
+        if (info.name == name) {
+            kind = info.kind;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string generate_corpus(CorpusKind kind, size_t size, uint64_t seed) {
+    Generator g = { .rng = std::mt19937_64(seed), .out = {} };
+    g.out.reserve(size + 256);
+    g.out += kind == CorpusKind::ALU_MEM_IMM16 ? "BITS 16\n" : "BITS 32\n";
+
+    while (g.out.size() < size) {
+        switch (kind) {
+            case CorpusKind::ZO:            zo_line(g); break;
+            case CorpusKind::ALU_REG_REG:   reg_reg_line(g, Mode::M32); break;
+            case CorpusKind::ALU_REG_IMM:   reg_imm_line(g, Mode::M32); break;
+            case CorpusKind::ALU_MEM_IMM16: mem_imm16_line(g); break;
+            case CorpusKind::ALU_MEM_IMM32: mem_imm32_line(g); break;
+            case CorpusKind::MIXED_BITS:    mixed_bits_block(g); break;
+            case CorpusKind::COMMENTS:      commented_instruction(g); break;
+            case CorpusKind::MIXED:         mixed_line(g); break;
+        }
+    }
+
+    return std::move(g.out);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class CorpusKind {
+    ZO,
+    ALU_REG_REG,
+    ALU_REG_IMM,
+    ALU_MEM_IMM16,      // 16-bit addressing forms
+    ALU_MEM_IMM32,      // 32-bit addressing forms with SIB
+    MIXED_BITS,         // short blocks alternating between BITS 16, 32 and 64
+    COMMENTS,           // about two thirds of the input is comments
+    MIXED               // weighted blend of everything above
+};
+
+struct CorpusInfo {
+    CorpusKind          kind;
+    std::string_view    name;
+};
+
+constexpr CorpusInfo CORPUS_KINDS[] = {
+    { CorpusKind::ZO,               "zo" },
+    { CorpusKind::ALU_REG_REG,      "alu-reg-reg" },
+    { CorpusKind::ALU_REG_IMM,      "alu-reg-imm" },
+    { CorpusKind::ALU_MEM_IMM16,    "alu-mem-imm16" },
+    { CorpusKind::ALU_MEM_IMM32,    "alu-mem-imm32" },
+    { CorpusKind::MIXED_BITS,       "mixed-bits" },
+    { CorpusKind::COMMENTS,         "comments" },
+    { CorpusKind::MIXED,            "mixed" }
+};
+
+bool parse_corpus_kind(std::string_view name, CorpusKind& kind);
+
+// Generates at least `size` bytes of valid source, the same seed always gives the same corpus
+std::string generate_corpus(CorpusKind kind, size_t size, uint64_t seed);
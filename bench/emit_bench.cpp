@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "audasm.hpp"
+#include "emitter.hpp"
+
+namespace {
+    using audasm::Emitter;
+    using audasm::Mem;
+    using audasm::Operand;
+    using audasm::Reg;
+
+    constexpr size_t DEFAULT_INSTRUCTIONS = 200000;
+    constexpr size_t DEFAULT_RUNS = 5;
+
+    // Writes the source the typed calls stand for, the way a JIT formats it for the text path
+    class TextBuilder {
+    public:
+        TextBuilder& bits(BitsMode b_mode) {
+            std::format_to(std::back_inserter(source), "BITS {}\n", b_mode == M16 ? 16 : b_mode == M32 ? 32 : 64);
+            return *this;
+        }
+
+        TextBuilder& prefix(uint16_t prefixes) {
+            for (const auto& [keyword, bit] : PREFIX_KEYWORDS) {
+                if (prefixes & bit) {
+                    source += keyword;
+                    source.push_back(' ');
+                    prefixes &= ~bit;
+                }
+            }
+            return *this;
+        }
+
+#define X(name, ...) TextBuilder& name() { return line(#name, nullptr, nullptr, nullptr); }
+        ZO_INSTRUCTIONS(X)
+#undef X
+
+#define X(name, ...) TextBuilder& name(const Operand& a, const Operand& b) { return line(#name, &a, &b, nullptr); }
+        ALU_INSTRUCTIONS(X)
+#undef X
+
+#define X(sse, avx, ...)                                                                                              \
+        TextBuilder& sse(const Operand& a, const Operand& b) { return line(#sse, &a, &b, nullptr); }                  \
+        TextBuilder& avx(const Operand& a, const Operand& b) { return line(#avx, &a, &b, nullptr); }                  \
+        TextBuilder& avx(const Operand& a, const Operand& b, const Operand& c) { return line(#avx, &a, &b, &c); }
+        SIMD_INSTRUCTIONS(X)
+#undef X
+
+        std::string source;
+
+    private:
+        TextBuilder& line(std::string_view mnemonic, const Operand* a, const Operand* b, const Operand* c) {
+            source += mnemonic;
+
+            const char* separator = " ";
+            for (const Operand* operand : { a, b, c }) {
+                if (operand != nullptr) {
+                    source += separator;
+                    append_operand(*operand);
+                    separator = ", ";
+                }
+            }
+            source.push_back('\n');
+            return *this;
+        }
+
+        void append_operand(const Operand& operand) {
+            switch (operand.type) {
+                case AsmArgType::REGISTER: {
+                    source += register_info(operand.reg).name;
+                    break;
+                }
+                case AsmArgType::IMMEDIATE: {
+                    std::format_to(std::back_inserter(source), "{}", (int64_t)operand.imm);
+                    break;
+                }
+                case AsmArgType::MEMORY: {
+                    const Mem& mem = operand.mem;
+                    if (mem.size != 0) {
+                        source += mem.size == 8 ? "%BYTE " : mem.size == 16 ? "%WORD " : mem.size == 32 ? "%DWORD " : "%QWORD ";
+                    }
+
+                    const size_t start = source.size();
+                    source.push_back('[');
+                    if (mem.rip) {
+                        source += "RIP";
+                    }
+                    if (mem.base.has_value()) {
+                        source += register_info(*mem.base).name;
+                    }
+                    // An unscaled index after a base reads as a second register, alone it must keep its scale
+                    if (mem.index.has_value() && mem.base.has_value() && mem.scale == 1) {
+                        std::format_to(std::back_inserter(source), "+{}", register_info(*mem.index).name);
+                    }
+                    else if (mem.index.has_value()) {
+                        std::format_to(
+                            std::back_inserter(source),
+                            "{}{}*{}",
+                            mem.base.has_value() ? "+" : "",
+                            mem.scale,
+                            register_info(*mem.index).name
+                        );
+                    }
+                    if (source.size() == start + 1) {
+                        std::format_to(std::back_inserter(source), "{}", mem.disp);
+                    }
+                    else if (mem.disp != 0) {
+                        std::format_to(std::back_inserter(source), "{:+}", mem.disp);
+                    }
+                    source.push_back(']');
+                    break;
+                }
+            }
+        }
+    };
+
+    // One group of the routine, a mix of every family and of the common operand forms, `i` varies the constants
+    constexpr size_t GROUP_INSTRUCTIONS = 16;
+
+    template<typename Builder> void emit_group(Builder& a, int32_t i) {
+        a.ADD(Reg::EAX, Mem{ Reg::RBX, Reg::RCX, 4, 8 * i });
+        a.SUB(Reg::RCX, i);
+        a.XOR(Reg::R8D, Reg::R9D);
+        a.CMP(Mem{ Reg::RSP, {}, 1, 16, 32 }, 1000 + i);
+        a.AND(Mem{ Reg::R13, Reg::R10, 8, -i }, Reg::RDX);
+        a.OR(Reg::AL, 0x40);
+        a.ADC(Reg::R15, Mem{ .disp = 64 * i, .rip = true });
+        a.SBB(Mem{ Reg::RBP, {}, 1, 0, 16 }, -1);
+        a.VPADDD(Reg::YMM0, Reg::YMM1, Mem{ Reg::RDI, Reg::RSI, 2, 32 });
+        a.PXOR(Reg::XMM3, Reg::XMM11);
+        a.MOVDQU(Reg::XMM2, Mem{ Reg::RAX, {}, 1, 16 * i });
+        a.VMOVAPS(Mem{ Reg::R12, {}, 1, 32 }, Reg::YMM7);
+        a.prefix(PREFIX_LOCK).ADD(Mem{ Reg::RDX }, Reg::EBX);
+        a.LFENCE();
+        a.CDQE();
+        a.ADD(Reg::RSP, 8);
+    }
+
+    // Legacy modes, only used to check the byte identity of their memory forms
+    template<typename Builder> void emit_legacy(Builder& a) {
+        a.bits(M32);
+        a.ADD(Reg::EAX, Mem{ Reg::EBX, Reg::ECX, 4, 8 });
+        a.SUB(Mem{ Reg::ESP, {}, 1, 4, 16 }, 300);
+        a.PADDD(Reg::XMM1, Mem{ {}, Reg::EDX, 8, 0x100 });
+        a.bits(M16);
+        a.ADD(Reg::AX, Mem{ Reg::BX, Reg::SI, 1, 4 });
+        a.CMP(Mem{ Reg::BP, Reg::DI, 1, 0, 8 }, 7);
+        a.XOR(Mem{ .disp = 0x200 }, Reg::DX);
+        a.PUSHA();
+        a.bits(M64);
+    }
+
+    template<typename Builder> void emit_routine(Builder& a, size_t groups) {
+        for (size_t i = 0; i < groups; ++i) {
+            emit_group(a, (int32_t)(i % 97));
+        }
+    }
+
+    struct Measurement {
+        double  best_seconds;
+        size_t  bytes;
+    };
+
+    template<typename Run> static Measurement measure(size_t runs, Run run) {
+        Measurement m = { .best_seconds = 1e30, .bytes = 0 };
+        for (size_t r = 0; r < runs; ++r) {
+            const auto start = std::chrono::steady_clock::now();
+            m.bytes = run();
+            const auto end = std::chrono::steady_clock::now();
+            m.best_seconds = std::min(m.best_seconds, std::chrono::duration<double>(end - start).count());
+        }
+        return m;
+    }
+
+    static bool check_identical(bool optimize) {
+        TextBuilder text;
+        text.bits(M64);
+        emit_routine(text, 97);
+        emit_legacy(text);
+
+        Emitter typed(M64, optimize);
+        emit_routine(typed, 97);
+        emit_legacy(typed);
+
+        const audasm::Result from_text = audasm::assemble(text.source, { .b_mode = M64, .optimize = optimize });
+        const audasm::Result from_typed = typed.finish();
+
+        if (!from_text.success || !from_typed.success) {
+            std::cerr << "Error: The routine does not assemble" << std::endl << from_text.diagnostics << from_typed.diagnostics;
+            return false;
+        }
+        else if (from_text.bytes != from_typed.bytes) {
+            const auto [t, e] = std::mismatch(from_text.bytes.begin(), from_text.bytes.end(), from_typed.bytes.begin(), from_typed.bytes.end());
+            std::cerr << std::format(
+                "Error: The typed path differs from the text path at byte {}{}",
+                t - from_text.bytes.begin(),
+                optimize ? " with -O" : ""
+            ) << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const size_t instructions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : DEFAULT_INSTRUCTIONS;
+    const size_t runs = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : DEFAULT_RUNS;
+    if (instructions < GROUP_INSTRUCTIONS || runs == 0 || argc > 3) {
+        std::cerr << "Usage: emit_bench [instructions] [runs]" << std::endl;
+        return -1;
+    }
+
+    if (!check_identical(false) || !check_identical(true)) {
+        return -1;
+    }
+
+    const size_t groups = instructions / GROUP_INSTRUCTIONS;
+    const size_t count = groups * GROUP_INSTRUCTIONS;
+
+    TextBuilder prepared;
+    emit_routine(prepared, groups);
+
+    // Formatting the source and assembling it, what a JIT going through the text pays
+    const Measurement text = measure(runs, [groups] {
+        TextBuilder builder;
+        emit_routine(builder, groups);
+        return audasm::assemble(builder.source, { .b_mode = M64 }).bytes.size();
+    });
+
+    // Assembling a source formatted beforehand
+    const Measurement parse = measure(runs, [&prepared] {
+        return audasm::assemble(prepared.source, { .b_mode = M64 }).bytes.size();
+    });
+
+    const Measurement typed = measure(runs, [groups] {
+        Emitter emitter(M64);
+        emit_routine(emitter, groups);
+        return emitter.finish().bytes.size();
+    });
+
+    std::cout << std::format("{} instructions, {} bytes, best of {} runs, output identical", count, typed.bytes, runs) << std::endl;
+    std::cout << std::format("{:<22} {:>14} {:>12} {:>10}", "path", "instr/s", "ns/instr", "speedup") << std::endl;
+    for (const auto& [name, m] : { std::pair { "format + assemble", text }, std::pair { "assemble only", parse }, std::pair { "typed emitter", typed } }) {
+        std::cout << std::format(
+            "{:<22} {:>14.0f} {:>12.1f} {:>9.1f}x",
+            name,
+            count / m.best_seconds,
+            m.best_seconds * 1e9 / count,
+            text.best_seconds / m.best_seconds
+        ) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "audasm.hpp"
+#include "jit.hpp"
+
+namespace {
+    constexpr size_t ROUTINE_SIZE = 1024;
+    constexpr size_t RESET_INTERVAL = 64;
+
+    // Each group adds 2 to EAX, the routine returns 2 * groups
+    static std::string make_routine(size_t& groups) {
+        std::string source = "BITS 64\nXOR EAX, EAX\n";
+        constexpr size_t header_size = audasm::assemble<"BITS 64\nXOR EAX, EAX">().size();
+        constexpr size_t group_size = audasm::assemble<"BITS 64\nADD EAX, 3\nVPADDD XMM0, XMM0, XMM1\nADD RCX, RDX\nSUB EAX, 1">().size();
+
+        groups = (ROUTINE_SIZE - header_size - 1) / group_size;
+        for (size_t i = 0; i < groups; ++i) {
+            source += "ADD EAX, 3\nVPADDD XMM0, XMM0, XMM1\nADD RCX, RDX\nSUB EAX, 1\n";
+        }
+        source += "RET\n";
+        return source;
+    }
+
+    static void print_distribution(const char* name, std::vector<double>& samples) {
+        std::sort(samples.begin(), samples.end());
+
+        double total = 0;
+        for (double s : samples) {
+            total += s;
+        }
+
+        std::cout << std::format(
+            "  {:<20} min {:>8.2f} us   median {:>8.2f} us   p99 {:>8.2f} us   mean {:>8.2f} us",
+            name,
+            samples.front(),
+            samples[samples.size() / 2],
+            samples[samples.size() * 99 / 100],
+            total / samples.size()
+        ) << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+    if (iterations == 0) {
+        std::cerr << "Usage: jit_latency [iterations]" << std::endl;
+        return -1;
+    }
+
+    size_t groups;
+    const std::string routine = make_routine(groups);
+
+    audasm::CodeArena arena;
+    std::vector<double> total_us;
+    std::vector<double> commit_us;
+    total_us.reserve(iterations);
+    commit_us.reserve(iterations);
+
+    size_t routine_bytes = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        if (i % RESET_INTERVAL == 0) {
+            audasm::reset(arena);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const audasm::JitResult result = audasm::assemble_jit(arena, routine);
+        const auto assembled = std::chrono::steady_clock::now();
+        const bool committed = result.success && audasm::commit(arena);
+        const auto end = std::chrono::steady_clock::now();
+
+        if (!committed) {
+            std::cerr << "Error: Could not assemble and commit the routine" << std::endl << result.diagnostics;
+            return -1;
+        }
+
+#if defined(__x86_64__) || defined(_M_X64)
+        if (i == 0) {
+            const int value = ((int (*)())result.entry)();
+            if (value != (int)(2 * groups)) {
+                std::cerr << std::format("Error: Routine returned {}, expected {}", value, 2 * groups) << std::endl;
+                return -1;
+            }
+        }
+#endif
+
+        routine_bytes = result.size;
+        total_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        commit_us.push_back(std::chrono::duration<double, std::micro>(end - assembled).count());
+    }
+
+    std::cout << std::format("JIT latency, {} byte routine, {} iterations:", routine_bytes, iterations) << std::endl;
+    print_distribution("assemble + commit", total_us);
+    print_distribution("commit only", commit_us);
+    return 0;
+}
@@ -0,0 +1,486 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "argument.hpp"
+#include "context.hpp"
+#include "encoding.hpp"
+#include "genformats.hpp"
+#include "memory.hpp"
+#include "output_format.hpp"
+#include "parsing_utils.hpp"
+#include "perf_counters.hpp"
+
+namespace {
+    // Operands are written the way the assembler sees them, upper-cased and trimmed
+    struct Operand {
+        BitsMode            b_mode;
+        std::string_view    text;
+        size_t              n_args;
+    };
+
+    constexpr Operand MEMORY_OPERANDS[] = {
+        { M16, "BX+SI+4",           1 },
+        { M16, "BP+DI",             1 },
+        { M16, "SI+0X200",          1 },
+        { M32, "EAX",               1 },
+        { M32, "EBX+2*ECX",         1 },
+        { M32, "4*EDX+EAX+0X10",    1 },
+        { M32, "EBP-8",             1 },
+        { M32, "ESP+0X20",          1 },
+        { M64, "RIP+0X100",         1 },
+        { M64, "R9+8*R10-8",        1 },
+        { M64, "RSP",               1 },
+        { M64, "R13+0X7F",          1 }
+    };
+
+    constexpr std::string_view NUMBERS[] = {
+        "0", "42", "-128", "0X7F", "0X12345678", "0B1011", "0O755", "4294967295"
+    };
+
+    constexpr Operand ARGUMENT_LISTS[] = {
+        { M32, "EAX, 0X10",                 2 },
+        { M32, "%DWORD [EAX+4*ECX+8], 5",   2 },
+        { M16, "AL, BL",                    2 },
+        { M64, "RAX, [RIP+0X40]",           2 },
+        { M64, "XMM1, XMM2, [R9]",          3 },
+        { M32, "[EBX], ECX",                2 }
+    };
+
+    struct NullBuffer : std::streambuf {
+        int overflow(int c) override {
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char*, std::streamsize n) override {
+            return n;
+        }
+    };
+
+    // Bytes formatted per pass of the text output benchmarks, one operation is one byte
+    constexpr size_t TEXT_BLOCK_SIZE = 4096;
+
+    struct ParsedOperand {
+        BitsMode                b_mode;
+        MemoryOperandDescriptor mdesc;
+    };
+
+    struct Fixture {
+        Context                     ctx;
+        std::vector<std::string>    memory_texts;
+        std::vector<ParsedOperand>  memory_operands;
+
+        std::vector<uint8_t>                text_block;
+        NullBuffer                          text_sink;
+        std::unique_ptr<TextOutputBuffer>   text_outputs[std::size(OUTPUT_FORMATS)];   // indexed by OutputFormat
+    };
+
+    // Keeps results observable so the calls are not optimized away
+    volatile uint64_t sink;
+
+    static int32_t operand_size(BitsMode mode) {
+        return mode == M16 ? 16 : mode == M32 ? 32 : 64;
+    }
+
+    static void bench_parse_number(Fixture& f) {
+        for (const auto& s : NUMBERS) {
+            uint64_t value;
+            parse_number(f.ctx, s, value);
+            sink = value;
+        }
+    }
+
+    static void bench_parse_memory(Fixture& f) {
+        for (size_t i = 0; i < f.memory_texts.size(); ++i) {
+            f.ctx.b_mode = MEMORY_OPERANDS[i].b_mode;
+
+            MemoryOperandDescriptor mdesc;
+            parse_memory(f.ctx, f.memory_texts[i], mdesc);
+            sink = mdesc.disp;
+        }
+    }
+
+    static void bench_make_modrm_sib(Fixture& f) {
+        for (const auto& op : f.memory_operands) {
+            f.ctx.b_mode = op.b_mode;
+
+            MemoryOperand mop;
+            make_modrm_sib(f.ctx, op.mdesc, 1, mop);
+            sink = mop.modrm;
+        }
+    }
+
+    static void bench_expect_arguments(Fixture& f) {
+        for (const auto& op : ARGUMENT_LISTS) {
+            f.ctx.b_mode = op.b_mode;
+            sink = expect_arguments(f.ctx, op.text, op.n_args).size();
+        }
+    }
+
+    static void bench_x86_format_mi(Fixture& f) {
+        f.ctx.output_buffer.clear();
+
+        for (const auto& op : f.memory_operands) {
+            f.ctx.b_mode = op.b_mode;
+            EncodedInstruction ins;
+            if (x86_format_mi(f.ctx, FormatMI {
+                .mdesc          = op.mdesc,
+                .size_override  = (uint8_t)operand_size(op.b_mode),
+                .imm            = 0x12,
+                .default_reg_v  = 0,
+                .r8_imm8_op     = 0x80,
+                .r_imm_def_op   = 0x81,
+                .r_def_imm8_op  = 0x83
+            }, ins)) {
+                emit_instruction(f.ctx, ins);
+            }
+        }
+        sink = f.ctx.output_buffer.size();
+    }
+
+    static void bench_x86_format_mr(Fixture& f) {
+        f.ctx.output_buffer.clear();
+
+        for (const auto& op : f.memory_operands) {
+            f.ctx.b_mode = op.b_mode;
+            EncodedInstruction ins;
+            if (x86_format_mr(f.ctx, FormatMR {
+                .mdesc          = op.mdesc,
+                .size_override  = 0,
+                .reg_size       = operand_size(op.b_mode),
+                .default_reg_v  = 1,
+                .r8_rm8_op      = 0x00,
+                .r_rm_def_op    = 0x01,
+                .prefixes       = {},
+                .ex_prefixes    = {}
+            }, ins)) {
+                emit_instruction(f.ctx, ins);
+            }
+        }
+        sink = f.ctx.output_buffer.size();
+    }
+
+    // Every 16 and 32-bit operand in both legacy modes and at every operand size, so the prefix choice keeps changing ;
+    // the immediate takes the full-size forms without a truncation warning
+    constexpr BitsMode LEGACY_MODES[] = { M16, M32 };
+    constexpr uint8_t LEGACY_OPERAND_SIZES[] = { 8, 16, 32 };
+
+    constexpr size_t MIXED_OPERATIONS = [] {
+        size_t n = 0;
+        for (const auto& op : MEMORY_OPERANDS) {
+            n += op.b_mode != M64;
+        }
+        return n * std::size(LEGACY_MODES) * std::size(LEGACY_OPERAND_SIZES);
+    }();
+
+    static void bench_x86_format_mi_mixed(Fixture& f) {
+        f.ctx.output_buffer.clear();
+
+        for (const auto& op : f.memory_operands) {
+            if (op.b_mode == M64) {
+                continue;
+            }
+
+            for (const BitsMode mode : LEGACY_MODES) {
+                f.ctx.b_mode = mode;
+                for (const uint8_t size : LEGACY_OPERAND_SIZES) {
+                    EncodedInstruction ins;
+                    if (x86_format_mi(f.ctx, FormatMI {
+                        .mdesc          = op.mdesc,
+                        .size_override  = size,
+                        .imm            = 0xFF,
+                        .default_reg_v  = 0,
+                        .r8_imm8_op     = 0x80,
+                        .r_imm_def_op   = 0x81,
+                        .r_def_imm8_op  = 0x83
+                    }, ins)) {
+                        emit_instruction(f.ctx, ins);
+                    }
+                }
+            }
+        }
+        sink = f.ctx.output_buffer.size();
+    }
+
+    static void bench_x86_format_mr_mixed(Fixture& f) {
+        f.ctx.output_buffer.clear();
+
+        for (const auto& op : f.memory_operands) {
+            if (op.b_mode == M64) {
+                continue;
+            }
+
+            for (const BitsMode mode : LEGACY_MODES) {
+                f.ctx.b_mode = mode;
+                for (const uint8_t size : LEGACY_OPERAND_SIZES) {
+                    EncodedInstruction ins;
+                    if (x86_format_mr(f.ctx, FormatMR {
+                        .mdesc          = op.mdesc,
+                        .size_override  = 0,
+                        .reg_size       = size,
+                        .default_reg_v  = 1,
+                        .r8_rm8_op      = 0x00,
+                        .r_rm_def_op    = 0x01,
+                        .prefixes       = {},
+                        .ex_prefixes    = {}
+                    }, ins)) {
+                        emit_instruction(f.ctx, ins);
+                    }
+                }
+            }
+        }
+        sink = f.ctx.output_buffer.size();
+    }
+
+    // A whole pass in one bits mode, the way a source with a single BITS directive is assembled
+    template<BitsMode MODE> static void bench_encode_homogeneous(Fixture& f) {
+        constexpr int32_t size = MODE == M16 ? 16 : MODE == M32 ? 32 : 64;
+        constexpr AsmRegister dest = MODE == M16 ? AsmRegister::BX : MODE == M32 ? AsmRegister::EBX : AsmRegister::RBX;
+        constexpr AsmRegister source = MODE == M16 ? AsmRegister::DX : MODE == M32 ? AsmRegister::EDX : AsmRegister::RDX;
+
+        f.ctx.b_mode = MODE;
+        f.ctx.output_buffer.clear();
+
+        for (const auto& op : f.memory_operands) {
+            if (op.b_mode != MODE) {
+                continue;
+            }
+
+            EncodedInstruction mi;
+            if (x86_format_mi(f.ctx, FormatMI {
+                .mdesc          = op.mdesc,
+                .size_override  = (uint8_t)size,
+                .imm            = 0xFF,
+                .default_reg_v  = 0,
+                .r8_imm8_op     = 0x80,
+                .r_imm_def_op   = 0x81,
+                .r_def_imm8_op  = 0x83
+            }, mi)) {
+                emit_instruction(f.ctx, mi);
+            }
+            EncodedInstruction mr;
+            if (x86_format_mr(f.ctx, FormatMR {
+                .mdesc          = op.mdesc,
+                .size_override  = 0,
+                .reg_size       = size,
+                .default_reg_v  = 2,
+                .r8_rm8_op      = 0x00,
+                .r_rm_def_op    = 0x01,
+                .prefixes       = {},
+                .ex_prefixes    = {}
+            }, mr)) {
+                emit_instruction(f.ctx, mr);
+            }
+        }
+
+        EncodedInstruction rr;
+        if (x86_format_rr(f.ctx, "ADD", FormatRR {
+            .reg_source         = source,
+            .reg_source_size    = size,
+            .reg_dest           = dest,
+            .reg_dest_size      = size,
+            .r8_op              = 0x00,
+            .r_def_op           = 0x01
+        }, rr)) {
+            emit_instruction(f.ctx, rr);
+        }
+        EncodedInstruction ri;
+        if (x86_format_ri(f.ctx, "ADD", FormatRI {
+            .reg            = dest,
+            .reg_size       = size,
+            .imm            = 0xFF,
+            .default_reg_v  = 0,
+            .r8_imm8_op     = 0x80,
+            .r_def_imm8_op  = 0x83,
+            .r_imm_def_op   = 0x81
+        }, ri)) {
+            emit_instruction(f.ctx, ri);
+        }
+        sink = f.ctx.output_buffer.size();
+    }
+
+    template<OutputFormat FORMAT> static void bench_format_text(Fixture& f) {
+        f.text_outputs[(size_t)FORMAT]->sputn((const char*)f.text_block.data(), (std::streamsize)f.text_block.size());
+    }
+
+    // Two memory forms per operand of the mode, plus the register forms
+    constexpr size_t homogeneous_operations(BitsMode mode) {
+        size_t n = 2;
+        for (const auto& op : MEMORY_OPERANDS) {
+            n += op.b_mode == mode ? 2 : 0;
+        }
+        return n;
+    }
+
+    struct MicroBenchmark {
+        std::string_view    name;
+        void                (*run)(Fixture& f);
+        size_t              ops_per_pass;
+    };
+
+    constexpr MicroBenchmark BENCHMARKS[] = {
+        { "parse_number",        bench_parse_number,            std::size(NUMBERS) },
+        { "parse_memory",        bench_parse_memory,            std::size(MEMORY_OPERANDS) },
+        { "make_modrm_sib",      bench_make_modrm_sib,          std::size(MEMORY_OPERANDS) },
+        { "expect_arguments",    bench_expect_arguments,        std::size(ARGUMENT_LISTS) },
+        { "x86_format_mi",       bench_x86_format_mi,           std::size(MEMORY_OPERANDS) },
+        { "x86_format_mr",       bench_x86_format_mr,           std::size(MEMORY_OPERANDS) },
+        { "x86_format_mi_mixed", bench_x86_format_mi_mixed,     MIXED_OPERATIONS },
+        { "x86_format_mr_mixed", bench_x86_format_mr_mixed,     MIXED_OPERATIONS },
+        { "encode_bits16",       bench_encode_homogeneous<M16>, homogeneous_operations(M16) },
+        { "encode_bits32",       bench_encode_homogeneous<M32>, homogeneous_operations(M32) },
+        { "encode_bits64",       bench_encode_homogeneous<M64>, homogeneous_operations(M64) },
+        { "text_hex",            bench_format_text<OutputFormat::HEX>,      TEXT_BLOCK_SIZE },
+        { "text_carray",         bench_format_text<OutputFormat::CARRAY>,   TEXT_BLOCK_SIZE },
+        { "text_ihex",           bench_format_text<OutputFormat::IHEX>,     TEXT_BLOCK_SIZE }
+    };
+
+    static bool setup_fixture(Fixture& f) {
+        for (const auto& op : MEMORY_OPERANDS) {
+            f.ctx.b_mode = op.b_mode;
+            f.memory_texts.emplace_back(op.text);
+
+            MemoryOperandDescriptor mdesc;
+            if (!parse_memory(f.ctx, f.memory_texts.back(), mdesc)) {
+                return false;
+            }
+            f.memory_operands.push_back(ParsedOperand { .b_mode = op.b_mode, .mdesc = mdesc });
+        }
+
+        // Spread over every byte value, like code is
+        for (size_t i = 0; i < TEXT_BLOCK_SIZE; ++i) {
+            f.text_block.push_back((uint8_t)((i * 0x9E3779B1u) >> 24));
+        }
+        for (const auto& info : OUTPUT_FORMATS) {
+            f.text_outputs[(size_t)info.format] = std::make_unique<TextOutputBuffer>(&f.text_sink, info.format);
+        }
+        return !f.ctx.on_error;
+    }
+
+    static std::string per_op(const PerfCounters& counters, PerfEvent event, uint64_t operations) {
+        return perf_counter_available(counters, event)
+            ? std::format("{:.2f}", (double)counters.values[event] / operations)
+            : "null";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t passes = 100000;
+    std::string_view filter;
+    const char* output_path = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        // No pass at all would divide by zero in the per-operation figures
+        if (arg == "--passes" && i + 1 < argc && std::strtoull(argv[i + 1], nullptr, 10) != 0) {
+            passes = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        }
+        else {
+            std::cerr << "Usage: micro_bench [--passes <n>] [--filter <name>] [--output <json file>]" << std::endl;
+            return -1;
+        }
+    }
+
+    NullBuffer null_buffer;
+    std::ostream null_stream(&null_buffer);
+
+    Fixture f = {
+        .ctx = Context {
+            .b_mode         = M32,
+            .line_no        = 1,
+            .output_file    = nullptr,
+            .diagnostics    = &null_stream,
+            .on_error       = false,
+            .optimize       = false
+        },
+        .memory_texts       = {},
+        .memory_operands    = {}
+    };
+
+    if (!setup_fixture(f)) {
+        std::cerr << "Error: Could not parse the benchmark operands" << std::endl;
+        return -1;
+    }
+
+    PerfCounters counters;
+    const bool hardware_counters = open_perf_counters(counters);
+
+    std::ostringstream json;
+    json << "{\n";
+    json << std::format("  \"counters\": \"{}\",\n", hardware_counters ? "perf_event_open" : "wall_clock");
+    json << std::format("  \"passes\": {},\n", passes);
+    json << "  \"benchmarks\": [";
+
+    bool first = true;
+    for (const auto& bench : BENCHMARKS) {
+        if (!filter.empty() && bench.name.find(filter) == std::string_view::npos) {
+            continue;
+        }
+
+        for (size_t i = 0; i < passes / 10 + 1; ++i) {
+            bench.run(f);
+        }
+
+        start_perf_counters(counters);
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < passes; ++i) {
+            bench.run(f);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        stop_perf_counters(counters);
+
+        if (f.ctx.on_error) {
+            std::cerr << std::format("Error: `{}` reported an error on the benchmark operands", bench.name) << std::endl;
+            return -1;
+        }
+
+        const uint64_t operations = (uint64_t)passes * bench.ops_per_pass;
+        const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        json << (first ? "\n" : ",\n");
+        json << "    {\n";
+        json << std::format("      \"name\": \"{}\",\n", bench.name);
+        json << std::format("      \"operations\": {},\n", operations);
+        json << std::format("      \"ns_per_op\": {:.2f}", ns / operations);
+        for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+            json << std::format(",\n      \"{}_per_op\": {}", PERF_EVENT_NAMES[e], per_op(counters, (PerfEvent)e, operations));
+        }
+        json << "\n    }";
+        first = false;
+    }
+
+    json << "\n  ]\n}\n";
+    close_perf_counters(counters);
+
+    if (output_path != nullptr) {
+        std::ofstream output_file(output_path);
+        output_file << json.str();
+        if (!output_file) {
+            std::cerr << "Error: could not write " << output_path << std::endl;
+            return -1;
+        }
+    }
+    else {
+        std::cout << json.str();
+    }
+
+    return 0;
+}
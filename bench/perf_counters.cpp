@@ -0,0 +1,96 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf_counters.hpp"
+
+namespace {
+#if defined(__linux__)
+    constexpr uint64_t PERF_EVENT_CONFIGS[PERF_EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    static int open_event(uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+bool open_perf_counters(PerfCounters& counters) {
+    bool any = false;
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+        counters.values[i] = 0;
+#if defined(__linux__)
+        counters.fds[i] = open_event(PERF_EVENT_CONFIGS[i]);
+#else
+        counters.fds[i] = -1;
+#endif
+        any |= counters.fds[i] >= 0;
+    }
+
+    return any;
+}
+
+void close_perf_counters(PerfCounters& counters) {
+    for (int& fd : counters.fds) {
+#if defined(__linux__)
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+        fd = -1;
+    }
+}
+
+bool perf_counter_available(const PerfCounters& counters, PerfEvent event) {
+    return counters.fds[event] >= 0;
+}
+
+void start_perf_counters(PerfCounters& counters) {
+#if defined(__linux__)
+    for (int fd : counters.fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void stop_perf_counters(PerfCounters& counters) {
+#if defined(__linux__)
+    for (int fd : counters.fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+        uint64_t value = 0;
+        if (counters.fds[i] < 0 || read(counters.fds[i], &value, sizeof(value)) != (ssize_t)sizeof(value)) {
+            value = 0;
+        }
+        counters.values[i] = value;
+    }
+#endif
+}
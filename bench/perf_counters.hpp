@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+
+    PERF_EVENT_COUNT
+};
+
+constexpr std::string_view PERF_EVENT_NAMES[PERF_EVENT_COUNT] = {
+    "cycles",
+    "instructions",
+    "branch_misses",
+    "cache_misses"
+};
+
+// Hardware counters of the calling thread, each event is opened on its own so a missing one does not disable the others
+struct PerfCounters {
+    int         fds[PERF_EVENT_COUNT];
+    uint64_t    values[PERF_EVENT_COUNT];
+};
+
+// Returns false if no counter could be opened (not Linux, or perf_event_paranoid too strict), wall-clock time still works
+bool open_perf_counters(PerfCounters& counters);
+void close_perf_counters(PerfCounters& counters);
+bool perf_counter_available(const PerfCounters& counters, PerfEvent event);
+
+void start_perf_counters(PerfCounters& counters);
+void stop_perf_counters(PerfCounters& counters);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+// Accounting of the global operator new and delete, compiled in by configuring with -DAUDASM_ALLOC_STATS=ON.
+// Every allocation made while it runs records its stack, the report attributes them to the first frame outside
+// of the standard library.
+bool alloc_stats_available();
+void start_alloc_stats();
+void stop_alloc_stats();
+
+// Stops the accounting if it still runs, `lines` is the number of source lines the allocations are spread over
+void print_alloc_stats(uint64_t lines);
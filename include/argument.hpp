@@ -1,10 +1,19 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <format>
+#include <ostream>
+#include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include "context.hpp"
 #include "memory.hpp"
+#include "parsing_utils.hpp"
 #include "registers.hpp"
+#include "stats.hpp"
 
 enum class AsmArgType {
     IMMEDIATE,
@@ -20,3 +29,123 @@ struct AsmArg {
         std::pair<MemoryOperandDescriptor, uint8_t> mem;
     };
 };
+
+constexpr std::vector<AsmArg> expect_arguments(Context& ctx, const std::string_view& s, size_t N) {
+    StatsScope scope(ctx.stats, PHASE_LEX);
+
+    std::string_view normalized = trim_string(s);
+    
+    size_t comment_pos = normalized.find_first_of(';');
+    if (comment_pos != std::string_view::npos) {
+        normalized = normalized.substr(0, comment_pos);
+    }
+
+    std::vector<std::string_view> args = split_string(normalized, ',');
+    if (args.size() != N) {
+        return {};
+    }
+
+    std::vector<AsmArg> parsed_args;
+
+    for (const auto& arg : args) {
+        std::string_view trimmed_arg = trim_string(arg);
+        uint8_t size_override = 0;
+
+        if (trimmed_arg.starts_with("%BYTE")) {
+            constexpr size_t prefix_length = 5;
+            size_override = 8;
+            trimmed_arg = trim_string(trimmed_arg.substr(prefix_length));
+        }
+        else if (trimmed_arg.starts_with("%WORD")) {
+            constexpr size_t prefix_length = 5;
+            size_override = 16;
+            trimmed_arg = trim_string(trimmed_arg.substr(prefix_length));
+        }
+        else if (trimmed_arg.starts_with("%DWORD")) {
+            constexpr size_t prefix_length = 6;
+            size_override = 32;
+            trimmed_arg = trim_string(trimmed_arg.substr(prefix_length));
+        }
+        else if (trimmed_arg.starts_with("%QWORD")) {
+            constexpr size_t prefix_length = 6;
+            size_override = 64;
+            trimmed_arg = trim_string(trimmed_arg.substr(prefix_length));
+        }
+
+        if (const RegisterName* reg = find_register(trimmed_arg)) {
+            if (size_override != 0) {
+                diagnose(ctx,
+                    "Error on line {}: Did not expect a size prefix before a register",
+                    ctx.line_no
+                );
+                ctx.on_error = true;
+                return {};
+            }
+
+            parsed_args.emplace_back(AsmArg {
+                .type = AsmArgType::REGISTER,
+                .reg = { reg->reg, reg->size }
+            });
+        }
+        else if (trimmed_arg.starts_with('[')) {
+            if (trimmed_arg.ends_with(']')) {
+                std::string_view memop = trimmed_arg.substr(1, trimmed_arg.size() - 2);
+                /// TODO: parse memory operand
+                MemoryOperandDescriptor mdesc;
+                if (!parse_memory(ctx, std::string(memop), mdesc)) {
+                    diagnose(ctx,
+                        "Error on line {}: Invalid memory operand detected for `{}`",
+                        ctx.line_no,
+                        trimmed_arg
+                    );
+                    ctx.on_error = true;
+                    return {};
+                }
+
+                parsed_args.emplace_back(AsmArg {
+                    .type = AsmArgType::MEMORY,
+                    .mem = { mdesc, size_override }
+                });
+            }
+            else {
+                diagnose(ctx,
+                    "Error on line {}: Did not expect '[' in '{}' (found in '{}')",
+                    ctx.line_no,
+                    trimmed_arg,
+                    s
+                );
+                ctx.on_error = true;
+                return {};
+            }
+        }
+        else {
+            if (size_override != 0) {
+                diagnose(ctx,
+                    "Error on line {}: Did not expect a size prefix before an immediate",
+                    ctx.line_no
+                );
+                ctx.on_error = true;
+                return {};
+            }
+            
+            uint64_t imm;
+            if (!parse_number(ctx, trimmed_arg, imm)) {
+                diagnose(ctx,
+                    "Error on line {}: Invalid argument format for `{}`",
+                    ctx.line_no,
+                    trimmed_arg
+                );
+                ctx.on_error = true;
+                return {};
+            }                
+            else {
+                parsed_args.emplace_back(AsmArg {
+                    .type = AsmArgType::IMMEDIATE,
+                    .imm = imm
+                });
+            }
+        }
+    }
+
+    return parsed_args;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "context.hpp"
+#include "directives.hpp"
+#include "encoding.hpp"
+#include "formats.hpp"
+#include "parsing_utils.hpp"
+#include "preprocessor.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+// Assembles one normalized line. Instructions, prefixes and BITS also assemble in constant evaluation, the data and
+// alignment directives only at run time
+constexpr void assemble_line(Context& ctx, const std::string_view& s) {
+    TRACE_SCOPE_LINE("assemble_line", ctx.line_no);
+
+    if (s.empty() || s.starts_with("//") || s.starts_with(";") || s.starts_with("#")) {
+        return;
+    }
+    else if (s.starts_with("BITS ")) {
+        constexpr size_t prefix_length = 5;
+        change_bits_mode(ctx, s.substr(prefix_length));
+    }
+    else if (s.starts_with("[BITS ")) {
+        constexpr size_t prefix_length = 6;
+        change_bits_mode(ctx, s.substr(prefix_length, s.size() - prefix_length - 1));
+    }
+    else if (s.starts_with("ALIGN ")) {
+        constexpr size_t prefix_length = 6;
+        assemble_align(ctx, s.substr(prefix_length));
+    }
+    else if (s.starts_with("DB ") || s.starts_with("DW ") || s.starts_with("DD ") || s.starts_with("DQ ")) {
+        constexpr size_t prefix_length = 3;
+        const size_t width =
+            s[1] == 'B' ? 1 :
+            s[1] == 'W' ? 2 :
+            s[1] == 'D' ? 4 :
+            8;
+        assemble_data(ctx, s.substr(0, 2), width, s.substr(prefix_length));
+    }
+    else if (s.starts_with("TIMES ")) {
+        constexpr size_t prefix_length = 6;
+        std::string_view rest = trim_string(s.substr(prefix_length));
+
+        size_t delimiter_pos = rest.find(" ");
+        if (delimiter_pos == std::string_view::npos) {
+            diagnose(ctx,
+                "Error on line {}: Missing instruction or data after `TIMES {}`",
+                ctx.line_no,
+                rest
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        uint64_t count;
+        if (!parse_number(ctx, rest.substr(0, delimiter_pos), count)) {
+            return;
+        }
+        else if ((int64_t)count < 0) {
+            diagnose(ctx,
+                "Error on line {}: Negative repetition count for `TIMES`",
+                ctx.line_no
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        // The item is encoded once, then its bytes are replicated. Padding depends on the offset it starts at, copies
+        // of it would not align anything.
+        const std::string_view item = trim_string(rest.substr(delimiter_pos + 1));
+        if (item.starts_with("ALIGN ")) {
+            diagnose(ctx,
+                "Error on line {}: `ALIGN` cannot be repeated with `TIMES`, its padding depends on the offset",
+                ctx.line_no
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        const uint64_t start_offset = ctx.offset;
+        assemble_line(ctx, item);
+        if (!ctx.on_error) {
+            replicate_output(ctx, start_offset, count);
+        }
+    }
+    else {
+        std::string_view rest = s;
+        size_t delimiter_pos = rest.find(" ");
+        std::string_view instruction = rest.substr(0, delimiter_pos);
+
+        // Prefixes accumulate in the context until the next instruction, be it on this line or a later one
+        uint16_t prefix;
+        while (parse_prefix(instruction, prefix)) {
+            ctx.contextual_prefixes |= prefix;
+
+            rest = delimiter_pos != std::string_view::npos ? trim_string(rest.substr(delimiter_pos + 1)) : "";
+            if (rest.empty() || rest.starts_with(";")) {
+                return;
+            }
+
+            delimiter_pos = rest.find(" ");
+            instruction = rest.substr(0, delimiter_pos);
+        }
+
+        std::string_view args = delimiter_pos != std::string_view::npos ? rest.substr(delimiter_pos + 1) : "";
+
+        const InstructionName* mnemonic = find_instruction(instruction);
+        if (mnemonic == nullptr) {
+            diagnose(ctx,
+                "Error on line {}: Unknown instruction `{}`",
+                ctx.line_no,
+                instruction
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        // The families only encode, the instruction is emitted here in one copy once it is complete
+        EncodedInstruction ins;
+        bool encoded = false;
+        switch (mnemonic->family) {
+            case InstructionFamily::ZO: encoded = assemble_zo(ctx, instruction, (ZOMnemonic)mnemonic->id, args, ins); break;
+            case InstructionFamily::ALU: encoded = assemble_alu(ctx, instruction, (ALUMnemonic)mnemonic->id, args, ins); break;
+            case InstructionFamily::SIMD: encoded = assemble_simd(ctx, instruction, (SIMDMnemonic)mnemonic->id, args, ins); break;
+        }
+
+        if (encoded) {
+            emit_instruction(ctx, ins);
+        }
+
+        if (ctx.stats != nullptr) {
+            record_instruction(*ctx.stats, mnemonic - INSTRUCTION_NAMES.data(), encoded ? ins.length : 0);
+        }
+    }
+}
+
+// Assembles `input` and every file it includes, the output buffer is flushed before returning
+void assemble_input(Context& ctx, SourceCache& cache, const SourceFile& input);
+
+// Lines fed one at a time, the context and the preprocessor state carry over from one line to the next
+struct LineSession {
+    SourceCache         cache;
+    Preprocessor        pp;
+    const SourceFile*   input;      // empty file named after the line source, relative %INCLUDE paths resolve from it
+};
+
+void begin_line_session(LineSession& session, const std::string& name);
+// The emitted bytes are left in the output buffer, the caller flushes it
+void assemble_session_line(Context& ctx, LineSession& session, const SourceLine& line);
+// Reports blocks and prefixes left open at the end of the session
+void end_line_session(Context& ctx, LineSession& session);
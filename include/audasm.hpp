@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "assembler.hpp"
+#include "context.hpp"
+#include "genformats.hpp"
+#include "instructions.hpp"
+#include "peephole.hpp"
+
+namespace audasm {
+    struct Options {
+        BitsMode    b_mode      = M16;
+        bool        optimize    = false;
+        std::string source_name = "<memory>";   // relative %include paths resolve from its directory
+    };
+
+    struct Result {
+        bool                    success;
+        std::vector<uint8_t>    bytes;
+        std::string             diagnostics;    // every error and warning, one per line
+        PeepholeStats           peephole_stats;
+    };
+
+    // Assembles `source` entirely in memory, nothing is written to disk. Safe to call from several threads at once
+    Result assemble(std::string_view source, const Options& options = {});
+
+    // A string literal passed as a template argument
+    template<size_t N> struct SourceLiteral {
+        char text[N];
+
+        constexpr SourceLiteral(const char (&s)[N]) {
+            std::copy_n(s, N, text);
+        }
+
+        constexpr std::string_view view() const {
+            return std::string_view(text, N - 1);
+        }
+    };
+
+    // Bytes assembled at compile time, with room for CAPACITY of them
+    template<size_t CAPACITY> struct ConstantCode {
+        size_t  length;
+        uint8_t bytes[CAPACITY];
+    };
+
+    // The bytes of `source`, lines are trimmed and upper-cased like the lines of a file
+    template<size_t CAPACITY> consteval ConstantCode<CAPACITY> assemble_constant(std::string_view source, BitsMode b_mode) {
+        Context ctx = {
+            .b_mode         = b_mode,
+            .line_no        = 0,
+            .output_file    = nullptr,
+            .diagnostics    = nullptr,
+            .on_error       = false,
+            .optimize       = false
+        };
+
+        std::string normalized;
+        for (size_t pos = 0; pos <= source.size(); ++ctx.line_no) {
+            const size_t eol = std::min(source.find('\n', pos), source.size());
+            const std::string_view line = source.substr(pos, eol - pos);
+            pos = eol + 1;
+
+            const size_t endpos   = line.find_last_not_of(" \t\r\n");
+            const size_t startpos = line.find_first_not_of(" \t");
+            if (endpos == std::string_view::npos) {
+                continue;
+            }
+
+            normalized.clear();
+            for (char c : line.substr(startpos, endpos - startpos + 1)) {
+                normalized.push_back(c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c);
+            }
+            assemble_line(ctx, normalized);
+        }
+
+        if (ctx.contextual_prefixes != PREFIX_NONE) {
+            diagnose(ctx, "Error: Prefix at the end of the input is not followed by an instruction");
+        }
+        if (ctx.output_buffer.size() > CAPACITY) {
+            diagnose(ctx,
+                "Error: {} bytes of code exceed the capacity of {}, raise it with the CAPACITY argument of assemble<>()",
+                ctx.output_buffer.size(),
+                CAPACITY
+            );
+        }
+
+        ConstantCode<CAPACITY> code = { .length = ctx.output_buffer.size(), .bytes = {} };
+        std::copy(ctx.output_buffer.begin(), ctx.output_buffer.end(), code.bytes);
+        return code;
+    }
+
+    // Assembles `SOURCE` at compile time, with no trace of the assembler left in the program:
+    //
+    //     constexpr auto stub = audasm::assemble<"BITS 32\nADD EAX, [EBX+4*ECX+8]">();    // std::array<uint8_t, 4>: 03 44 8B 08
+    //
+    // Instructions, prefixes, BITS and comments are supported. The preprocessor, %INCLUDE and the data and
+    // alignment directives only exist at run time and fail to compile, like every error and warning does: constant
+    // evaluation stops in diagnose(), and the compiler error on assembly_error() follows a note with the message.
+    // The source is assembled once into a buffer of CAPACITY bytes, the array only keeps the bytes emitted.
+    template<SourceLiteral SOURCE, BitsMode B_MODE = M16, size_t CAPACITY = 4096> consteval auto assemble() {
+        constexpr ConstantCode<CAPACITY> code = assemble_constant<CAPACITY>(SOURCE.view(), B_MODE);
+
+        std::array<uint8_t, code.length> result = {};
+        std::copy_n(code.bytes, code.length, result.begin());
+        return result;
+    }
+}
@@ -2,10 +2,17 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <cstdlib>
+#include <format>
+#include <ostream>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include "peephole.hpp"
+
+struct RunStats;
+
 enum BitsMode {
     INVALID,
     M16,
@@ -16,9 +23,55 @@ enum BitsMode {
 struct Context {
     BitsMode                b_mode;
     size_t                  line_no;
-    std::ofstream           output_file;
+    std::ostream*           output_file;    // nullptr keeps every emitted byte in output_buffer
+    std::ostream*           diagnostics;    // errors and warnings of this run only
     bool                    on_error;
-    std::vector<uint8_t>    contextual_prefixes;
+    uint16_t                contextual_prefixes;    // PrefixMask bits waiting for the next instruction
+
+    bool                    optimize;
+    PeepholeStats           peephole_stats;
+    RunStats*               stats;          // nullptr unless statistics were requested
+
+    uint64_t                offset;         // number of bytes emitted so far
+    std::vector<uint8_t>    output_buffer;  // emitted bytes not yet written to output_file
 };
 
-void change_bits_mode(Context& ctx, const std::string_view& s);
+// Never called at run time. Constant evaluation has no stream to write a diagnostic to and stops on the call to this
+// function instead, the compiler error names it and the notes above show the message.
+[[noreturn]] inline void assembly_error(const char*) {
+    std::abort();
+}
+
+constexpr void stop_constant_evaluation(std::string_view message) {
+    if consteval {
+        assembly_error(message.data());
+    }
+}
+
+// Writes one error or warning line
+template<typename... Args>
+constexpr void diagnose(const Context& ctx, std::format_string<Args...> fmt, Args&&... args) {
+    if consteval {
+        stop_constant_evaluation(fmt.get());
+    }
+    else {
+        *ctx.diagnostics << std::format(fmt, std::forward<Args>(args)...) << std::endl;
+    }
+}
+
+// Threshold past which the caller should hand the buffered output over to the file
+constexpr size_t OUTPUT_FLUSH_THRESHOLD = 1 << 16;
+
+void write_output(Context& ctx, const uint8_t* data, size_t n);
+void flush_output(Context& ctx);
+
+constexpr void emit_byte(Context& ctx, uint8_t b) {
+    ctx.output_buffer.push_back(b);
+    ++ctx.offset;
+}
+
+inline void emit_bytes(Context& ctx, const void* data, size_t n) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    ctx.output_buffer.insert(ctx.output_buffer.end(), bytes, bytes + n);
+    ctx.offset += n;
+}
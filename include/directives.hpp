@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "context.hpp"
+
+void emit_nop_padding(Context& ctx, size_t n);
+void assemble_align(Context& ctx, const std::string_view& args);
+void assemble_data(Context& ctx, const std::string_view& directive, size_t width, const std::string_view& args);
+void replicate_output(Context& ctx, uint64_t start_offset, uint64_t count);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+
+#include "argument.hpp"
+#include "audasm.hpp"
+#include "context.hpp"
+#include "encoding.hpp"
+#include "instruction_spec.hpp"
+#include "instructions.hpp"
+#include "registers.hpp"
+
+namespace audasm {
+    using Reg = AsmRegister;
+
+    // [base + scale * index + disp], the typed form of a text memory operand. `size` is the %BYTE .. %QWORD override
+    // in bits, 0 when the register operand gives the size
+    struct Mem {
+        std::optional<Reg>  base;
+        std::optional<Reg>  index;
+        uint8_t             scale   = 1;
+        int32_t             disp    = 0;
+        uint8_t             size    = 0;
+        bool                rip     = false;    // [RIP + disp], base and index stay empty
+    };
+
+    // Where an immediate or displacement sits in the bytes finish() returns, to patch it once its value is known
+    struct Field {
+        uint64_t    offset;
+        uint8_t     size;       // in bytes, 0 when there is no such field
+    };
+
+    // A register, memory operand or immediate, converted at the call
+    struct Operand {
+        AsmArgType  type;
+        Reg         reg;
+        Mem         mem;
+        uint64_t    imm;
+
+        constexpr Operand(Reg reg) : type(AsmArgType::REGISTER), reg(reg), mem{}, imm(0) {}
+        constexpr Operand(const Mem& mem) : type(AsmArgType::MEMORY), reg{}, mem(mem), imm(0) {}
+        template<std::integral T> constexpr Operand(T imm) : type(AsmArgType::IMMEDIATE), reg{}, mem{}, imm((uint64_t)imm) {}
+    };
+
+    // Builds machine code from typed operands, without formatting or parsing any text:
+    //
+    //     audasm::Emitter a(M64);
+    //     a.ADD(Reg::EAX, Mem{ Reg::EBX, Reg::ECX, 4, 8 }).LFENCE();
+    //     a.ADD(Reg::ECX, 0x12345678);
+    //     const audasm::Field imm = a.imm_field();    // patch the 0x12345678 later
+    //     audasm::Result code = a.finish();
+    //
+    // The operands go to the encoders of the text path, so the bytes are those of the equivalent source, peephole
+    // included. Diagnostics read the same, with the instruction count since the last finish() as the line number.
+    // There is one method per mnemonic of instruction_spec.hpp, named like it
+    class Emitter {
+    public:
+        explicit Emitter(BitsMode b_mode = M64, bool optimize = false);
+        Emitter(const Emitter&) = delete;
+        Emitter& operator=(const Emitter&) = delete;
+
+        // Same as a BITS line
+        Emitter& bits(BitsMode b_mode);
+
+        // PrefixMask bits applied to the next instruction, like a LOCK or CS: line
+        Emitter& prefix(uint16_t prefixes);
+
+#define X(name, ...) Emitter& name() { return zo(ZO_##name); }
+        ZO_INSTRUCTIONS(X)
+#undef X
+
+#define X(name, ...) Emitter& name(const Operand& dest, const Operand& source) { return alu(ALU_##name, dest, source); }
+        ALU_INSTRUCTIONS(X)
+#undef X
+
+        // The VEX arithmetic forms take three operands, every other form two
+#define X(sse, avx, ...)                                                                                      \
+        Emitter& sse(const Operand& a, const Operand& b) { return simd(SIMD_##sse, a, b, nullptr); }          \
+        Emitter& avx(const Operand& a, const Operand& b) { return simd(SIMD_##avx, a, b, nullptr); }          \
+        Emitter& avx(const Operand& a, const Operand& b, const Operand& c) { return simd(SIMD_##avx, a, b, &c); }
+        SIMD_INSTRUCTIONS(X)
+#undef X
+
+        // Bytes emitted since the last finish()
+        uint64_t offset() const;
+
+        // Fields of the last instruction, empty when it has none or failed to encode. The peephole pass may have
+        // shortened the immediate or dropped it.
+        Field imm_field() const;
+        Field disp_field() const;
+
+        // Hands over the code and the diagnostics and starts over in the current bits mode
+        Result finish();
+
+    private:
+        Emitter& zo(ZOMnemonic id);
+        Emitter& alu(ALUMnemonic id, const Operand& dest, const Operand& source);
+        Emitter& simd(SIMDMnemonic id, const Operand& a, const Operand& b, const Operand* c);
+        Emitter& emit(bool encoded, const EncodedInstruction& ins);
+
+        AsmArg to_argument(const Operand& operand, bool& valid);
+        bool to_descriptor(const Mem& mem, MemoryOperandDescriptor& mdesc);
+        bool add_address_register(Reg reg, bool is_index, uint8_t scale, MemoryOperandDescriptor& mdesc);
+
+        std::ostringstream  diagnostics;
+        Context             ctx;
+        Field               imm         = {};
+        Field               disp        = {};
+    };
+}
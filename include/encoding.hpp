@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "context.hpp"
+
+// Architectural limit on the length of one instruction, prefixes included
+constexpr size_t MAX_INSTRUCTION_LENGTH = 15;
+constexpr uint8_t NO_FIELD = 0xFF;
+
+// Prefix lines can stack one of each legacy prefix in front of an instruction. The processor rejects the result past
+// MAX_INSTRUCTION_LENGTH, but it is still assembled as written.
+constexpr size_t MAX_CONTEXTUAL_PREFIXES = 11;
+
+// An instruction encoded on the stack, prefixes of a prefix line first. The encoders fill it and return whether it is
+// complete, the dispatcher then appends it to the output in a single copy, so an instruction that fails leaves no
+// byte behind. The field offsets locate the displacement and the immediate without decoding the bytes, the typed
+// emitter hands them out for patching. Everything here also runs in constant evaluation, where the bytes cannot be
+// copied with memcpy.
+struct EncodedInstruction {
+    uint8_t bytes[MAX_INSTRUCTION_LENGTH + MAX_CONTEXTUAL_PREFIXES];
+    uint8_t length      = 0;
+    uint8_t disp_offset = NO_FIELD;
+    uint8_t disp_size   = 0;        // in bytes
+    uint8_t imm_offset  = NO_FIELD;
+    uint8_t imm_size    = 0;        // in bytes
+};
+
+constexpr void encode_byte(EncodedInstruction& ins, uint8_t b) {
+    ins.bytes[ins.length++] = b;
+}
+
+constexpr void encode_bytes(EncodedInstruction& ins, const uint8_t* data, size_t n) {
+    if consteval {
+        std::copy_n(data, n, ins.bytes + ins.length);
+    }
+    else {
+        std::memcpy(ins.bytes + ins.length, data, n);
+    }
+    ins.length += (uint8_t)n;
+}
+
+// Little-endian, the low `size` bytes of `value`
+constexpr void encode_le(EncodedInstruction& ins, uint64_t value, uint8_t size) {
+    if consteval {
+        for (uint8_t i = 0; i < size; ++i) {
+            ins.bytes[ins.length + i] = (uint8_t)(value >> (8 * i));
+        }
+    }
+    else {
+        std::memcpy(ins.bytes + ins.length, &value, size);
+    }
+    ins.length += size;
+}
+
+constexpr void encode_disp(EncodedInstruction& ins, uint64_t disp, uint8_t size) {
+    ins.disp_offset = ins.length;
+    ins.disp_size = size;
+    encode_le(ins, disp, size);
+}
+
+constexpr void encode_imm(EncodedInstruction& ins, uint64_t imm, uint8_t size) {
+    ins.imm_offset = ins.length;
+    ins.imm_size = size;
+    encode_le(ins, imm, size);
+}
+
+constexpr void emit_instruction(Context& ctx, const EncodedInstruction& ins) {
+    ctx.output_buffer.insert(ctx.output_buffer.end(), ins.bytes, ins.bytes + ins.length);
+    ctx.offset += ins.length;
+}
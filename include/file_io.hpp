@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// How input files are read and the output file is written
+enum class IOBackend {
+    DEFAULT,    // inputs are mapped, the output goes through std::filebuf
+    POSIX,      // read() and write() on large blocks
+    URING       // io_uring: blocks read ahead while the completed ones are split into lines, asynchronous writes from registered buffers
+};
+
+struct IOBackendInfo {
+    IOBackend           backend;
+    std::string_view    name;
+};
+
+constexpr IOBackendInfo IO_BACKENDS[] = {
+    { IOBackend::DEFAULT,   "default" },
+    { IOBackend::POSIX,     "posix" },
+    { IOBackend::URING,     "uring" }
+};
+
+bool parse_io_backend(std::string_view name, IOBackend& backend);
+
+// False when the kernel has no io_uring or it is disabled, URING then falls back to POSIX
+bool io_uring_available();
+
+// Called with the buffer of the whole file and the length of its prefix read so far, each time it grows. The last call
+// covers the whole file, bytes already handed over do not change.
+using ReadProgress = std::function<void(std::string_view contents, size_t length)>;
+
+// Reads the whole file into `contents`, DEFAULT reads like POSIX. URING hands the blocks to `on_read` as they arrive,
+// the other backends once the file is read.
+bool read_file(const std::string& path, IOBackend backend, std::string& contents, const ReadProgress& on_read = {});
+
+#if !defined(_WIN32)
+// Reads `fd` until the end of the input, for pipes and devices whose size is not known in advance
+bool read_until_eof(int fd, std::string& contents);
+#endif
+
+// Creates or truncates `path`, returns nullptr if it cannot be opened.
+// Write errors show up as a failing pubsync(), which std::ostream::flush() turns into badbit.
+std::unique_ptr<std::streambuf> open_output_file(const std::string& path, IOBackend backend);
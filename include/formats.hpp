@@ -1,33 +1,627 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <string>
+#include <format>
+#include <ostream>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
+#include "argument.hpp"
 #include "context.hpp"
+#include "encoding.hpp"
+#include "genformats.hpp"
+#include "instructions.hpp"
+#include "parsing_utils.hpp"
+#include "peephole.hpp"
+#include "registers.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
-struct ZOInstruction {
-    uint8_t opcode;
-    std::vector<uint8_t> forbidden_prefixes;
-    
-    struct Mode {
-        BitsMode mode;
-        uint8_t prefix;
-    } mode_prefix;
-
-    std::vector<uint8_t> other_prefixes;
-    bool hasOptionalImm8 = false;
+struct PrefixInfo {
+    uint16_t            bit;
+    uint8_t             byte;
+    std::string_view    name;
 };
 
-struct ALUInstruction {
-    uint8_t reg_field;
+// Emission order: lock/repeat group first, then segment overrides, then size overrides
+inline constexpr PrefixInfo PREFIXES[] = {
+    { PREFIX_LOCK,      0xF0, "LOCK"  },
+    { PREFIX_REPNE,     0xF2, "REPNE" },
+    { PREFIX_REP,       0xF3, "REP"   },
+    { PREFIX_CS,        0x2E, "CS:"   },
+    { PREFIX_SS,        0x36, "SS:"   },
+    { PREFIX_DS,        0x3E, "DS:"   },
+    { PREFIX_ES,        0x26, "ES:"   },
+    { PREFIX_FS,        0x64, "FS:"   },
+    { PREFIX_GS,        0x65, "GS:"   },
+    { PREFIX_OPSIZE,    0x66, "O16"   },
+    { PREFIX_ADDRSIZE,  0x67, "A16"   }
 };
 
-extern std::unordered_map<std::string_view, ZOInstruction>   ZOTable;
-extern std::unordered_map<std::string_view, ALUInstruction>  ALUTable;
+struct PrefixKeyword {
+    std::string_view    keyword;
+    uint16_t            bit;
+};
+
+inline constexpr PrefixKeyword PREFIX_KEYWORDS[] = {
+    { "LOCK",   PREFIX_LOCK  },
+    { "REP",    PREFIX_REP   },
+    { "REPE",   PREFIX_REP   },
+    { "REPZ",   PREFIX_REP   },
+    { "REPNE",  PREFIX_REPNE },
+    { "REPNZ",  PREFIX_REPNE },
+    { "CS:",    PREFIX_CS    },
+    { "SS:",    PREFIX_SS    },
+    { "DS:",    PREFIX_DS    },
+    { "ES:",    PREFIX_ES    },
+    { "FS:",    PREFIX_FS    },
+    { "GS:",    PREFIX_GS    }
+};
+
+constexpr bool parse_prefix(const std::string_view& s, uint16_t& prefix) {
+    for (const auto& [keyword, bit] : PREFIX_KEYWORDS) {
+        if (s == keyword) {
+            prefix = bit;
+            return true;
+        }
+    }
+    return false;
+}
+
+constexpr bool check_forbidden_prefix(Context& ctx, const std::string_view& instruction, uint16_t forbidden) {
+    const uint16_t illegal = ctx.contextual_prefixes & forbidden;
+    if (illegal == 0) {
+        return true;
+    }
+
+    for (const auto& p : PREFIXES) {
+        if (illegal & p.bit) {
+            diagnose(ctx,
+                "Error on line {}: Illegal prefix `{}` for instruction `{}`",
+                ctx.line_no,
+                p.name,
+                instruction
+            );
+            break;
+        }
+    }
+
+    ctx.contextual_prefixes = PREFIX_NONE;
+    ctx.on_error = true;
+    return false;
+}
+
+static_assert(std::size(PREFIXES) == MAX_CONTEXTUAL_PREFIXES);
+
+// Moves the prefixes waiting in the context to the front of the instruction
+constexpr void encode_contextual_prefixes(Context& ctx, EncodedInstruction& ins) {
+    if (ctx.contextual_prefixes == PREFIX_NONE) {
+        return;
+    }
+
+    for (const auto& p : PREFIXES) {
+        if (ctx.contextual_prefixes & p.bit) {
+            encode_byte(ins, p.byte);
+        }
+    }
+    ctx.contextual_prefixes = PREFIX_NONE;
+}
+// The encoding steps below take the operands already parsed, the typed emitter calls them directly. Like the
+// encoders, they fill `ins` and return whether it is complete, the caller emits it
+constexpr bool encode_zo(Context& ctx, const std::string_view& instruction, ZOMnemonic id, EncodedInstruction& ins) {
+    FormatScope format_scope(ctx, ins, FORMAT_ZO);
+    const ZOInstruction& zoi = ZO_TABLE[id];
+
+    if (!(zoi.modes & (1 << ctx.b_mode))) {
+        diagnose(ctx,
+            "Error on line {}: Instruction `{}` is not available in {}-bit mode",
+            ctx.line_no,
+            instruction,
+            ctx.b_mode == BitsMode::M16 ? 16 : (ctx.b_mode == BitsMode::M32 ? 32 : 64)
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    if (!check_forbidden_prefix(ctx, instruction, zoi.forbidden_prefixes)) {
+        return false;
+    }
+
+    encode_contextual_prefixes(ctx, ins);
+
+    // No sized instruction has mandatory prefixes in `other_prefixes`, so REX can go right after 0x66
+    if (zoi.operand_size != 0) {
+        const OperandSizePrefix* prefix = operand_size_prefix(ctx.b_mode, zoi.operand_size);
+        if (prefix->opsize) {
+            encode_byte(ins, 0x66);
+        }
+        if (prefix->rex_w) {
+            encode_byte(ins, 0x40 | REX_W);
+        }
+    }
+
+    encode_bytes(ins, zoi.other_prefixes, zoi.n_other_prefixes);
+    encode_byte(ins, zoi.opcode);
+    return true;
+}
+
+constexpr bool assemble_zo(
+    Context& ctx,
+    const std::string_view& instruction,
+    ZOMnemonic id,
+    const std::string_view& args,
+    EncodedInstruction& ins
+) {
+    TRACE_SCOPE("assemble_zo");
+
+    std::string_view trimmed = trim_string(args);
+    if (!trimmed.empty() && trimmed.front() != ';') {
+        diagnose(ctx,
+            "Error on line {}: Instruction `{}` did not expect arguments ; found: `{}`",
+            ctx.line_no,
+            instruction,
+            args
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    return encode_zo(ctx, instruction, id, ins);
+}
+// Sign-extends `imm` from `size` bits, returns true if the result fits in a sign-extended imm8
+constexpr bool fits_sign_extended_imm8(uint64_t imm, int32_t size, uint64_t& sext) {
+    int64_t v;
+    switch (size) {
+        case 16: {
+            if (!test_number<int16_t>(imm)) {
+                return false;
+            }
+            v = (int16_t)(uint16_t)imm;
+            break;
+        }
+        case 32: {
+            if (!test_number<int32_t>(imm)) {
+                return false;
+            }
+            v = (int32_t)(uint32_t)imm;
+            break;
+        }
+        case 64: {
+            // 64-bit operands only take a sign-extended imm32
+            if (!test_number_strict<int32_t>(imm)) {
+                return false;
+            }
+            v = (int64_t)imm;
+            break;
+        }
+        default: return false;
+    }
+
+    sext = (uint64_t)v;
+    return test_number_strict<int8_t>(v);
+}
+
+// Returns true if the peephole took the instruction over, `encoded` then tells whether it could be encoded
+constexpr bool peephole_alu_ri(
+    Context& ctx,
+    const std::string_view& instruction,
+    ALUMnemonic id,
+    AsmRegister reg,
+    int32_t reg_size,
+    uint64_t imm,
+    EncodedInstruction& ins,
+    bool& encoded
+) {
+    if (reg_size != 8 && reg_size != 16 && reg_size != 32 && reg_size != 64) {
+        return false;
+    }
+
+    const bool is_accumulator = reg == AsmRegister::AX || reg == AsmRegister::EAX || reg == AsmRegister::RAX;
+    const size_t imm_width = reg_size == 64 ? 4 : reg_size / 8;
+
+    if (id == ALU_CMP && imm == 0) {
+        // CMP reg, 0 is 0x3C ib (AL), 0x3D iw/id (AX/EAX) or 0x80/0x83 /7 ib, TEST reg, reg is always 2 bytes
+        const size_t original_size =
+            reg == AsmRegister::AL  ? 2 :
+            is_accumulator          ? 1 + imm_width :
+            3;
+
+        encoded = x86_format_rr(ctx, instruction, FormatRR {
+            .reg_source         = reg,
+            .reg_source_size    = reg_size,
+            .reg_dest           = reg,
+            .reg_dest_size      = reg_size,
+            .r8_op              = 0x84,
+            .r_def_op           = 0x85
+        }, ins);
+        if (encoded) {
+            record_peephole_hit(ctx.peephole_stats, CMP_ZERO_TO_TEST, original_size - 2);
+        }
+        return true;
+    }
+
+    uint64_t sext;
+    if (!fits_sign_extended_imm8(imm, reg_size, sext)) {
+        return false;
+    }
+
+    PeepholeRule rule;
+    size_t bytes_saved;
+    if (is_accumulator) {
+        // 0x05+8*r iw/id against 0x83 /r ib
+        rule = test_number_strict<int8_t>(imm) ? ACC_IMM8 : SEXT_IMM8;
+        bytes_saved = 1 + imm_width - 3;
+    }
+    else if (!test_number_strict<int8_t>(imm)) {
+        rule = SEXT_IMM8;
+        bytes_saved = imm_width - 1;
+    }
+    else {
+        return false;
+    }
+
+    encoded = x86_format_ri(ctx, instruction, FormatRI {
+        .reg            = reg,
+        .reg_size       = reg_size,
+        .imm            = sext,
+        .default_reg_v  = ALU_TABLE[id].reg_field,
+        .r8_imm8_op     = ALU_TABLE[id].opcodes[ALU_FORM_RM8_IMM8],
+        .r_def_imm8_op  = ALU_TABLE[id].opcodes[ALU_FORM_RM_IMM8],
+        .r_imm_def_op   = ALU_TABLE[id].opcodes[ALU_FORM_RM_IMM]
+    }, ins);
+    if (encoded) {
+        record_peephole_hit(ctx.peephole_stats, rule, bytes_saved);
+    }
+    return true;
+}
+
+// Same contract as `peephole_alu_ri`
+constexpr bool peephole_alu_mi(Context& ctx, FormatMI fparams, EncodedInstruction& ins, bool& encoded) {
+    const int32_t operand_size = fparams.size_override != 0
+        ? fparams.size_override
+        : (ctx.b_mode == BitsMode::M16 ? 16 : 32);
+
+    uint64_t sext;
+    if (test_number_strict<int8_t>(fparams.imm) || !fits_sign_extended_imm8(fparams.imm, operand_size, sext)) {
+        return false;
+    }
+
+    fparams.imm = sext;
+    encoded = x86_format_mi(ctx, fparams, ins);
+    if (encoded) {
+        record_peephole_hit(ctx.peephole_stats, SEXT_IMM8, (operand_size == 64 ? 4 : operand_size / 8) - 1);
+    }
+    return true;
+}
+
+constexpr bool encode_alu(
+    Context& ctx,
+    const std::string_view& instruction,
+    ALUMnemonic id,
+    const AsmArg* parsed_args,
+    EncodedInstruction& ins
+) {
+    const ALUInstruction& alui = ALU_TABLE[id];
+    const uint8_t* opcodes = alui.opcodes;
+
+    // LOCK is only legal on a memory destination that is written back, which CMP never does
+    uint16_t forbidden = PREFIX_REP | PREFIX_REPNE | PREFIX_OPSIZE | PREFIX_ADDRSIZE;
+    if (parsed_args[0].type != AsmArgType::MEMORY || id == ALU_CMP) {
+        forbidden |= PREFIX_LOCK;
+    }
+
+    if (!check_forbidden_prefix(ctx, instruction, forbidden)) {
+        return false;
+    }
+    encode_contextual_prefixes(ctx, ins);
+
+    if (parsed_args[1].type == AsmArgType::IMMEDIATE) {
+        const auto& imm = parsed_args[1].imm;
+
+        if (parsed_args[0].type == AsmArgType::REGISTER) {
+            const auto& [r0, s0] = parsed_args[0].reg;
+
+            bool encoded;
+            if (ctx.optimize && peephole_alu_ri(ctx, instruction, id, r0, s0, imm, ins, encoded)) {
+                return encoded;
+            }
+
+            if (!x86_format_i(ctx, FormatI {
+                .reg        = r0,
+                .imm        = imm,
+                .op_imm_8   = opcodes[ALU_FORM_ACC_IMM8],
+                .op_imm_def = opcodes[ALU_FORM_ACC_IMM]
+            }, ins)) {
+                return x86_format_ri(ctx, instruction, FormatRI {
+                    .reg            = r0,
+                    .reg_size       = s0,
+                    .imm            = imm,
+                    .default_reg_v  = alui.reg_field,
+                    .r8_imm8_op     = opcodes[ALU_FORM_RM8_IMM8],
+                    .r_def_imm8_op  = opcodes[ALU_FORM_RM_IMM8],
+                    .r_imm_def_op   = opcodes[ALU_FORM_RM_IMM]
+                }, ins);
+            }
+            return true;
+        }
+        else if (parsed_args[0].type == AsmArgType::MEMORY) {
+            const auto& [mdesc, size_override] = parsed_args[0].mem;
+            const FormatMI fparams = {
+                .mdesc          = mdesc,
+                .size_override  = size_override,
+                .imm            = imm,
+                .default_reg_v  = alui.reg_field,
+                .r8_imm8_op     = opcodes[ALU_FORM_RM8_IMM8],
+                .r_imm_def_op   = opcodes[ALU_FORM_RM_IMM],
+                .r_def_imm8_op  = opcodes[ALU_FORM_RM_IMM8]
+            };
+
+            bool encoded;
+            if (ctx.optimize && peephole_alu_mi(ctx, fparams, ins, encoded)) {
+                return encoded;
+            }
+            return x86_format_mi(ctx, fparams, ins);
+        }
+        else {
+            diagnose(ctx,
+                "Error on line {}: Wrong destination operand type for `{}`, expected a register of memory operand",
+                ctx.line_no,
+                instruction
+            );
+            ctx.on_error = true;
+            return false;
+        }
+    }
+    else  if (parsed_args[1].type == AsmArgType::REGISTER) {
+        const auto& [rs, ss] = parsed_args[1].reg;
+
+        if (parsed_args[0].type == AsmArgType::REGISTER) {
+            const auto& [rd, sd] = parsed_args[0].reg;
+            return x86_format_rr(ctx, instruction, FormatRR {
+                .reg_source         = rs,
+                .reg_source_size    = ss,
+                .reg_dest           = rd,
+                .reg_dest_size      = sd,
+                .r8_op              = opcodes[ALU_FORM_RM8_R8],
+                .r_def_op           = opcodes[ALU_FORM_RM_R]
+            }, ins);
+        }
+        else if (parsed_args[0].type == AsmArgType::MEMORY) {
+            const auto& [mdesc, size_override] = parsed_args[0].mem;
+            return x86_format_mr(ctx, FormatMR {
+                .mdesc          = mdesc,
+                .size_override  = size_override,
+                .reg_size       = ss,
+                .default_reg_v  = register_encoding(rs),
+                .r8_rm8_op      = opcodes[ALU_FORM_RM8_R8],
+                .r_rm_def_op    = opcodes[ALU_FORM_RM_R],
+                .prefixes       = {},
+                .ex_prefixes    = {}
+            }, ins);
+        }
+        else {
+            diagnose(ctx,
+                "Error on line {}: Wrong destination operand type for `{}`, expected a register or memory operand",
+                ctx.line_no,
+                instruction
+            );
+            ctx.on_error = true;
+            return false;
+        }
+    }
+    else if (parsed_args[1].type == AsmArgType::MEMORY) {
+        const auto& [mdesc, size_override] = parsed_args[1].mem;
+
+        if (parsed_args[0].type == AsmArgType::REGISTER) {
+            const auto& [rd, sd] = parsed_args[0].reg;
+            return x86_format_mr(ctx, FormatMR {
+                .mdesc          = mdesc,
+                .size_override  = size_override,
+                .reg_size       = sd,
+                .default_reg_v  = register_encoding(rd),
+                .r8_rm8_op      = opcodes[ALU_FORM_R8_RM8],
+                .r_rm_def_op    = opcodes[ALU_FORM_R_RM],
+                .prefixes       = {},
+                .ex_prefixes    = {}
+            }, ins);
+        }
+        else {
+            diagnose(ctx,
+                "Error on line {}: Wrong destination operand type for `{}`, expected a register or memory operand",
+                ctx.line_no,
+                instruction
+            );
+            ctx.on_error = true;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+constexpr bool assemble_alu(
+    Context& ctx,
+    const std::string_view& instruction,
+    ALUMnemonic id,
+    const std::string_view& args,
+    EncodedInstruction& ins
+) {
+    TRACE_SCOPE("assemble_alu");
+
+    const std::vector<AsmArg> parsed_args = expect_arguments(ctx, args, 2);
+    if (parsed_args.empty() || ctx.on_error) {
+        diagnose(ctx,
+            "Error on line {}: Invalid number of arguments for `{}`: `{}`",
+            ctx.line_no,
+            instruction,
+            args
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    return encode_alu(ctx, instruction, id, parsed_args.data(), ins);
+}
+// Checks that `arg` is a vector register of the width the instruction allows, `size` is set by the first register seen
+constexpr bool expect_vector_register(
+    Context& ctx,
+    const std::string_view& instruction,
+    const SIMDInstruction& simdi,
+    const AsmArg& arg,
+    int32_t& size
+) {
+    // The register is only read once the argument is known to be one
+    const auto& [reg, rsize] = arg.reg;
+    const bool allowed = arg.type == AsmArgType::REGISTER && (rsize == 128 || (rsize == 256 && simdi.vex && !simdi.scalar));
+
+    if (!allowed) {
+        diagnose(ctx,
+            "Error on line {}: `{}` expects {} registers",
+            ctx.line_no,
+            instruction,
+            (simdi.vex && !simdi.scalar) ? "XMM or YMM" : "XMM"
+        );
+        ctx.on_error = true;
+        return false;
+    }
+    else if (size != 0 && size != rsize) {
+        diagnose(ctx,
+            "Error on line {}: Mismatched operand sizes for `{}`",
+            ctx.line_no,
+            instruction
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    size = rsize;
+    return true;
+}
+
+constexpr bool set_rm_operand(
+    Context& ctx,
+    const std::string_view& instruction,
+    const SIMDInstruction& simdi,
+    const AsmArg& arg,
+    int32_t& size,
+    FormatSIMD& fparams
+) {
+    if (arg.type == AsmArgType::MEMORY) {
+        fparams.rm_is_reg = false;
+        fparams.mdesc = arg.mem.first;
+        return true;
+    }
+    else if (!expect_vector_register(ctx, instruction, simdi, arg, size)) {
+        return false;
+    }
+
+    fparams.rm_is_reg = true;
+    fparams.rm = register_encoding(arg.reg.first);
+    return true;
+}
+
+// The VEX arithmetic forms take the extra source operand
+constexpr size_t simd_operand_count(const SIMDInstruction& simdi) {
+    return (simdi.vex && simdi.kind == SIMDKind::ARITH) ? 3 : 2;
+}
+
+// `parsed_args` holds simd_operand_count() operands
+constexpr bool encode_simd(
+    Context& ctx,
+    const std::string_view& instruction,
+    SIMDMnemonic id,
+    const AsmArg* parsed_args,
+    EncodedInstruction& ins
+) {
+    const SIMDInstruction& simdi = SIMD_TABLE[id];
+    const size_t n_args = simd_operand_count(simdi);
+
+    if (!check_forbidden_prefix(ctx, instruction, PREFIX_LOCK | PREFIX_REP | PREFIX_REPNE | PREFIX_OPSIZE | PREFIX_ADDRSIZE)) {
+        return false;
+    }
+
+    FormatSIMD fparams = {
+        .reg        = 0,
+        .vvvv       = 0,
+        .rm_is_reg  = false,
+        .rm         = 0,
+        .mdesc      = {},
+        .vex_l      = false,
+        .pp         = simdi.pp,
+        .map        = simdi.map,
+        .opcode     = simdi.opcode
+    };
+    int32_t size = 0;
+
+    // Store forms put the register in ModRM.reg and the memory destination in ModRM.rm
+    const bool is_store =
+        simdi.kind == SIMDKind::STORE
+        || (simdi.kind == SIMDKind::MOVE && parsed_args[0].type == AsmArgType::MEMORY);
+
+    const AsmArg& reg_arg = is_store ? parsed_args[1] : parsed_args[0];
+    const AsmArg& rm_arg = is_store ? parsed_args[0] : parsed_args[n_args - 1];
+
+    if (!expect_vector_register(ctx, instruction, simdi, reg_arg, size)) {
+        return false;
+    }
+    fparams.reg = register_encoding(reg_arg.reg.first);
+
+    if (n_args == 3) {
+        if (!expect_vector_register(ctx, instruction, simdi, parsed_args[1], size)) {
+            return false;
+        }
+        fparams.vvvv = register_encoding(parsed_args[1].reg.first);
+    }
+
+    if (!set_rm_operand(ctx, instruction, simdi, rm_arg, size, fparams)) {
+        return false;
+    }
+    else if ((simdi.kind == SIMDKind::LOAD || simdi.kind == SIMDKind::STORE) && fparams.rm_is_reg) {
+        diagnose(ctx,
+            "Error on line {}: `{}` expects a memory operand",
+            ctx.line_no,
+            instruction
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    if (is_store) {
+        fparams.opcode = simdi.store_opcode;
+    }
+    fparams.vex_l = size == 256;
+
+    encode_contextual_prefixes(ctx, ins);
+
+    if (simdi.vex) {
+        return x86_format_vex(ctx, fparams, ins);
+    }
+    else {
+        return x86_format_sse(ctx, fparams, ins);
+    }
+}
+
+constexpr bool assemble_simd(
+    Context& ctx,
+    const std::string_view& instruction,
+    SIMDMnemonic id,
+    const std::string_view& args,
+    EncodedInstruction& ins
+) {
+    TRACE_SCOPE("assemble_simd");
+
+    const std::vector<AsmArg> parsed_args = expect_arguments(ctx, args, simd_operand_count(SIMD_TABLE[id]));
+    if (parsed_args.empty() || ctx.on_error) {
+        diagnose(ctx,
+            "Error on line {}: Invalid number of arguments for `{}`: `{}`",
+            ctx.line_no,
+            instruction,
+            args
+        );
+        ctx.on_error = true;
+        return false;
+    }
 
-bool check_forbidden_prefix(const Context& ctx, uint8_t p);
-void assemble_zo(Context& ctx, const std::string_view& instruction, const std::string_view& args);
-void assemble_alu(Context& ctx, const std::string_view& instruction, const std::string_view& args);
\ No newline at end of file
+    return encode_simd(ctx, instruction, id, parsed_args.data(), ins);
+}
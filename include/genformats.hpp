@@ -1,12 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <format>
+#include <ostream>
 #include <string_view>
-#include <vector>
 
 #include "argument.hpp"
 #include "context.hpp"
+#include "encoding.hpp"
 #include "memory.hpp"
+#include "parsing_utils.hpp"
+#include "registers.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 struct FormatI {
     AsmRegister     reg;
@@ -47,6 +57,12 @@ struct FormatRR {
     uint8_t         r_def_op;
 };
 
+// A few bytes held in place, so that the format parameters never allocate
+struct InlineBytes {
+    uint8_t bytes[4];
+    uint8_t length;
+};
+
 struct FormatMR {
     MemoryOperandDescriptor mdesc;
     uint8_t                 size_override;
@@ -56,12 +72,834 @@ struct FormatMR {
     uint8_t                 r8_rm8_op;
     uint8_t                 r_rm_def_op;
 
-    std::vector<uint8_t>    prefixes;
-    std::vector<uint8_t>    ex_prefixes;
+    InlineBytes             prefixes;       // emitted instead of the opcode when not empty
+    InlineBytes             ex_prefixes;    // when not empty, only these of the computed prefixes are kept
+};
+
+// Implied prefix and opcode map, numbered as in the VEX pp and mmmmm fields
+enum SIMDPrefix : uint8_t {
+    PP_NONE = 0,
+    PP_66   = 1,
+    PP_F3   = 2,
+    PP_F2   = 3
+};
+
+enum SIMDMap : uint8_t {
+    MAP_0F      = 1,
+    MAP_0F38    = 2,
+    MAP_0F3A    = 3
+};
+
+struct FormatSIMD {
+    uint8_t                 reg;        // ModRM.reg register encoding
+    uint8_t                 vvvv;       // VEX second source register encoding, 0 when unused
+    bool                    rm_is_reg;
+    uint8_t                 rm;         // ModRM.rm register encoding if `rm_is_reg`
+    MemoryOperandDescriptor mdesc;      // memory operand otherwise
+
+    bool                    vex_l;      // 256-bit operation
+    uint8_t                 pp;
+    uint8_t                 map;
+    uint8_t                 opcode;
+};
+
+// Operand-size prefixes required by one operand size in one bits mode
+struct OperandSizePrefix {
+    bool    valid;
+    bool    opsize;     // 0x66
+    bool    rex_w;
+};
+
+// Indexed by [BitsMode][operand size: 8, 16, 32, 64]
+inline constexpr OperandSizePrefix OPERAND_SIZE_PREFIXES[4][4] = {
+    //  8-bit                   16-bit                  32-bit                  64-bit
+    { { false, false, false },  { false, false, false },  { false, false, false },  { false, false, false } },  // INVALID
+    { { true,  false, false },  { true,  false, false },  { true,  true,  false },  { false, false, false } },  // M16
+    { { true,  false, false },  { true,  true,  false },  { true,  false, false },  { false, false, false } },  // M32
+    { { true,  false, false },  { true,  true,  false },  { true,  false, false },  { true,  false, true  } }   // M64
+};
+
+struct AddressSizePrefix {
+    bool    valid;
+    bool    addrsize;   // 0x67
+};
+
+// Indexed by [BitsMode][address size: 16, 32, 64]
+inline constexpr AddressSizePrefix ADDRESS_SIZE_PREFIXES[4][3] = {
+    //  16-bit          32-bit          64-bit
+    { { false, false }, { false, false }, { false, false } },   // INVALID
+    { { true,  false }, { true,  true  }, { false, false } },   // M16
+    { { true,  true  }, { true,  false }, { false, false } },   // M32
+    { { false, false }, { true,  true  }, { true,  false } }    // M64
+};
+
+// Column 4 of the operand sizes and column 3 of the address sizes take every invalid size
+constexpr size_t OPERAND_SIZE_COLUMNS = 5;
+constexpr size_t ADDRESS_SIZE_COLUMNS = 4;
+
+// 8, 16, 32 and 64 map to their column with a bit scan instead of a branch on the size
+constexpr size_t operand_size_column(int32_t size) {
+    const uint32_t s = (uint32_t)size;
+    return std::has_single_bit(s) && (s & 0x78) ? std::bit_width(s) - 4 : OPERAND_SIZE_COLUMNS - 1;
+}
+
+constexpr size_t address_size_column(int32_t size) {
+    const uint32_t s = (uint32_t)size;
+    return std::has_single_bit(s) && (s & 0x70) ? std::bit_width(s) - 5 : ADDRESS_SIZE_COLUMNS - 1;
+}
+
+constexpr const OperandSizePrefix* operand_size_prefix(BitsMode mode, int32_t size) {
+    const size_t column = operand_size_column(size);
+    if (column == OPERAND_SIZE_COLUMNS - 1) {
+        return nullptr;
+    }
+
+    const OperandSizePrefix& prefix = OPERAND_SIZE_PREFIXES[mode][column];
+    return prefix.valid ? &prefix : nullptr;
+}
+
+// Legacy prefixes of a memory form, written as two bytes of which the first `length` are kept
+struct MemoryPrefixes {
+    bool    valid;
+    bool    rex_w;
+    uint8_t length;
+    uint8_t bytes[2];   // 0x66, then 0x67
 };
 
-bool x86_format_i(Context& ctx, const FormatI& fparams);
-void x86_format_ri(Context& ctx, const std::string_view& instruction, const FormatRI& fparams);
-void x86_format_mi(Context& ctx, const FormatMI& fparams);
-void x86_format_rr(Context& ctx, const std::string_view& instruction, const FormatRR& fparams);
-void x86_format_mr(Context& ctx, const FormatMR& fparams);
+// Indexed by [BitsMode][address size][operand size], the two tables above folded into one load
+inline constexpr auto MEMORY_PREFIXES = [] {
+    std::array<std::array<std::array<MemoryPrefixes, OPERAND_SIZE_COLUMNS>, ADDRESS_SIZE_COLUMNS>, 4> table = {};
+
+    for (size_t mode = 0; mode < 4; ++mode) {
+        for (size_t address = 0; address < ADDRESS_SIZE_COLUMNS - 1; ++address) {
+            for (size_t operand = 0; operand < OPERAND_SIZE_COLUMNS - 1; ++operand) {
+                const OperandSizePrefix& opsize = OPERAND_SIZE_PREFIXES[mode][operand];
+                const AddressSizePrefix& addrsize = ADDRESS_SIZE_PREFIXES[mode][address];
+                MemoryPrefixes& prefixes = table[mode][address][operand];
+
+                prefixes.valid = opsize.valid && addrsize.valid;
+                prefixes.rex_w = opsize.rex_w;
+                if (opsize.opsize) {
+                    prefixes.bytes[prefixes.length++] = 0x66;
+                }
+                if (addrsize.addrsize) {
+                    prefixes.bytes[prefixes.length++] = 0x67;
+                }
+            }
+        }
+    }
+
+    return table;
+}();
+
+// Legacy encodings of the VEX pp and mmmmm fields
+inline constexpr uint8_t SIMD_PREFIX_BYTES[] = { 0x00, 0x66, 0xF3, 0xF2 };
+inline constexpr uint8_t SIMD_MAP_BYTES[] = { 0x00, 0x00, 0x38, 0x3A };
+
+inline bool invalid_operand_size(Context& ctx, const std::string_view& instruction, int32_t size) {
+    if (size == 64) {
+        diagnose(ctx,
+            "Error on line {}: 64-bit operands of `{}` are only available in 64-bit mode",
+            ctx.line_no,
+            instruction
+        );
+    }
+    else {
+        diagnose(ctx,
+            "Error on line {}: Invalid register used as argument for `{}`",
+            ctx.line_no,
+            instruction
+        );
+    }
+    ctx.on_error = true;
+    return false;
+}
+
+constexpr uint8_t rex_bit(uint8_t encoding, uint8_t bit) {
+    return (encoding & REG_REX_EXTENSION) ? bit : 0;
+}
+
+constexpr uint8_t rex_constraints(uint8_t encoding) {
+    return encoding & (REG_REX_REQUIRED | REG_REX_FORBIDDEN);
+}
+
+// `rex` holds the W/R/X/B bits, `constraints` the REG_REX_* flags of the register operands ;
+// `rex_byte` is left at 0 when the instruction does not need a REX prefix
+template<BitsMode MODE> constexpr bool make_rex(Context& ctx, uint8_t rex, uint8_t constraints, uint8_t& rex_byte) {
+    rex_byte = 0;
+    if (rex == 0 && !(constraints & REG_REX_REQUIRED)) {
+        return true;
+    }
+
+    if constexpr (MODE != BitsMode::M64) {
+        diagnose(ctx,
+            "Error on line {}: Registers R8-R15, XMM8-XMM15, YMM8-YMM15, SPL, BPL, SIL and DIL are only available in 64-bit mode",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    if (constraints & REG_REX_FORBIDDEN) {
+        diagnose(ctx,
+            "Error on line {}: AH, BH, CH and DH cannot be encoded in an instruction requiring a REX prefix",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    rex_byte = 0x40 | rex;
+    return true;
+}
+
+// Encodes the operand-size override and REX prefix of a register or accumulator form
+template<BitsMode MODE> constexpr bool encode_register_prefixes(
+    Context& ctx,
+    EncodedInstruction& ins,
+    const std::string_view& instruction,
+    int32_t size,
+    uint8_t rex,
+    uint8_t constraints
+) {
+    const OperandSizePrefix* prefix = operand_size_prefix(MODE, size);
+    if (prefix == nullptr) {
+        return invalid_operand_size(ctx, instruction, size);
+    }
+
+    uint8_t rex_byte;
+    if (!make_rex<MODE>(ctx, rex | (prefix->rex_w ? REX_W : 0), constraints, rex_byte)) {
+        return false;
+    }
+
+    if (prefix->opsize) {
+        encode_byte(ins, 0x66);
+    }
+    if (rex_byte != 0) {
+        encode_byte(ins, rex_byte);
+    }
+    return true;
+}
+
+// Always writes both prefix bytes and REX, the length alone decides which of them are kept
+constexpr void encode_memory_prefixes(EncodedInstruction& ins, const MemoryPrefixes& prefixes, uint8_t rex_byte) {
+    std::copy_n(prefixes.bytes, sizeof(prefixes.bytes), ins.bytes + ins.length);
+    ins.length += prefixes.length;
+    ins.bytes[ins.length] = rex_byte;
+    ins.length += rex_byte != 0;
+}
+
+// ModRM, SIB and displacement of a memory or register r/m operand
+constexpr void encode_memory_operand(EncodedInstruction& ins, const MemoryOperand& mmop) {
+    encode_byte(ins, mmop.modrm);
+
+    if (mmop.has_sib) {
+        encode_byte(ins, mmop.sib);
+    }
+
+    if (mmop.size == 16) {
+        encode_disp_16(ins, mmop.disp_size, mmop.disp);
+    }
+    else {
+        encode_disp_32(ins, mmop.disp_size, mmop.disp);
+    }
+}
+
+// Looks up the prefixes of a memory form and builds its REX prefix. Outside of long mode `operand_error` names
+// what makes an operand size unencodable.
+template<BitsMode MODE> constexpr bool memory_prefixes(
+    Context& ctx,
+    const MemoryOperand& mmop,
+    int32_t operand_size,
+    uint8_t reg_v,
+    const std::string_view& operand_error,
+    const MemoryPrefixes*& prefixes,
+    uint8_t& rex_byte
+) {
+    prefixes = &MEMORY_PREFIXES[MODE][address_size_column(mmop.size)][operand_size_column(operand_size)];
+    const uint8_t rex = (prefixes->rex_w ? REX_W : 0) | rex_bit(reg_v, REX_R) | mmop.rex;
+
+    // Outside of long mode, this only rejects registers that would need a REX prefix, before any size error
+    if (MODE != BitsMode::M64 && !make_rex<MODE>(ctx, rex, rex_constraints(reg_v), rex_byte)) {
+        return false;
+    }
+
+    if (!prefixes->valid) {
+        if (MODE == BitsMode::M64 && operand_size_prefix(BitsMode::M64, operand_size) == nullptr) {
+            diagnose(ctx,
+                "Error on line {}: Invalid operand size `{}`",
+                ctx.line_no,
+                operand_size
+            );
+        }
+        else if (MODE == BitsMode::M64) {
+            diagnose(ctx,
+                "Error on line {}: 16-bit addressing is not available in 64-bit mode",
+                ctx.line_no
+            );
+        }
+        else if (mmop.size == 64) {
+            diagnose(ctx,
+                "Error on line {}: 64-bit addressing is only available in 64-bit mode",
+                ctx.line_no
+            );
+        }
+        else {
+            diagnose(ctx,
+                "Error on line {}: {} is unsupported in {} bits mode",
+                ctx.line_no,
+                operand_error,
+                MODE == BitsMode::M16 ? 16 : 32
+            );
+        }
+        ctx.on_error = true;
+        return false;
+    }
+
+    return MODE != BitsMode::M64 || make_rex<MODE>(ctx, rex, rex_constraints(reg_v), rex_byte);
+}
+
+// The encoders append to `ins` and return whether the instruction is complete, they never emit it themselves
+template<BitsMode MODE> constexpr bool format_i(Context& ctx, const FormatI& fparams, EncodedInstruction& ins) {
+    FormatScope format_scope(ctx, ins, FORMAT_I);
+    TRACE_SCOPE("x86_format_i");
+
+    if (fparams.reg == AsmRegister::AL && test_number<int8_t>(fparams.imm)) {
+        encode_byte(ins, fparams.op_imm_8);
+        encode_imm(ins, fparams.imm, sizeof(int8_t));
+        return true;
+    }
+
+    int32_t size;
+    switch (fparams.reg) {
+        case AsmRegister::AX: {
+            if (!test_number<int16_t>(fparams.imm)) {
+                return false;
+            }
+            size = 16;
+            break;
+        }
+        case AsmRegister::EAX: {
+            if (!test_number<int32_t>(fparams.imm)) {
+                return false;
+            }
+            size = 32;
+            break;
+        }
+        case AsmRegister::RAX: {
+            // The immediate is sign-extended to 64 bits
+            if (!test_number_strict<int32_t>(fparams.imm)) {
+                return false;
+            }
+            size = 64;
+            break;
+        }
+        default: return false;
+    }
+
+    // Unencodable sizes are left to the general register form, which reports them
+    const OperandSizePrefix* prefix = operand_size_prefix(MODE, size);
+    if (prefix == nullptr) {
+        return false;
+    }
+
+    if (prefix->opsize) {
+        encode_byte(ins, 0x66);
+    }
+    if (prefix->rex_w) {
+        encode_byte(ins, 0x40 | REX_W);
+    }
+    encode_byte(ins, fparams.op_imm_def);
+    encode_imm(ins, fparams.imm, size == 16 ? sizeof(int16_t) : sizeof(int32_t));
+    return true;
+}
+
+template<BitsMode MODE> constexpr bool format_ri(
+    Context& ctx,
+    const std::string_view& instruction,
+    const FormatRI& fparams,
+    EncodedInstruction& ins
+) {
+    FormatScope format_scope(ctx, ins, FORMAT_RI);
+    TRACE_SCOPE("x86_format_ri");
+
+    const uint8_t encoding = register_encoding(fparams.reg);
+    const uint8_t modrm = build_modrm_core(encoding, fparams.default_reg_v, 0b11);
+    const auto& imm = fparams.imm;
+
+    if (!encode_register_prefixes<MODE>(ctx, ins, instruction, fparams.reg_size, rex_bit(encoding, REX_B), rex_constraints(encoding))) {
+        return false;
+    }
+
+    switch (fparams.reg_size) {
+        case 8: {
+            if (!test_number<int8_t>(imm)) {
+                diagnose(ctx,
+                    "Warning on line {}: Immediate value `{}` too large to fit within 8 bits, truncating to 8 bits",
+                    ctx.line_no,
+                    imm
+                );
+            }
+
+            encode_byte(ins, fparams.r8_imm8_op);
+            encode_byte(ins, modrm);
+            encode_imm(ins, imm, sizeof(int8_t));
+            break;
+        }
+        case 16: {
+            if (test_number_strict<int8_t>(imm)) {
+                encode_byte(ins, fparams.r_def_imm8_op);
+                encode_byte(ins, modrm);
+                encode_imm(ins, imm, sizeof(int8_t));
+            }
+            else {
+                if (!test_number<int16_t>(imm)) {
+                    diagnose(ctx,
+                        "Warning on line {}: Immediate value `{}` too large to fit within 16 bits, truncating to 16 bits",
+                        ctx.line_no,
+                        imm
+                    );
+                }
+
+                encode_byte(ins, fparams.r_imm_def_op);
+                encode_byte(ins, modrm);
+                encode_imm(ins, imm, sizeof(int16_t));
+            }
+            break;
+        }
+        case 32: case 64: {
+            if (test_number_strict<int8_t>(imm)) {
+                encode_byte(ins, fparams.r_def_imm8_op);
+                encode_byte(ins, modrm);
+                encode_imm(ins, imm, sizeof(int8_t));
+            }
+            else {
+                if (fparams.reg_size == 32 && !test_number<int32_t>(imm)) {
+                    diagnose(ctx,
+                        "Warning on line {}: Immediate value `{}` too large to fit within 32 bits, truncating to 32 bits",
+                        ctx.line_no,
+                        imm
+                    );
+                }
+                else if (fparams.reg_size == 64 && !test_number_strict<int32_t>(imm)) {
+                    diagnose(ctx,
+                        "Warning on line {}: Immediate value `{}` does not fit within a sign-extended 32-bit immediate, truncating to 32 bits",
+                        ctx.line_no,
+                        imm
+                    );
+                }
+
+                encode_byte(ins, fparams.r_imm_def_op);
+                encode_byte(ins, modrm);
+                encode_imm(ins, imm, sizeof(int32_t));
+            }
+            break;
+        }
+        default: return false;
+    }
+
+    return true;
+}
+
+template<size_t SIZE> constexpr void print_size_warning(const Context& ctx, uint64_t imm) {
+    switch (SIZE) {
+        case 8: {
+            if (!test_number<int8_t>(imm)) {
+                diagnose(ctx,
+                    "Warning on line {}: Immediate value too large to fit in 8 bits, truncating to 8 bits",
+                    ctx.line_no
+                );
+            }
+            break;
+        }
+        case 16: {
+            if (!test_number<int16_t>(imm)) {
+                diagnose(ctx,
+                    "Warning on line {}: Immediate value too large to fit in 16 bits, truncating to 16 bits",
+                    ctx.line_no
+                );
+            }
+            break;
+        }
+        case 32: {
+            if (!test_number<int32_t>(imm)) {
+                diagnose(ctx,
+                    "Warning on line {}: Immediate value too large to fit in 32 bits, truncating to 32 bits",
+                    ctx.line_no
+                );
+            }
+            break;
+        }
+        case 64: {
+            if (!test_number_strict<int32_t>(imm)) {
+                diagnose(ctx,
+                    "Warning on line {}: Immediate value does not fit in a sign-extended 32-bit immediate, truncating to 32 bits",
+                    ctx.line_no
+                );
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+// `ins` already holds the prefixes
+template<size_t IMM_SIZE> constexpr void generate_mi(
+    EncodedInstruction& ins,
+    uint8_t op,
+    const MemoryOperand& mmop,
+    uint64_t imm
+) {
+    encode_byte(ins, op);
+    encode_memory_operand(ins, mmop);
+
+    switch (IMM_SIZE) {
+        case  8: encode_imm(ins, imm, sizeof(uint8_t)); break;
+        case 16: encode_imm(ins, imm, sizeof(uint16_t)); break;
+        case 32: encode_imm(ins, imm, sizeof(uint32_t)); break;
+        case 64: encode_imm(ins, imm, sizeof(uint32_t)); break;     // sign-extended by the processor
+        default: break;
+    }
+}
+
+template<size_t IMM_SIZE> constexpr void generate_warning_mi(
+    Context& ctx,
+    EncodedInstruction& ins,
+    uint8_t op,
+    const MemoryOperand& mmop,
+    uint64_t imm
+) {
+    if (IMM_SIZE != 0) {
+        print_size_warning<IMM_SIZE>(ctx, imm);
+    }
+    generate_mi<IMM_SIZE>(ins, op, mmop, imm);
+}
+
+template<BitsMode MODE> constexpr bool format_mi(Context& ctx, const FormatMI& fparams, EncodedInstruction& ins) {
+    FormatScope format_scope(ctx, ins, FORMAT_MI);
+    TRACE_SCOPE("x86_format_mi");
+
+    const auto& imm = fparams.imm;
+
+    MemoryOperand mmop;
+    if (!make_modrm_sib(ctx, fparams.mdesc, fparams.default_reg_v, mmop)) {
+        diagnose(ctx,
+            "Error on line {}: Invalid memory descriptor",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    const int32_t operand_size = fparams.size_override != 0
+        ? fparams.size_override
+        : (MODE == BitsMode::M16 ? 16 : 32);
+
+    const MemoryPrefixes* prefixes;
+    uint8_t rex_byte;
+    if (!memory_prefixes<MODE>(ctx, mmop, operand_size, fparams.default_reg_v, "64 bits addressing", prefixes, rex_byte)) {
+        return false;
+    }
+
+    encode_memory_prefixes(ins, *prefixes, rex_byte);
+
+    if (operand_size == 8) {
+        generate_warning_mi<8>(ctx, ins, fparams.r8_imm8_op, mmop, imm);
+    }
+    else if (test_number_strict<int8_t>(imm)) {
+        generate_mi<8>(ins, fparams.r_def_imm8_op, mmop, imm);
+    }
+    else if (operand_size == 16) {
+        generate_warning_mi<16>(ctx, ins, fparams.r_imm_def_op, mmop, imm);
+    }
+    else if (operand_size == 32) {
+        generate_warning_mi<32>(ctx, ins, fparams.r_imm_def_op, mmop, imm);
+    }
+    else {
+        generate_warning_mi<64>(ctx, ins, fparams.r_imm_def_op, mmop, imm);
+    }
+    return true;
+}
+
+template<BitsMode MODE> constexpr bool format_rr(
+    Context& ctx,
+    const std::string_view& instruction,
+    const FormatRR& fparams,
+    EncodedInstruction& ins
+) {
+    FormatScope format_scope(ctx, ins, FORMAT_RR);
+    TRACE_SCOPE("x86_format_rr");
+
+    if (fparams.reg_source_size != fparams.reg_dest_size) {
+        diagnose(ctx,
+            "Error on line {}: Mismatched operand sizes for `{}`",
+            ctx.line_no,
+            instruction
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    const uint8_t dest_encoding = register_encoding(fparams.reg_dest);
+    const uint8_t source_encoding = register_encoding(fparams.reg_source);
+    const uint8_t modrm = build_modrm_core(dest_encoding, source_encoding, 0b11);
+
+    if (!encode_register_prefixes<MODE>(
+        ctx,
+        ins,
+        instruction,
+        fparams.reg_source_size,
+        rex_bit(source_encoding, REX_R) | rex_bit(dest_encoding, REX_B),
+        rex_constraints(source_encoding) | rex_constraints(dest_encoding)
+    )) {
+        return false;
+    }
+
+    encode_byte(ins, fparams.reg_source_size == 8 ? fparams.r8_op : fparams.r_def_op);
+    encode_byte(ins, modrm);
+    return true;
+}
+
+// Prefixes, ModRM, SIB and a 32-bit displacement leave this much room for the opcode bytes
+static_assert(3 + sizeof(InlineBytes::bytes) <= MAX_INSTRUCTION_LENGTH - 7);
+
+template<BitsMode MODE> constexpr bool format_mr(Context& ctx, const FormatMR& fparams, EncodedInstruction& ins) {
+    FormatScope format_scope(ctx, ins, FORMAT_MR);
+    TRACE_SCOPE("x86_format_mr");
+
+    MemoryOperand mmop;
+    if (!make_modrm_sib(ctx, fparams.mdesc, fparams.default_reg_v, mmop)) {
+        diagnose(ctx,
+            "Error on line {}: Invalid memory operand",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    if (fparams.size_override != 0 && (int32_t)(fparams.size_override) != fparams.reg_size) {
+        diagnose(ctx,
+            "Error on line {}: Mismatched operand sizes",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    const MemoryPrefixes* prefixes;
+    uint8_t rex_byte;
+    if (!memory_prefixes<MODE>(ctx, mmop, fparams.reg_size, fparams.default_reg_v, "64-bit registers use", prefixes, rex_byte)) {
+        return false;
+    }
+
+    const uint8_t start = ins.length;
+    encode_memory_prefixes(ins, *prefixes, rex_byte);
+
+    if (fparams.ex_prefixes.length != 0) {
+        // Only keep the prefixes listed in `ex_prefixes`, those of a prefix line already in `ins` stay
+        uint8_t kept = start;
+        for (uint8_t i = start; i < ins.length; ++i) {
+            const uint8_t* end = fparams.ex_prefixes.bytes + fparams.ex_prefixes.length;
+            if (std::find(fparams.ex_prefixes.bytes, end, ins.bytes[i]) != end) {
+                ins.bytes[kept++] = ins.bytes[i];
+            }
+        }
+        ins.length = kept;
+    }
+
+    if (fparams.prefixes.length != 0) {
+        encode_bytes(ins, fparams.prefixes.bytes, fparams.prefixes.length);
+    }
+    else {
+        encode_byte(ins, fparams.reg_size == 8 ? fparams.r8_rm8_op : fparams.r_rm_def_op);
+    }
+
+    encode_memory_operand(ins, mmop);
+    return true;
+}
+
+// ModRM/SIB of the r/m operand of a vector instruction, and whether it needs an address-size override
+template<BitsMode MODE> constexpr bool simd_operand(Context& ctx, const FormatSIMD& fparams, MemoryOperand& mmop, bool& addrsize) {
+    addrsize = false;
+
+    if (fparams.rm_is_reg) {
+        mmop = {
+            .size       = 0,
+            .modrm      = build_modrm_core(fparams.rm, fparams.reg, 0b11),
+            .has_sib    = false,
+            .sib        = 0,
+            .disp_size  = 0,
+            .disp       = 0,
+            .rex        = rex_bit(fparams.rm, REX_B)
+        };
+        return true;
+    }
+
+    if (!make_modrm_sib(ctx, fparams.mdesc, fparams.reg, mmop)) {
+        diagnose(ctx,
+            "Error on line {}: Invalid memory operand",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    const size_t column = mmop.size == 16 ? 0 : (mmop.size == 32 ? 1 : 2);
+    const AddressSizePrefix& prefix = ADDRESS_SIZE_PREFIXES[MODE][column];
+    if (!prefix.valid) {
+        diagnose(ctx,
+            "Error on line {}: {}-bit addressing is not available in this bits mode",
+            ctx.line_no,
+            mmop.size
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    addrsize = prefix.addrsize;
+    return true;
+}
+
+template<BitsMode MODE> constexpr bool format_sse(Context& ctx, const FormatSIMD& fparams, EncodedInstruction& ins) {
+    FormatScope format_scope(ctx, ins, FORMAT_SSE);
+    TRACE_SCOPE("x86_format_sse");
+
+    MemoryOperand mmop;
+    bool addrsize;
+    if (!simd_operand<MODE>(ctx, fparams, mmop, addrsize)) {
+        return false;
+    }
+
+    uint8_t rex_byte;
+    if (!make_rex<MODE>(ctx, rex_bit(fparams.reg, REX_R) | mmop.rex, 0, rex_byte)) {
+        return false;
+    }
+
+    // The implied prefix must be the last one before REX and the escape bytes
+    if (addrsize) {
+        encode_byte(ins, 0x67);
+    }
+    if (fparams.pp != PP_NONE) {
+        encode_byte(ins, SIMD_PREFIX_BYTES[fparams.pp]);
+    }
+    if (rex_byte != 0) {
+        encode_byte(ins, rex_byte);
+    }
+
+    encode_byte(ins, 0x0F);
+    if (fparams.map != MAP_0F) {
+        encode_byte(ins, SIMD_MAP_BYTES[fparams.map]);
+    }
+
+    encode_byte(ins, fparams.opcode);
+    encode_memory_operand(ins, mmop);
+    return true;
+}
+
+template<BitsMode MODE> constexpr bool format_vex(Context& ctx, const FormatSIMD& fparams, EncodedInstruction& ins) {
+    FormatScope format_scope(ctx, ins, FORMAT_VEX);
+    TRACE_SCOPE("x86_format_vex");
+
+    MemoryOperand mmop;
+    bool addrsize;
+    if (!simd_operand<MODE>(ctx, fparams, mmop, addrsize)) {
+        return false;
+    }
+
+    // VEX carries the register extension bits itself, make_rex() only rejects them outside of long mode
+    const uint8_t rex = rex_bit(fparams.reg, REX_R) | mmop.rex;
+    uint8_t unused;
+    if (!make_rex<MODE>(ctx, rex | rex_bit(fparams.vvvv, REX_R), 0, unused)) {
+        return false;
+    }
+
+    if (addrsize) {
+        encode_byte(ins, 0x67);
+    }
+
+    const uint8_t vvvv_l_pp = ((~fparams.vvvv & 0xF) << 3) | (fparams.vex_l ? 0x04 : 0x00) | fparams.pp;
+
+    // The 2-byte form only has room for R, so X, B, W=1 and the 0F38/0F3A maps need the 3-byte form
+    if (fparams.map == MAP_0F && !(rex & (REX_X | REX_B))) {
+        encode_byte(ins, 0xC5);
+        encode_byte(ins, ((rex & REX_R) ? 0x00 : 0x80) | vvvv_l_pp);
+    }
+    else {
+        encode_byte(ins, 0xC4);
+        encode_byte(ins,
+            ((rex & REX_R) ? 0x00 : 0x80)
+            | ((rex & REX_X) ? 0x00 : 0x40)
+            | ((rex & REX_B) ? 0x00 : 0x20)
+            | fparams.map
+        );
+        encode_byte(ins, vvvv_l_pp);
+    }
+
+    encode_byte(ins, fparams.opcode);
+    encode_memory_operand(ins, mmop);
+    return true;
+}
+
+constexpr void change_bits_mode(Context& ctx, const std::string_view& s) {
+    uint64_t bits;
+    if (parse_number_base(s, 10, bits)) {
+        if (bits == 16) {
+            ctx.b_mode = BitsMode::M16;
+            return;
+        }
+        else if (bits == 32) {
+            ctx.b_mode = BitsMode::M32;
+            return;
+        }
+        else if (bits == 64) {
+            ctx.b_mode = BitsMode::M64;
+            return;
+        }
+    }
+
+    diagnose(ctx,
+        "Error on line {}: Invalid mode '{}' for BITS directive (accepted widths are 16, 32 and 64)",
+        ctx.line_no,
+        s
+    );
+    ctx.on_error = true;
+}
+
+// Runs `encode` instantiated for the current bits mode. The switch compiles to direct calls, and b_mode stays the
+// only mode state of the context
+template<typename Encode> constexpr decltype(auto) with_bits_mode(const Context& ctx, Encode&& encode) {
+    switch (ctx.b_mode) {
+        case BitsMode::M16: return encode.template operator()<BitsMode::M16>();
+        case BitsMode::M32: return encode.template operator()<BitsMode::M32>();
+        case BitsMode::M64: return encode.template operator()<BitsMode::M64>();
+        default: return encode.template operator()<BitsMode::INVALID>();   // rejects every operand size
+    }
+}
+
+constexpr bool x86_format_i(Context& ctx, const FormatI& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_i<MODE>(ctx, fparams, ins); });
+}
+
+constexpr bool x86_format_ri(Context& ctx, const std::string_view& instruction, const FormatRI& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_ri<MODE>(ctx, instruction, fparams, ins); });
+}
+
+constexpr bool x86_format_mi(Context& ctx, const FormatMI& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_mi<MODE>(ctx, fparams, ins); });
+}
+
+constexpr bool x86_format_rr(Context& ctx, const std::string_view& instruction, const FormatRR& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_rr<MODE>(ctx, instruction, fparams, ins); });
+}
+
+constexpr bool x86_format_mr(Context& ctx, const FormatMR& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_mr<MODE>(ctx, fparams, ins); });
+}
+
+constexpr bool x86_format_sse(Context& ctx, const FormatSIMD& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_sse<MODE>(ctx, fparams, ins); });
+}
+
+constexpr bool x86_format_vex(Context& ctx, const FormatSIMD& fparams, EncodedInstruction& ins) {
+    return with_bits_mode(ctx, [&]<BitsMode MODE>() { return format_vex<MODE>(ctx, fparams, ins); });
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+// The instruction set, one row per mnemonic. instructions.hpp expands each list into the mnemonic IDs, the
+// encoder tables and the name index, so adding an instruction of an existing family only takes a row here.
+
+// Instructions without operands (LOCK is always forbidden, the column lists the other forbidden prefixes)
+// X(mnemonic, opcode, forbidden prefixes, operand size, modes, optional imm8, escape bytes...)
+#define ZO_INSTRUCTIONS(X) \
+    X(AAA,         0x37, PREFIX_NONE,      0,  MODES_LEGACY, false) \
+    X(AAD,         0xD5, PREFIX_NONE,      0,  MODES_LEGACY, true) \
+    X(AAM,         0xD4, PREFIX_NONE,      0,  MODES_LEGACY, true) \
+    X(AAS,         0x3F, PREFIX_NONE,      0,  MODES_LEGACY, false) \
+    X(CBW,         0x98, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(CWDE,        0x98, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(CDQE,        0x98, PREFIX_NONE,      64, MODE_64,      false) \
+    X(CWD,         0x99, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(CDQ,         0x99, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(CQO,         0x99, PREFIX_NONE,      64, MODE_64,      false) \
+    X(CLAC,        0xCA, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(CLC,         0xF8, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(CLD,         0xFC, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(CLI,         0xFA, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(CLTS,        0x06, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(CMC,         0xF5, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(CMPSB,       0xA6, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(CMPSW,       0xA7, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(CMPSD,       0xA7, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(CMPSQ,       0xA7, PREFIX_NONE,      64, MODE_64,      false) \
+    X(CPUID,       0xA2, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(DAA,         0x27, PREFIX_NONE,      0,  MODES_LEGACY, false) \
+    X(DAS,         0x2F, PREFIX_NONE,      0,  MODES_LEGACY, false) \
+    X(ENDBR32,     0xFB, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF3, 0x0F, 0x1E) \
+    X(ENDBR64,     0xFA, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF3, 0x0F, 0x1E) \
+    X(HLT,         0xF4, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(INSB,        0x6C, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(INSW,        0x6D, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(INSD,        0x6D, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(INT1,        0xF1, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(INT3,        0xCC, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(INTO,        0xCE, PREFIX_NONE,      0,  MODES_LEGACY, false) \
+    X(INVD,        0x08, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(IRET,        0xCF, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(IRETD,       0xCF, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(IRETQ,       0xCF, PREFIX_NONE,      64, MODE_64,      false) \
+    X(LAHF,        0x9F, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(LEAVE,       0xC9, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(LFENCE,      0xE8, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0xAE) \
+    X(LODSB,       0xAC, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(LODSW,       0xAD, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(LODSD,       0xAD, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(LODSQ,       0xAD, PREFIX_NONE,      64, MODE_64,      false) \
+    X(MFENCE,      0xF0, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0xAE) \
+    X(MONITOR,     0xC8, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(MOVSB,       0xA4, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(MOVSW,       0xA5, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(MOVSD,       0xA5, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(MOVSQ,       0xA5, PREFIX_NONE,      64, MODE_64,      false) \
+    X(MWAIT,       0xC9, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(OUTSB,       0x6E, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(OUTSW,       0x6F, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(OUTSD,       0x6F, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(PAUSE,       0x90, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF3) \
+    X(PCONFIG,     0xC5, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(POPA,        0x61, PREFIX_NONE,      16, MODES_LEGACY, false) \
+    X(POPAD,       0x61, PREFIX_NONE,      32, MODES_LEGACY, false) \
+    X(POPF,        0x9D, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(POPFD,       0x9D, PREFIX_NONE,      32, MODES_LEGACY, false) \
+    X(POPFQ,       0x9D, PREFIX_NONE,      0,  MODE_64,      false) \
+    X(PUSHA,       0x60, PREFIX_NONE,      16, MODES_LEGACY, false) \
+    X(PUSHAD,      0x60, PREFIX_NONE,      32, MODES_LEGACY, false) \
+    X(PUSHF,       0x9C, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(PUSHFD,      0x9C, PREFIX_NONE,      32, MODES_LEGACY, false) \
+    X(PUSHFQ,      0x9C, PREFIX_NONE,      0,  MODE_64,      false) \
+    X(RDMSR,       0x32, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(RDPKRU,      0xEE, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(RDPMC,       0x33, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(RDTSC,       0x31, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(RDTSCP,      0xF9, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(RET,         0xC3, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(RSM,         0xAA, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(SAHF,        0x9E, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(SAVEPREVSSP, 0xEA, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF3, 0x0F, 0x01) \
+    X(SCASB,       0xAE, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(SCASW,       0xAF, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(SCASD,       0xAF, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(SCASQ,       0xAF, PREFIX_NONE,      64, MODE_64,      false) \
+    X(SERIALIZE,   0xE8, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(SETSSBSY,    0xE8, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF3, 0x0F, 0x01) \
+    X(SFENCE,      0xF8, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0xAE) \
+    X(STAC,        0xCB, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(STC,         0xF9, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(STD,         0xFD, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(STI,         0xFB, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(STOSB,       0xAA, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(STOSW,       0xAB, PREFIX_NONE,      16, MODES_ALL,    false) \
+    X(STOSD,       0xAB, PREFIX_NONE,      32, MODES_ALL,    false) \
+    X(STOSQ,       0xAB, PREFIX_NONE,      64, MODE_64,      false) \
+    X(SWAPGS,      0xF8, PREFIX_NONE,      0,  MODE_64,      false, 0x0F, 0x01) \
+    X(SYSCALL,     0x05, PREFIX_NONE,      0,  MODE_64,      false, 0x0F) \
+    X(SYSENTER,    0x34, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(SYSEXIT,     0x35, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(SYSRET,      0x07, PREFIX_NONE,      0,  MODE_64,      false, 0x0F) \
+    X(UD2,         0x0B, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(WBINVD,      0x09, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(WBNOINVD,    0x09, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF3, 0x0F) \
+    X(WRMSR,       0x30, PREFIX_NONE,      0,  MODES_ALL,    false, 0x0F) \
+    X(WRPKRU,      0xEF, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(XGETBV,      0xD0, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(XLATB,       0xD7, PREFIX_NONE,      0,  MODES_ALL,    false) \
+    X(XRESLDTRK,   0xE9, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF2, 0x0F, 0x01) \
+    X(XSETBV,      0xD1, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01) \
+    X(XSUSLDTRK,   0xE8, PREFIX_NONE,      0,  MODES_ALL,    false, 0xF2, 0x0F, 0x01) \
+    X(XTEST,       0xD6, PREFIX_MANDATORY, 0,  MODES_ALL,    false, 0x0F, 0x01)
+
+// Binary arithmetic with the classic 00-3F opcode layout: `base` is the r/m8, r8 form and `digit` the ModRM.reg
+// field of the 80/81/83 immediate forms
+// X(mnemonic, base opcode, digit)
+#define ALU_INSTRUCTIONS(X) \
+    X(ADD, 0x00, 0) \
+    X(OR,  0x08, 1) \
+    X(ADC, 0x10, 2) \
+    X(SBB, 0x18, 3) \
+    X(AND, 0x20, 4) \
+    X(SUB, 0x28, 5) \
+    X(XOR, 0x30, 6) \
+    X(CMP, 0x38, 7)
+
+// SSE instructions and their VEX forms, which only differ by how pp and map are encoded
+// X(SSE mnemonic, VEX mnemonic, implied prefix, map, opcode, store opcode, kind, scalar)
+#define SIMD_INSTRUCTIONS(X) \
+    X(MOVAPD,     VMOVAPD,     PP_66,   MAP_0F,   0x28, 0x29, MOVE,  false) \
+    X(MOVAPS,     VMOVAPS,     PP_NONE, MAP_0F,   0x28, 0x29, MOVE,  false) \
+    X(MOVDQA,     VMOVDQA,     PP_66,   MAP_0F,   0x6F, 0x7F, MOVE,  false) \
+    X(MOVDQU,     VMOVDQU,     PP_F3,   MAP_0F,   0x6F, 0x7F, MOVE,  false) \
+    X(MOVUPD,     VMOVUPD,     PP_66,   MAP_0F,   0x10, 0x11, MOVE,  false) \
+    X(MOVUPS,     VMOVUPS,     PP_NONE, MAP_0F,   0x10, 0x11, MOVE,  false) \
+    X(MOVNTDQA,   VMOVNTDQA,   PP_66,   MAP_0F38, 0x2A, 0x00, LOAD,  false) \
+    X(MOVNTDQ,    VMOVNTDQ,    PP_66,   MAP_0F,   0x00, 0xE7, STORE, false) \
+    X(MOVNTPD,    VMOVNTPD,    PP_66,   MAP_0F,   0x00, 0x2B, STORE, false) \
+    X(MOVNTPS,    VMOVNTPS,    PP_NONE, MAP_0F,   0x00, 0x2B, STORE, false) \
+    X(PACKUSWB,   VPACKUSWB,   PP_66,   MAP_0F,   0x67, 0x00, ARITH, false) \
+    X(PADDB,      VPADDB,      PP_66,   MAP_0F,   0xFC, 0x00, ARITH, false) \
+    X(PADDD,      VPADDD,      PP_66,   MAP_0F,   0xFE, 0x00, ARITH, false) \
+    X(PADDQ,      VPADDQ,      PP_66,   MAP_0F,   0xD4, 0x00, ARITH, false) \
+    X(PADDW,      VPADDW,      PP_66,   MAP_0F,   0xFD, 0x00, ARITH, false) \
+    X(PAND,       VPAND,       PP_66,   MAP_0F,   0xDB, 0x00, ARITH, false) \
+    X(PANDN,      VPANDN,      PP_66,   MAP_0F,   0xDF, 0x00, ARITH, false) \
+    X(PAVGB,      VPAVGB,      PP_66,   MAP_0F,   0xE0, 0x00, ARITH, false) \
+    X(PCMPEQB,    VPCMPEQB,    PP_66,   MAP_0F,   0x74, 0x00, ARITH, false) \
+    X(PCMPEQD,    VPCMPEQD,    PP_66,   MAP_0F,   0x76, 0x00, ARITH, false) \
+    X(PCMPEQW,    VPCMPEQW,    PP_66,   MAP_0F,   0x75, 0x00, ARITH, false) \
+    X(PCMPGTB,    VPCMPGTB,    PP_66,   MAP_0F,   0x64, 0x00, ARITH, false) \
+    X(PCMPGTD,    VPCMPGTD,    PP_66,   MAP_0F,   0x66, 0x00, ARITH, false) \
+    X(PCMPGTW,    VPCMPGTW,    PP_66,   MAP_0F,   0x65, 0x00, ARITH, false) \
+    X(PMAXUB,     VPMAXUB,     PP_66,   MAP_0F,   0xDE, 0x00, ARITH, false) \
+    X(PMINUB,     VPMINUB,     PP_66,   MAP_0F,   0xDA, 0x00, ARITH, false) \
+    X(PMULLD,     VPMULLD,     PP_66,   MAP_0F38, 0x40, 0x00, ARITH, false) \
+    X(PMULLW,     VPMULLW,     PP_66,   MAP_0F,   0xD5, 0x00, ARITH, false) \
+    X(PMULUDQ,    VPMULUDQ,    PP_66,   MAP_0F,   0xF4, 0x00, ARITH, false) \
+    X(POR,        VPOR,        PP_66,   MAP_0F,   0xEB, 0x00, ARITH, false) \
+    X(PSADBW,     VPSADBW,     PP_66,   MAP_0F,   0xF6, 0x00, ARITH, false) \
+    X(PSHUFB,     VPSHUFB,     PP_66,   MAP_0F38, 0x00, 0x00, ARITH, false) \
+    X(PSUBB,      VPSUBB,      PP_66,   MAP_0F,   0xF8, 0x00, ARITH, false) \
+    X(PSUBD,      VPSUBD,      PP_66,   MAP_0F,   0xFA, 0x00, ARITH, false) \
+    X(PSUBQ,      VPSUBQ,      PP_66,   MAP_0F,   0xFB, 0x00, ARITH, false) \
+    X(PSUBW,      VPSUBW,      PP_66,   MAP_0F,   0xF9, 0x00, ARITH, false) \
+    X(PUNPCKHBW,  VPUNPCKHBW,  PP_66,   MAP_0F,   0x68, 0x00, ARITH, false) \
+    X(PUNPCKHDQ,  VPUNPCKHDQ,  PP_66,   MAP_0F,   0x6A, 0x00, ARITH, false) \
+    X(PUNPCKHQDQ, VPUNPCKHQDQ, PP_66,   MAP_0F,   0x6D, 0x00, ARITH, false) \
+    X(PUNPCKLBW,  VPUNPCKLBW,  PP_66,   MAP_0F,   0x60, 0x00, ARITH, false) \
+    X(PUNPCKLDQ,  VPUNPCKLDQ,  PP_66,   MAP_0F,   0x62, 0x00, ARITH, false) \
+    X(PUNPCKLQDQ, VPUNPCKLQDQ, PP_66,   MAP_0F,   0x6C, 0x00, ARITH, false) \
+    X(PXOR,       VPXOR,       PP_66,   MAP_0F,   0xEF, 0x00, ARITH, false) \
+    X(ADDPD,      VADDPD,      PP_66,   MAP_0F,   0x58, 0x00, ARITH, false) \
+    X(ADDPS,      VADDPS,      PP_NONE, MAP_0F,   0x58, 0x00, ARITH, false) \
+    X(ANDNPD,     VANDNPD,     PP_66,   MAP_0F,   0x55, 0x00, ARITH, false) \
+    X(ANDNPS,     VANDNPS,     PP_NONE, MAP_0F,   0x55, 0x00, ARITH, false) \
+    X(ANDPD,      VANDPD,      PP_66,   MAP_0F,   0x54, 0x00, ARITH, false) \
+    X(ANDPS,      VANDPS,      PP_NONE, MAP_0F,   0x54, 0x00, ARITH, false) \
+    X(DIVPD,      VDIVPD,      PP_66,   MAP_0F,   0x5E, 0x00, ARITH, false) \
+    X(DIVPS,      VDIVPS,      PP_NONE, MAP_0F,   0x5E, 0x00, ARITH, false) \
+    X(MAXPD,      VMAXPD,      PP_66,   MAP_0F,   0x5F, 0x00, ARITH, false) \
+    X(MAXPS,      VMAXPS,      PP_NONE, MAP_0F,   0x5F, 0x00, ARITH, false) \
+    X(MINPD,      VMINPD,      PP_66,   MAP_0F,   0x5D, 0x00, ARITH, false) \
+    X(MINPS,      VMINPS,      PP_NONE, MAP_0F,   0x5D, 0x00, ARITH, false) \
+    X(MULPD,      VMULPD,      PP_66,   MAP_0F,   0x59, 0x00, ARITH, false) \
+    X(MULPS,      VMULPS,      PP_NONE, MAP_0F,   0x59, 0x00, ARITH, false) \
+    X(ORPD,       VORPD,       PP_66,   MAP_0F,   0x56, 0x00, ARITH, false) \
+    X(ORPS,       VORPS,       PP_NONE, MAP_0F,   0x56, 0x00, ARITH, false) \
+    X(SUBPD,      VSUBPD,      PP_66,   MAP_0F,   0x5C, 0x00, ARITH, false) \
+    X(SUBPS,      VSUBPS,      PP_NONE, MAP_0F,   0x5C, 0x00, ARITH, false) \
+    X(XORPD,      VXORPD,      PP_66,   MAP_0F,   0x57, 0x00, ARITH, false) \
+    X(XORPS,      VXORPS,      PP_NONE, MAP_0F,   0x57, 0x00, ARITH, false) \
+    X(ADDSD,      VADDSD,      PP_F2,   MAP_0F,   0x58, 0x00, ARITH, true) \
+    X(ADDSS,      VADDSS,      PP_F3,   MAP_0F,   0x58, 0x00, ARITH, true) \
+    X(DIVSD,      VDIVSD,      PP_F2,   MAP_0F,   0x5E, 0x00, ARITH, true) \
+    X(DIVSS,      VDIVSS,      PP_F3,   MAP_0F,   0x5E, 0x00, ARITH, true) \
+    X(MAXSD,      VMAXSD,      PP_F2,   MAP_0F,   0x5F, 0x00, ARITH, true) \
+    X(MAXSS,      VMAXSS,      PP_F3,   MAP_0F,   0x5F, 0x00, ARITH, true) \
+    X(MINSD,      VMINSD,      PP_F2,   MAP_0F,   0x5D, 0x00, ARITH, true) \
+    X(MINSS,      VMINSS,      PP_F3,   MAP_0F,   0x5D, 0x00, ARITH, true) \
+    X(MULSD,      VMULSD,      PP_F2,   MAP_0F,   0x59, 0x00, ARITH, true) \
+    X(MULSS,      VMULSS,      PP_F3,   MAP_0F,   0x59, 0x00, ARITH, true) \
+    X(SUBSD,      VSUBSD,      PP_F2,   MAP_0F,   0x5C, 0x00, ARITH, true) \
+    X(SUBSS,      VSUBSS,      PP_F3,   MAP_0F,   0x5C, 0x00, ARITH, true)
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+#include "context.hpp"
+#include "genformats.hpp"
+#include "instruction_spec.hpp"
+
+// Legacy prefixes as bits, so that prefix state and per-instruction restrictions are checked with one AND
+enum PrefixMask : uint16_t {
+    PREFIX_NONE     = 0,
+    PREFIX_LOCK     = 1 << 0,   // F0
+    PREFIX_REPNE    = 1 << 1,   // F2
+    PREFIX_REP      = 1 << 2,   // F3
+    PREFIX_CS       = 1 << 3,   // 2E
+    PREFIX_SS       = 1 << 4,   // 36
+    PREFIX_DS       = 1 << 5,   // 3E
+    PREFIX_ES       = 1 << 6,   // 26
+    PREFIX_FS       = 1 << 7,   // 64
+    PREFIX_GS       = 1 << 8,   // 65
+    PREFIX_OPSIZE   = 1 << 9,   // 66
+    PREFIX_ADDRSIZE = 1 << 10,  // 67
+
+    PREFIX_SEGMENTS = PREFIX_CS | PREFIX_SS | PREFIX_DS | PREFIX_ES | PREFIX_FS | PREFIX_GS,
+    PREFIX_MANDATORY = PREFIX_OPSIZE | PREFIX_REPNE | PREFIX_REP   // the ones that also serve as mandatory prefixes
+};
+
+// Bits modes an instruction can be encoded in, tested with `1 << ctx.b_mode`
+enum ModeMask : uint8_t {
+    MODE_16         = 1 << BitsMode::M16,
+    MODE_32         = 1 << BitsMode::M32,
+    MODE_64         = 1 << BitsMode::M64,
+
+    MODES_LEGACY    = MODE_16 | MODE_32,
+    MODES_ALL       = MODE_16 | MODE_32 | MODE_64
+};
+
+constexpr size_t MAX_ZO_ESCAPE = 3;
+
+struct ZOInstruction {
+    uint8_t opcode;
+    uint16_t forbidden_prefixes;
+    uint8_t operand_size;   // 0 when the operation does not depend on the operand size
+    uint8_t modes;
+
+    uint8_t other_prefixes[MAX_ZO_ESCAPE];  // mandatory prefix and escape bytes, emitted before the opcode
+    uint8_t n_other_prefixes;
+    bool hasOptionalImm8;
+};
+
+// Operand forms of the ALU instructions, in the order of their opcodes
+enum ALUForm : uint8_t {
+    ALU_FORM_ACC_IMM8,      // AL, imm8
+    ALU_FORM_ACC_IMM,       // AX/EAX/RAX, imm16/32
+    ALU_FORM_RM8_IMM8,      // 80 /digit
+    ALU_FORM_RM_IMM,        // 81 /digit
+    ALU_FORM_RM_IMM8,       // 83 /digit, sign-extended
+    ALU_FORM_RM8_R8,
+    ALU_FORM_RM_R,
+    ALU_FORM_R8_RM8,
+    ALU_FORM_R_RM,
+
+    ALU_FORM_COUNT
+};
+
+struct ALUInstruction {
+    uint8_t reg_field;      // the /digit of the immediate forms
+    uint8_t opcodes[ALU_FORM_COUNT];
+};
+
+enum class SIMDKind : uint8_t {
+    ARITH,      // xmm, xmm/m (SSE) or xmm, xmm, xmm/m (VEX)
+    MOVE,       // xmm, xmm/m with `opcode` or xmm/m, xmm with `store_opcode`
+    LOAD,       // xmm, m
+    STORE       // m, xmm
+};
+
+struct SIMDInstruction {
+    uint8_t     pp;             // SIMDPrefix
+    uint8_t     map;            // SIMDMap
+    uint8_t     opcode;
+    uint8_t     store_opcode;
+    SIMDKind    kind;
+    bool        vex;
+    bool        scalar;         // no 256-bit form
+};
+
+// Mnemonic IDs, each family is numbered from 0 so its table is indexed directly
+enum ZOMnemonic : uint16_t {
+#define X(name, ...) ZO_##name,
+    ZO_INSTRUCTIONS(X)
+#undef X
+
+    ZO_COUNT
+};
+
+enum ALUMnemonic : uint16_t {
+#define X(name, ...) ALU_##name,
+    ALU_INSTRUCTIONS(X)
+#undef X
+
+    ALU_COUNT
+};
+
+// The VEX form of a row directly follows its SSE form
+enum SIMDMnemonic : uint16_t {
+#define X(sse, avx, ...) SIMD_##sse, SIMD_##avx,
+    SIMD_INSTRUCTIONS(X)
+#undef X
+
+    SIMD_COUNT
+};
+
+// Table rows built from the spec rows, LOCK is forbidden on every instruction without operands
+constexpr ZOInstruction make_zo(
+    uint8_t opcode,
+    uint16_t forbidden_prefixes,
+    uint8_t operand_size,
+    uint8_t modes,
+    bool optional_imm8,
+    std::initializer_list<uint8_t> other_prefixes
+) {
+    ZOInstruction zoi = {
+        .opcode             = opcode,
+        .forbidden_prefixes = (uint16_t)(PREFIX_LOCK | forbidden_prefixes),
+        .operand_size       = operand_size,
+        .modes              = modes,
+        .other_prefixes     = {},
+        .n_other_prefixes   = (uint8_t)other_prefixes.size(),
+        .hasOptionalImm8    = optional_imm8
+    };
+    std::copy(other_prefixes.begin(), other_prefixes.end(), zoi.other_prefixes);
+    return zoi;
+}
+
+constexpr ALUInstruction make_alu(uint8_t base, uint8_t digit) {
+    return ALUInstruction {
+        .reg_field  = digit,
+        .opcodes    = {
+            (uint8_t)(base + 0x04),
+            (uint8_t)(base + 0x05),
+            0x80,
+            0x81,
+            0x83,
+            (uint8_t)(base + 0x00),
+            (uint8_t)(base + 0x01),
+            (uint8_t)(base + 0x02),
+            (uint8_t)(base + 0x03)
+        }
+    };
+}
+
+inline constexpr ZOInstruction ZO_TABLE[ZO_COUNT] = {
+#define X(name, opcode, forbidden, operand_size, modes, optional_imm8, ...) \
+    make_zo(opcode, forbidden, operand_size, modes, optional_imm8, { __VA_ARGS__ }),
+    ZO_INSTRUCTIONS(X)
+#undef X
+};
+
+inline constexpr ALUInstruction ALU_TABLE[ALU_COUNT] = {
+#define X(name, base, digit) make_alu(base, digit),
+    ALU_INSTRUCTIONS(X)
+#undef X
+};
+
+inline constexpr SIMDInstruction SIMD_TABLE[SIMD_COUNT] = {
+#define X(sse, avx, pp, map, opcode, store_opcode, kind, scalar) \
+    SIMDInstruction { pp, map, opcode, store_opcode, SIMDKind::kind, false, scalar }, \
+    SIMDInstruction { pp, map, opcode, store_opcode, SIMDKind::kind, true, scalar },
+    SIMD_INSTRUCTIONS(X)
+#undef X
+};
+
+// Mnemonics indexed by ID, for the diagnostics of code that does not start from the text
+inline constexpr std::string_view ZO_NAMES[ZO_COUNT] = {
+#define X(name, ...) #name,
+    ZO_INSTRUCTIONS(X)
+#undef X
+};
+
+inline constexpr std::string_view ALU_NAMES[ALU_COUNT] = {
+#define X(name, ...) #name,
+    ALU_INSTRUCTIONS(X)
+#undef X
+};
+
+inline constexpr std::string_view SIMD_NAMES[SIMD_COUNT] = {
+#define X(sse, avx, ...) #sse, #avx,
+    SIMD_INSTRUCTIONS(X)
+#undef X
+};
+
+enum class InstructionFamily : uint8_t {
+    ZO,
+    ALU,
+    SIMD
+};
+
+struct InstructionName {
+    std::string_view    name;
+    InstructionFamily   family;
+    uint16_t            id;         // index into the family's table
+};
+
+constexpr size_t INSTRUCTION_COUNT = (size_t)ZO_COUNT + (size_t)ALU_COUNT + (size_t)SIMD_COUNT;
+
+// Every mnemonic sorted by name, looked up with a binary search
+inline constexpr std::array<InstructionName, INSTRUCTION_COUNT> INSTRUCTION_NAMES = [] {
+    std::array<InstructionName, INSTRUCTION_COUNT> names = {{
+#define X(name, ...) { #name, InstructionFamily::ZO, ZO_##name },
+        ZO_INSTRUCTIONS(X)
+#undef X
+#define X(name, ...) { #name, InstructionFamily::ALU, ALU_##name },
+        ALU_INSTRUCTIONS(X)
+#undef X
+#define X(sse, avx, ...) { #sse, InstructionFamily::SIMD, SIMD_##sse }, { #avx, InstructionFamily::SIMD, SIMD_##avx },
+        SIMD_INSTRUCTIONS(X)
+#undef X
+    }};
+
+    std::sort(names.begin(), names.end(), [](const InstructionName& a, const InstructionName& b) {
+        return a.name < b.name;
+    });
+    return names;
+}();
+
+static_assert(
+    std::adjacent_find(INSTRUCTION_NAMES.begin(), INSTRUCTION_NAMES.end(), [](const InstructionName& a, const InstructionName& b) {
+        return a.name == b.name;
+    }) == INSTRUCTION_NAMES.end(),
+    "A mnemonic is listed twice in instruction_spec.hpp"
+);
+
+// Returns nullptr if `instruction` is not a known mnemonic
+constexpr const InstructionName* find_instruction(const std::string_view& instruction) {
+    const auto it = std::lower_bound(INSTRUCTION_NAMES.begin(), INSTRUCTION_NAMES.end(), instruction, [](const InstructionName& entry, const std::string_view& name) {
+        return entry.name < name;
+    });
+
+    return it != INSTRUCTION_NAMES.end() && it->name == instruction ? &*it : nullptr;
+}
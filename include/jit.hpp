@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "audasm.hpp"
+#include "emitter.hpp"
+
+namespace audasm {
+    // Entry points start on a cache line so a routine never shares its first fetch block with the previous one
+    constexpr size_t JIT_ENTRY_ALIGNMENT = 64;
+    constexpr size_t JIT_DEFAULT_CHUNK_SIZE = 1 << 16;
+
+    struct CodeChunk {
+        uint8_t*    base;
+        size_t      size;
+    };
+
+    // Executable memory for assembled routines. A chunk is writable until it is committed and executable
+    // afterwards, never both at once
+    struct CodeArena {
+        size_t                  chunk_size;
+        std::vector<CodeChunk>  pending;        // written since the last commit, routines go to the last one
+        size_t                  pending_used;   // bytes used in the last pending chunk
+        std::vector<CodeChunk>  committed;
+        std::vector<CodeChunk>  pool;           // released chunks, writable and ready to be reused
+
+        explicit CodeArena(size_t chunk_size = JIT_DEFAULT_CHUNK_SIZE);
+        CodeArena(const CodeArena&) = delete;
+        CodeArena& operator=(const CodeArena&) = delete;
+        ~CodeArena();
+    };
+
+    struct JitResult {
+        bool            success;
+        const void*     entry;          // only callable once the arena has been committed
+        size_t          size;
+        std::string     diagnostics;
+    };
+
+    // Assembles `source` into the pending chunk of `arena`
+    JitResult assemble_jit(CodeArena& arena, std::string_view source, const Options& options = { .b_mode = M64 });
+
+    // Loads the code built by `emitter` into the pending chunk of `arena`, with no text in between. Calls finish()
+    JitResult assemble_jit(CodeArena& arena, Emitter& emitter);
+
+    // Makes every routine assembled since the last commit executable, later routines go to a fresh chunk. On failure
+    // the pending chunks are left writable
+    bool commit(CodeArena& arena);
+
+    // Invalidates every entry point and returns all chunks to the pool
+    void reset(CodeArena& arena);
+}
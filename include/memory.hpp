@@ -1,9 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <format>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "context.hpp"
+#include "encoding.hpp"
+#include "parsing_utils.hpp"
+#include "registers.hpp"
+#include "stats.hpp"
 
 struct MemoryOperandDescriptor {
     // Legacy 16-bit fields
@@ -20,6 +30,10 @@ struct MemoryOperandDescriptor {
     uint8_t index;  // SIB-index
     uint8_t scale;  // SIB-scale
     uint8_t base;   // SIB-base
+
+    // Long mode fields
+
+    bool rip;       // true for RIP-relative addressing
 };
 
 struct MemoryOperand {
@@ -29,11 +43,734 @@ struct MemoryOperand {
     uint8_t     sib;
     uint8_t     disp_size;
     uint64_t    disp;
+    uint8_t     rex;        // REX.X and REX.B bits for the SIB index and base/rm register
 };
 
-bool parse_memory(Context& ctx, std::string rs, MemoryOperandDescriptor& mdesc);
-uint8_t build_modrm_core(uint8_t rm, uint8_t reg, uint8_t mod);
-bool make_modrm_sib(Context& ctx, MemoryOperandDescriptor desc, uint8_t reg_v, MemoryOperand& mop);
+inline bool invalid_16_bit_repetition(
+    Context& ctx,
+    const std::string_view& atom,
+    const std::string_view& s
+) {
+    diagnose(ctx,
+        "Error on line {}: Illegal repetition of register `{}` in 16-bit memory operand `[{}]`",
+        ctx.line_no,
+        atom,
+        s
+    );
+    ctx.on_error = true;
+    return false;
+}
+
+inline bool invalid_16_bit_combination(
+    Context& ctx,
+    const std::string_view& s
+) {
+    diagnose(ctx,
+        "Error on line {}: Illegal combination of registers in 16-bit memory operand `[{}]`",
+        ctx.line_no,
+        s
+    );
+    ctx.on_error = true;
+    return false;
+}
+
+constexpr void parse_quark(
+    Context& ctx,
+    const std::vector<std::string_view>& quarks,
+    const std::string& atom,
+    const std::string& rs,
+    size_t x,
+    size_t y,
+    uint8_t& register_encoding,
+    int32_t& register_size,
+    uint8_t& scale
+) {
+    const auto& [name, reg, rsize] = *find_register(quarks[x]);
+    if (rsize != 32 && rsize != 64) {
+        diagnose(ctx,
+            "Error on line {}: Invalid width for register `{}` in scaled index `{}` in memory operand `[{}]`",
+            ctx.line_no,
+            quarks[x],
+            atom,
+            rs
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    register_encoding = ::register_encoding(reg);
+    register_size = rsize;
+    uint64_t n;
+
+    if (
+        !parse_number(ctx, quarks[y], n)
+        || !(n == 1 || n == 2 || n == 4 || n == 8)
+    ) {
+        diagnose(ctx,
+            "Error on line {}: invalid scale `{}` in memory operand `[{}]`, must be 1, 2, 4 or 8 ; default is 1 if absent",
+            ctx.line_no,
+            quarks[y],
+            rs
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    scale = (uint8_t)n;
+}
+
+// The address size is set by the first register, a displacement alone only provides a default
+constexpr bool has_address_registers(const MemoryOperandDescriptor& desc) {
+    return desc.bx || desc.bp || desc.si || desc.di || desc.rip || desc.base != 0xFF || desc.index != 0xFF;
+}
+
+#define match_16_bit_reg(X, Y)                                  \
+    do {                                                        \
+        if (desc.X) {                                           \
+            return invalid_16_bit_repetition(ctx, atom, rs);    \
+        }                                                       \
+        else if (desc.Y) {                                      \
+            return invalid_16_bit_combination(ctx, rs);         \
+        }                                                       \
+        desc.X = true;                                          \
+    } while (0)
+
+constexpr bool parse_memory(
+    Context& ctx,
+    std::string rs,
+    MemoryOperandDescriptor& mdesc
+) {
+    StatsScope scope(ctx.stats, PHASE_MEMORY);
+
+    std::string s = rs;
+    s.erase(std::remove(s.begin(), s.end(), ' '), s.end());
+
+    std::string atom = "";
+    bool is_adding = true;
+
+    MemoryOperandDescriptor desc = {
+        .size   = 0,
+        .bx     = false,
+        .bp     = false,
+        .si     = false,
+        .di     = false,
+        .disp   = 0,
+        .index  = 0xFF,
+        .scale  = 0,
+        .base   = 0xFF,
+        .rip    = false
+    };
+
+    for (size_t i = 0; i <= s.size(); ++i) {
+        const char& c = s[i];
+
+        if (c != '+' && c != '-' && i < s.size()) {
+            atom.push_back(c);
+        }
+        else {
+            if (atom == "RIP") {
+                if (ctx.b_mode != BitsMode::M64) {
+                    diagnose(ctx,
+                        "Error on line {}: RIP-relative addressing in memory operand `[{}]` is only available in 64-bit mode",
+                        ctx.line_no,
+                        rs
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+                else if (!is_adding || has_address_registers(desc)) {
+                    diagnose(ctx,
+                        "Error on line {}: RIP can only be combined with a displacement in memory operand `[{}]`, consider using the format `[RIP + DISP]`",
+                        ctx.line_no,
+                        rs
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+
+                desc.rip = true;
+                desc.size = 64;
+            }
+            else if (const RegisterName* atom_register = find_register(atom)) {
+                const auto& [name, reg, rsize] = *atom_register;
+                switch (rsize) {
+                    case 8: {
+                        diagnose(ctx,
+                            "Error on line {}: Invalid memory operand `[{}]` (illegal use of 8-bit register `{}`)",
+                            ctx.line_no,
+                            rs,
+                            atom
+                        );
+                        ctx.on_error = true;
+                        return false;
+                    }
+                    case 16: {
+                        if (!has_address_registers(desc)) {
+                            desc.size = 16;
+                        }
+                        else if (desc.size != 16) {
+                            diagnose(ctx,
+                                "Error on line {}: Invalid combination of 16-bit register `{}` in {}-bit memory operand `[{}]`",
+                                ctx.line_no,
+                                atom,
+                                desc.size,
+                                rs
+                            );
+                            ctx.on_error = true;
+                            return false;
+                        }
+
+                        switch (reg) {
+                            case AsmRegister::BX: {
+                                match_16_bit_reg(bx, bp);
+                                break;
+                            }
+                            case AsmRegister::BP: {
+                                match_16_bit_reg(bp, bx);
+                                break;
+                            }
+                            case AsmRegister::SI: {
+                                match_16_bit_reg(si, di);
+                                break;
+                            }
+                            case AsmRegister::DI: {
+                                match_16_bit_reg(di, si);
+                                break;
+                            }
+                            default: {
+                                diagnose(ctx,
+                                    "Error on line {}: Use of invalid 16-bit register `{}` in 16-bit memory operand `[{}]`",
+                                    ctx.line_no,
+                                    atom,
+                                    rs
+                                );
+                                ctx.on_error = true;
+                                return false;
+                            }
+                        }
+
+                        break;
+                    }
+                    case 32: case 64: {
+                        if (!has_address_registers(desc)) {
+                            desc.size = (uint8_t)rsize;
+                        }
+                        else if (desc.size != rsize) {
+                            diagnose(ctx,
+                                "Error on line {}: Invalid combination of {}-bit register `{}` in {}-bit memory operand `[{}]`",
+                                ctx.line_no,
+                                rsize,
+                                atom,
+                                desc.size,
+                                rs
+                            );
+                            ctx.on_error = true;
+                            return false;
+                        }
+
+                        uint8_t encoding = register_encoding(reg);
+
+                        if (desc.base == 0xFF) {
+                            desc.base = encoding;
+                        }
+                        else if (desc.index == 0xFF) {
+                            desc.scale = 1;
+                            desc.index = encoding;
+                        }
+                        else {
+                            if (encoding == desc.base) {
+                                if (desc.index == 0xFF || desc.scale == 1) {
+                                    desc.base = desc.index;
+                                    desc.index = encoding;
+                                    desc.scale = 2;
+                                }
+                                else {
+                                    diagnose(ctx,
+                                        "Error on line {}: Invalid repetition of {}-bit register `{}` in memory operand `[{}]`, consider using the format `[SCALE * INDEX + BASE + DISP]`",
+                                        ctx.line_no,
+                                        rsize,
+                                        atom,
+                                        rs
+                                    );
+                                    ctx.on_error = true;
+                                    return false;
+                                }
+                            }
+                            else if (encoding == desc.index) {
+                                desc.scale += is_adding ? 1 : -1;
+                            }
+                            else {
+                                diagnose(ctx,
+                                    "Error on line {}: Invalid use of third {}-bit register `{}` in memory operand `[{}]`, consider using the format `[SCALE * INDEX + BASE + DISP]`",
+                                    ctx.line_no,
+                                    rsize,
+                                    atom,
+                                    rs
+                                );
+                                ctx.on_error = true;
+                                return false;
+                            }
+                        }
+
+                        break;
+                    }
+                    default: {
+                        diagnose(ctx,
+                            "Error on line {}: Unsupported width for {}-bit register `{}` in memory operand `[{}]`",
+                            ctx.line_no,
+                            rsize == -1 ? 16 : rsize,
+                            atom,
+                            rs
+                        );
+                        ctx.on_error = true;
+                        return false;
+                    }
+                }
+            }
+            else if (atom.contains('*')) {
+                std::vector<std::string_view> quarks = split_string(atom, '*');
+
+                uint8_t register_encoding;
+                int32_t register_size;
+                uint8_t scale;
+
+                if (quarks.size() != 2) {
+                    diagnose(ctx,
+                        "Error on line {}: Too many fields in scaled index `{}` in memory operand `[{}]`, consider using the format `[SCALe * INDEX + BASE + DISP]`",
+                        ctx.line_no,
+                        atom,
+                        rs
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+                else if (find_register(quarks[0]) != nullptr) {
+                    parse_quark(ctx, quarks, atom, rs, 0, 1, register_encoding, register_size, scale);
+                    if (ctx.on_error) {
+                        return false;
+                    }
+                }
+                else if (find_register(quarks[1]) != nullptr) {
+                    parse_quark(ctx, quarks, atom, rs, 1, 0, register_encoding, register_size, scale);
+                    if (ctx.on_error) {
+                        return false;
+                    }
+                }
+                else {
+                    diagnose(ctx,
+                        "Error on line {}: Invalid scaled index `{}` in memory operand `[{}]`, no memory operand is a valid register",
+                        ctx.line_no,
+                        atom,
+                        rs
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+
+                if (!has_address_registers(desc)) {
+                    desc.size = (uint8_t)register_size;
+                }
+                else if (desc.size != register_size) {
+                    diagnose(ctx,
+                        "Error on line {}: Invalid combination of {}-bit register `{}` in {}-bit memory operand `[{}]`",
+                        ctx.line_no,
+                        register_size,
+                        atom,
+                        desc.size,
+                        rs
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+
+                if (!is_adding) {
+                    scale = -scale;
+                }
+
+                if (desc.index != 0xFF) {
+                    if (desc.index == register_encoding) {
+                        desc.scale += scale;
+                    }
+                    else if (desc.base == 0xFF && desc.scale == 1) {
+                        desc.base = desc.index;
+                        desc.scale = scale;
+                    }
+                    else {
+                        diagnose(ctx,
+                            "Error on line {}: Cannot have two scaled indexes in memory operand `[{}]`, consider using the format `[SCALE * INDEX + BASE + DISP]`",
+                            ctx.line_no,
+                            rs
+                        );
+                        ctx.on_error = true;
+                        return false;
+                    }
+                }
+                else {
+                    // The base is kept when it is the same register, `[R12+1*R12]` is `[R12+R12*1]`
+                    desc.scale = scale;
+                }
+
+                desc.index = register_encoding;
+            }
+            else {
+                uint64_t n;
+                if (!parse_number(ctx, atom, n)) {
+                    diagnose(ctx,
+                        "Error on line {}: Invalid expression `{}` in memory operand `[{}]`, consider using the format `[SCALE * INDEX + BASE + DISP]`",
+                        ctx.line_no,
+                        atom,
+                        rs
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+
+                int64_t sn = (int64_t)n;
+                if (!test_number_strict<int32_t>(sn)) {
+                    sn = (int64_t)((int32_t)sn);
+                    diagnose(ctx,
+                        "Warning on line {}: Displacement magnitude of `{}` is too large, applying modulo 2^32, might cause unwanted or undefined behavior",
+                        ctx.line_no,
+                        atom
+                    );
+                }
+
+                if (desc.size == 0 && ctx.b_mode == BitsMode::M64) {
+                    desc.size = 64;
+                }
+                else if (desc.size == 0) {
+                    if (!test_number_strict<int16_t>(sn)) {
+                        sn = (int64_t)((int32_t)sn);
+                        diagnose(ctx,
+                            "Warning on line {}: Displacement magnitude of `{}` is too large, applying modulo 2^16, might cause unwanted or undefined behavior",
+                            ctx.line_no,
+                            atom
+                        );
+                    }
+                    desc.size = 16;
+                }
+
+                desc.disp += is_adding ? sn : -sn;
+            }
+
+            is_adding = c == '+';
+            atom.clear();
+        }
+    }
+
+    if (desc.rip && (desc.base != 0xFF || desc.index != 0xFF)) {
+        diagnose(ctx,
+            "Error on line {}: RIP can only be combined with a displacement in memory operand `[{}]`, consider using the format `[RIP + DISP]`",
+            ctx.line_no,
+            rs
+        );
+        ctx.on_error = true;
+        return false;
+    }
+
+    switch (desc.scale) {
+        case 0: case 1: case 2: case 4: case 8:
+            mdesc = desc;
+            return true;
+        default: {
+            diagnose(ctx,
+                "Error on line {}: Invalid scale `{}` in memory operand `[{}]`, valid values are 1, 2, 4 and 8",
+                ctx.line_no,
+                desc.scale,
+                rs
+            );
+            ctx.on_error = true;
+            return false;
+        }
+    }
+}
+
+#undef match_16_bit_reg
+
+constexpr uint8_t build_modrm_core(uint8_t rm, uint8_t reg, uint8_t mod) {
+    return ((mod & 0x3) << 6) | ((reg & 0x7) << 3) | (rm & 0x7);
+}
+
+constexpr bool build_16bit_modrm(
+    Context& ctx,
+    const MemoryOperandDescriptor& desc,
+    uint8_t rm,
+    uint8_t reg,
+    MemoryOperand& mop
+) {
+    if (desc.disp == 0) {
+        mop = {
+            .size       = 16,
+            .modrm      = build_modrm_core(rm, reg, 0b00),
+            .has_sib    = false,
+            .sib        = 0,
+            .disp_size  = 0,
+            .disp       = 0
+        };
+        return true;
+    }
+    else if (test_number_strict<int8_t>(desc.disp)) {
+        mop = {
+            .size       = 16,
+            .modrm      = build_modrm_core(rm, reg, 0b01),
+            .has_sib    = false,
+            .sib        = 0,
+            .disp_size  = 8,
+            .disp       = (uint64_t)desc.disp
+        };
+        return true;
+    }
+    else if (test_number_strict<int16_t>(desc.disp)) {
+        mop = {
+            .size       = 16,
+            .modrm      = build_modrm_core(rm, reg, 0b10),
+            .has_sib    = false,
+            .sib        = 0,
+            .disp_size  = 16,
+            .disp       = (uint64_t)desc.disp
+        };
+        return true;
+    }
+    else {
+        diagnose(ctx,
+            "Error on line {}: Displacement `{}` is too large for 16-bit addressing mode",
+            ctx.line_no,
+            desc.disp
+        );
+        ctx.on_error = true;
+        return false;
+    }
+}
+
+constexpr uint8_t build_sib_core(uint8_t base, uint8_t index, uint8_t scale) {
+    uint8_t scl;
+    
+    switch (scale) {
+        case 2: {
+            scl = 0b01;
+            break;
+        }
+        case 4: {
+            scl = 0b10;
+            break;
+        }
+        case 8: {
+            scl = 0b11;
+            break;
+        }
+        default: scl = 0b00;
+    }
+
+    return (scl << 6) | ((index & 0x7) << 3) | (base & 0x7);
+}
+
+constexpr bool make_modrm_sib(
+    Context& ctx,
+    MemoryOperandDescriptor desc,
+    uint8_t reg_v,
+    MemoryOperand& mop
+) {
+    StatsScope scope(ctx.stats, PHASE_MEMORY);
+
+    switch (desc.size) {
+        case 16: {
+            if (desc.bx) {
+                if (desc.si) {
+                    return build_16bit_modrm(ctx, desc, 0b000, reg_v, mop);
+                }
+                else if (desc.di) {
+                    return build_16bit_modrm(ctx, desc, 0b001, reg_v, mop);
+                }
+                else {
+                    return build_16bit_modrm(ctx, desc, 0b111, reg_v, mop);
+                }
+            }
+            else if (desc.bp) {
+                if (desc.si) {
+                    return build_16bit_modrm(ctx, desc, 0b010, reg_v, mop);
+                }
+                else if (desc.di) {
+                    return build_16bit_modrm(ctx, desc, 0b011, reg_v, mop);
+                }
+                else if (test_number_strict<int8_t>(desc.disp)) {
+                    mop = {
+                        .size       = 16,
+                        .modrm      = build_modrm_core(0b110, reg_v, 0b01),
+                        .has_sib    = false,
+                        .sib        = 0,
+                        .disp_size  = 8,
+                        .disp       = (uint64_t)desc.disp
+                    };
+                    return true;
+                }
+                else {
+                    mop = {
+                        .size       = 16,
+                        .modrm      = build_modrm_core(0b110, reg_v, 0b10),
+                        .has_sib    = false,
+                        .sib        = 0,
+                        .disp_size  = 16,
+                        .disp       = (uint64_t)desc.disp
+                    };
+                    return true;
+                }
+            }
+            else if (desc.si) {
+                return build_16bit_modrm(ctx, desc, 0b100, reg_v, mop);
+            }
+            else if (desc.di) {
+                return build_16bit_modrm(ctx, desc, 0b101, reg_v, mop);
+            }
+            else {
+                mop = {
+                    .size       = 16,
+                    .modrm      = build_modrm_core(0b110, reg_v, 0b00),
+                    .has_sib    = false,
+                    .sib        = 0,
+                    .disp_size  = 16,
+                    .disp       = (uint64_t)desc.disp
+                };
+                return true;
+            }
+
+            break;
+        }
+        case 32: case 64: {
+            const uint8_t esp_encoding = register_encoding(AsmRegister::ESP);
+            const uint8_t ebp_encoding = register_encoding(AsmRegister::EBP);
+
+            if (desc.rip) {
+                mop = {
+                    .size       = 64,
+                    .modrm      = build_modrm_core(ebp_encoding, reg_v, 0b00),
+                    .has_sib    = false,
+                    .sib        = 0,
+                    .disp_size  = 32,
+                    .disp       = (uint64_t)desc.disp,
+                    .rex        = 0
+                };
+                return true;
+            }
+
+            if (desc.index == esp_encoding) {
+                if (desc.scale != 1) {
+                    diagnose(ctx,
+                        "Error on line {}: Cannot use ESP with a memory index",
+                        ctx.line_no
+                    );
+                    ctx.on_error = true;
+                    return false;
+                }
+                std::swap(desc.base, desc.index);
+            }
+
+            const uint8_t rex =
+                (desc.index != 0xFF && (desc.index & REG_REX_EXTENSION) ? REX_X : 0)
+                | (desc.base != 0xFF && (desc.base & REG_REX_EXTENSION) ? REX_B : 0);
+
+            // R12 and R13 only differ from ESP and EBP by REX.B, so they share their special cases
+            const uint8_t base_rm = desc.base & 0x7;
+
+            const uint8_t disp_size = test_number_strict<int8_t>(desc.disp) ? 8 : 32;
+            const uint8_t mmod = (disp_size == 8) ? 0b01 : 0b10;
+
+            if (desc.base == 0xFF && desc.index == 0xFF) {
+                mop = {
+                    .size       = desc.size,
+                    .modrm      = build_modrm_core(esp_encoding, reg_v, 0b00),
+                    .has_sib    = true,
+                    .sib        = build_sib_core(ebp_encoding, esp_encoding, 0b00),
+                    .disp_size  = 32,
+                    .disp       = (uint64_t)desc.disp,
+                    .rex        = rex
+                };
+                return true;
+            }
+            else if (desc.index == 0xFF && base_rm != esp_encoding) {
+                if (desc.disp == 0 && base_rm != ebp_encoding) {
+                    mop = {
+                        .size       = desc.size,
+                        .modrm      = build_modrm_core(desc.base, reg_v, 0b00),
+                        .has_sib    = false,
+                        .sib        = 0,
+                        .disp_size  = 0,
+                        .disp       = 0,
+                        .rex        = rex
+                    };
+                    return true;
+                }
+                else {
+                    mop = {
+                        .size       = desc.size,
+                        .modrm      = build_modrm_core(desc.base, reg_v, mmod),
+                        .has_sib    = false,
+                        .sib        = 0,
+                        .disp_size  = disp_size,
+                        .disp       = (uint64_t)desc.disp,
+                        .rex        = rex
+                    };
+                    return true;
+                }
+            }
+
+            const uint8_t sib_rm = esp_encoding;
+            const uint8_t sib_index = (desc.index == 0xFF) ? esp_encoding : desc.index;
+
+            if (desc.base == 0xFF) {
+                mop = {
+                    .size       = desc.size,
+                    .modrm      = build_modrm_core(sib_rm, reg_v, 0b00),
+                    .has_sib    = true,
+                    .sib        = build_sib_core(ebp_encoding, sib_index, desc.scale),
+                    .disp_size  = 32,
+                    .disp       = (uint64_t)desc.disp,
+                    .rex        = rex
+                };
+                return true;
+            }
+            else if (desc.disp == 0 && base_rm != ebp_encoding) {
+                mop = {
+                    .size       = desc.size,
+                    .modrm      = build_modrm_core(sib_rm, reg_v, 0b00),
+                    .has_sib    = true,
+                    .sib        = build_sib_core(desc.base, sib_index, desc.scale),
+                    .disp_size  = 0,
+                    .disp       = 0,
+                    .rex        = rex
+                };
+                return true;
+            }
+            else {
+                mop = {
+                    .size       = desc.size,
+                    .modrm      = build_modrm_core(sib_rm, reg_v, mmod),
+                    .has_sib    = true,
+                    .sib        = build_sib_core(desc.base, sib_index, desc.scale),
+                    .disp_size  = disp_size,
+                    .disp       = (uint64_t)desc.disp,
+                    .rex        = rex
+                };
+                return true;
+            }
+
+            break;
+        }
+        default: return false;
+    }
+}
+
+constexpr void encode_disp_16(EncodedInstruction& ins, uint8_t disp_size, uint64_t disp) {
+    switch (disp_size) {
+        case  8: encode_disp(ins, disp, sizeof(uint8_t)); break;
+        case 16: encode_disp(ins, disp, sizeof(uint16_t)); break;
+        default: break;
+    }
+}
 
-void output_disp_16(Context& ctx, uint8_t disp_size, uint64_t disp);
-void output_disp_32(Context& ctx, uint8_t disp_size, uint64_t disp);
\ No newline at end of file
+constexpr void encode_disp_32(EncodedInstruction& ins, uint8_t disp_size, uint64_t disp) {
+    switch (disp_size) {
+        case  8: encode_disp(ins, disp, sizeof(uint8_t)); break;
+        case 32: encode_disp(ins, disp, sizeof(uint32_t)); break;
+        default: break;
+    }
+}
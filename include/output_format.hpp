@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+enum class OutputFormat {
+    BINARY,
+    HEX,        // two hex digits per byte, 32 bytes per line
+    CARRAY,     // `unsigned char name[] = { ... };` followed by `unsigned int name_len`, like xxd -i
+    IHEX        // Intel HEX data records of 16 bytes, with extended linear address records past 64 KiB
+};
+
+struct OutputFormatInfo {
+    OutputFormat        format;
+    std::string_view    name;
+};
+
+constexpr OutputFormatInfo OUTPUT_FORMATS[] = {
+    { OutputFormat::BINARY, "bin" },
+    { OutputFormat::HEX,    "hex" },
+    { OutputFormat::CARRAY, "carray" },
+    { OutputFormat::IHEX,   "ihex" }
+};
+
+bool parse_output_format(std::string_view name, OutputFormat& format);
+
+// C identifier made of the file name of `path`, like the one xxd -i picks: `out/boot.bin` gives `boot_bin`
+std::string carray_name(const std::string& path);
+
+// Formats the bytes written to it as text, which is handed to `sink` in large blocks. Every byte is formatted
+// through lookup tables, a block of input never goes through std::format.
+// finish() writes what follows the last byte (closing brace, end-of-file record) and is called once at the end.
+class TextOutputBuffer final : public std::streambuf {
+public:
+    TextOutputBuffer(std::streambuf* sink, OutputFormat format, std::string_view array_name = "output");
+    ~TextOutputBuffer() override;
+
+    // Returns false if the sink refused any of the text
+    bool finish();
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int overflow(int c) override;
+    int sync() override;
+
+private:
+    void format_bytes(const uint8_t* data, size_t n);
+    void format_hex(const uint8_t* data, size_t n);
+    void format_carray(const uint8_t* data, size_t n);
+    void format_ihex(const uint8_t* data, size_t n);
+    void write_ihex_data(uint64_t address, const uint8_t* data, size_t n);
+    void write_ihex_record(uint8_t type, uint16_t address, const uint8_t* data, size_t n);
+    void append(std::string_view text);
+    void flush_text();
+
+    std::streambuf*         sink;
+    OutputFormat            format;
+    std::string             array_name;
+
+    std::unique_ptr<char[]> text;
+    size_t                  text_size;      // formatted text not yet handed to the sink
+
+    uint64_t                byte_count;     // bytes formatted so far
+    size_t                  column;         // bytes on the current line, HEX and CARRAY
+    uint8_t                 record[16];     // bytes of the IHEX record being filled
+    uint32_t                upper_address;  // last extended linear address written, IHEX
+    bool                    failed;
+};
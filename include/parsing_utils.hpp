@@ -1,25 +1,126 @@
 #pragma once
 
+#include <charconv>
 #include <cstdint>
+#include <format>
 #include <limits>
+#include <ostream>
 #include <string_view>
 #include <type_traits>
 #include <vector>
 
-#include "argument.hpp"
 #include "context.hpp"
 
-std::string_view trim_string(const std::string_view& s);
-std::vector<std::string_view> split_string(std::string_view s, char del);
-bool parse_number(Context& ctx, const std::string_view& s, uint64_t& res);
-std::vector<AsmArg> expect_arguments(Context& ctx, const std::string_view& s, size_t N);
+// std::from_chars is not constexpr in the libraries this builds with, the compile-time assembler parses the digits
+// itself. Both accept exactly the int64_t literals, with an optional minus sign.
+constexpr bool parse_number_base(const std::string_view& s, int base, uint64_t& res) {
+    if consteval {
+        const bool negative = s.starts_with('-');
+        const std::string_view digits = negative ? s.substr(1) : s;
+        const uint64_t limit = negative ? (uint64_t)1 << 63 : ((uint64_t)1 << 63) - 1;
 
-template<typename T> requires std::numeric_limits<T>::is_integer bool test_number(int64_t n) {
+        uint64_t value = 0;
+        for (char c : digits) {
+            const int digit =
+                (c >= '0' && c <= '9') ? c - '0' :
+                (c >= 'A' && c <= 'Z') ? c - 'A' + 10 :
+                (c >= 'a' && c <= 'z') ? c - 'a' + 10 :
+                base;
+            if (digit >= base || value > (limit - digit) / base) {
+                return false;
+            }
+            value = value * base + digit;
+        }
+
+        res = negative ? 0 - value : value;
+        return !digits.empty();
+    }
+
+    int64_t temp = 0;
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), temp, base);
+    res = temp;
+    return ec == std::errc{} && ptr == s.data() + s.size();
+}
+
+constexpr std::string_view trim_string(const std::string_view& s) {
+    size_t endpos   = s.find_last_not_of(" \t\n");
+    size_t startpos = s.find_first_not_of(" \t");
+
+    return (endpos == std::string_view::npos)
+        ? ""
+        : s.substr(startpos, endpos - startpos + 1);
+    
+}
+
+constexpr std::vector<std::string_view> split_string(std::string_view s, char del) {
+    std::vector<std::string_view> tokens;
+    size_t i = 0;
+
+    while ((i = s.find(del)) != std::string_view::npos) {
+        tokens.emplace_back(s.substr(0, i));
+        s = s.substr(i + 1);
+    }
+    if (!s.empty()) {
+        tokens.emplace_back(s);
+    }
+
+    return tokens;
+}
+
+constexpr bool parse_number(Context& ctx, const std::string_view& s, uint64_t& res) {
+    if (s.starts_with("0X")) {
+        const std::string_view& suffix = s.substr(2);
+        if (!parse_number_base(suffix, 16, res)) {
+            ctx.on_error = true;
+            diagnose(ctx,
+                "Arithmetic error on line {}: invalid hexadecimal literal `{}`",
+                ctx.line_no,
+                s
+            );
+        }
+    }
+    else if (s.starts_with("0O")) {
+        const std::string_view& suffix = s.substr(2);
+        if (!parse_number_base(suffix, 8, res)) {
+            ctx.on_error = true;
+            diagnose(ctx,
+                "Arithmetic error on line {}: invalid octal literal `{}`",
+                ctx.line_no,
+                s
+            );
+        }
+    }
+    else if (s.starts_with("0B")) {
+        const std::string_view& suffix = s.substr(2);
+        if (!parse_number_base(suffix, 2, res)) {
+            ctx.on_error = true;
+            diagnose(ctx,
+                "Arithmetic error on line {}: invalid binary literal `{}`",
+                ctx.line_no,
+                s
+            );
+        }
+    }
+    else {
+        if (!parse_number_base(s, 10, res)) {
+            ctx.on_error = true;
+            diagnose(ctx,
+                "Arithmetic error on line {}: invalid decimal literal `{}`",
+                ctx.line_no,
+                s
+            );
+        }
+    }
+
+    return !ctx.on_error;
+}
+
+template<typename T> requires std::numeric_limits<T>::is_integer constexpr bool test_number(int64_t n) {
     return
         (n >= (int64_t)std::numeric_limits<T>::min() && n <= (int64_t)std::numeric_limits<T>::max())
         || ((uint64_t)n >= 0 && (uint64_t)n <= (uint64_t)std::numeric_limits<typename std::make_unsigned<T>::type>::max());
 }
 
-template<typename T> requires std::numeric_limits<T>::is_integer bool test_number_strict(int64_t n) {
+template<typename T> requires std::numeric_limits<T>::is_integer constexpr bool test_number_strict(int64_t n) {
     return n >= (int64_t)std::numeric_limits<T>::min() && n <= (int64_t)std::numeric_limits<T>::max();
 }
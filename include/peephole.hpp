@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+enum PeepholeRule {
+    CMP_ZERO_TO_TEST,   // CMP reg, 0           -> TEST reg, reg
+    ACC_IMM8,           // OP AX/EAX, imm8      -> OP r/m, sign-extended imm8 (0x83) instead of imm16/32
+    SEXT_IMM8,          // OP r/m, imm16/32     -> OP r/m, sign-extended imm8 when the value survives the round trip
+    PEEPHOLE_RULE_COUNT
+};
+
+struct PeepholeStats {
+    size_t hits[PEEPHOLE_RULE_COUNT];
+    size_t bytes_saved[PEEPHOLE_RULE_COUNT];
+};
+
+void record_peephole_hit(PeepholeStats& stats, PeepholeRule rule, size_t bytes_saved);
+void print_peephole_stats(const PeepholeStats& stats, std::ostream& out);
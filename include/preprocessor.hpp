@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "context.hpp"
+#include "source.hpp"
+
+enum class TokenKind : uint8_t {
+    TEXT,
+    IDENTIFIER,
+    PARAMETER,          // %1 ... %N, `offset` holds N
+    PARAMETER_COUNT     // %0
+};
+
+struct Token {
+    TokenKind   kind;
+    uint32_t    offset;
+    uint32_t    length;
+};
+
+struct TokenizedLine {
+    uint32_t    first_token;
+    uint32_t    token_count;
+};
+
+// Lines recorded once at definition time, tokens point into `text`
+struct TokenizedBlock {
+    std::string                 text;
+    std::vector<Token>          tokens;
+    std::vector<TokenizedLine>  lines;
+};
+
+struct Macro {
+    size_t          n_params;
+    TokenizedBlock  body;
+};
+
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+template<typename T> using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+
+struct Conditional {
+    bool parent_active;
+    bool taken;
+    bool active;
+    bool in_else;
+};
+
+enum class RecordingKind {
+    NONE,
+    MACRO,
+    REP
+};
+
+struct Recording {
+    RecordingKind   kind;
+    std::string     name;
+    size_t          n_params;
+    uint64_t        count;
+    size_t          depth;
+    size_t          line_no;
+    TokenizedBlock  block;
+};
+
+struct Preprocessor {
+    StringMap<std::string>                      defines;
+    StringMap<std::shared_ptr<const Macro>>     macros;
+    std::vector<Conditional>                    conditionals;
+    Recording                                   recording;
+    size_t                                      expansion_depth;
+};
+
+using LineSink = void (*)(Context& ctx, const std::string_view& line);
+
+void preprocess_line(Context& ctx, Preprocessor& pp, const std::string_view& line, LineSink sink);
+bool preprocessor_passes_through(const Preprocessor& pp);
+bool preprocessor_is_skipping(const Preprocessor& pp);
+size_t skip_to_next_directive(const SourceFile& file, size_t i);
+void finish_preprocessing(Context& ctx, const Preprocessor& pp);
@@ -1,18 +1,57 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <string_view>
-#include <unordered_map>
+
+// Register encodings: bits 0-2 go in the ModRM/SIB fields, bit 3 in REX.R/X/B,
+// bits 4-5 tell whether the register needs or cannot take a REX prefix
+constexpr uint8_t REG_REX_EXTENSION = 1 << 3;
+constexpr uint8_t REG_REX_REQUIRED  = 1 << 4;   // SPL, BPL, SIL, DIL
+constexpr uint8_t REG_REX_FORBIDDEN = 1 << 5;   // AH, CH, DH, BH
+
+// REX prefix bits, the prefix byte is 0x40 | bits
+constexpr uint8_t REX_B = 1 << 0;
+constexpr uint8_t REX_X = 1 << 1;
+constexpr uint8_t REX_R = 1 << 2;
+constexpr uint8_t REX_W = 1 << 3;
 
 enum class AsmRegister {
-    AL, AH, AX, EAX,
-    BL, BH, BX, EBX,
-    CL, CH, CX, ECX,
-    DL, DH, DX, EDX,
-            SI, ESI,
-            DI, EDI,
-            SP, ESP,
-            BP, EBP,
+    AL,   AH,   AX,   EAX,  RAX,
+    BL,   BH,   BX,   EBX,  RBX,
+    CL,   CH,   CX,   ECX,  RCX,
+    DL,   DH,   DX,   EDX,  RDX,
+    SIL,        SI,   ESI,  RSI,
+    DIL,        DI,   EDI,  RDI,
+    SPL,        SP,   ESP,  RSP,
+    BPL,        BP,   EBP,  RBP,
+    R8B,        R8W,  R8D,  R8,
+    R9B,        R9W,  R9D,  R9,
+    R10B,       R10W, R10D, R10,
+    R11B,       R11W, R11D, R11,
+    R12B,       R12W, R12D, R12,
+    R13B,       R13W, R13D, R13,
+    R14B,       R14W, R14D, R14,
+    R15B,       R15W, R15D, R15,
+    XMM0,     YMM0,
+    XMM1,     YMM1,
+    XMM2,     YMM2,
+    XMM3,     YMM3,
+    XMM4,     YMM4,
+    XMM5,     YMM5,
+    XMM6,     YMM6,
+    XMM7,     YMM7,
+    XMM8,     YMM8,
+    XMM9,     YMM9,
+    XMM10,    YMM10,
+    XMM11,    YMM11,
+    XMM12,    YMM12,
+    XMM13,    YMM13,
+    XMM14,    YMM14,
+    XMM15,    YMM15,
     CS,
     DS,
     ES,
@@ -21,5 +60,220 @@ enum class AsmRegister {
     SS
 };
 
-extern std::unordered_map<std::string_view, std::pair<AsmRegister, int32_t>> REGISTERS;
-extern std::unordered_map<AsmRegister, uint8_t> REGISTERS_ENCODING;
+constexpr size_t REGISTER_COUNT = (size_t)AsmRegister::SS + 1;
+
+struct RegisterName {
+    std::string_view    name;
+    AsmRegister         reg;
+    int32_t             size;       // in bits, -1 for the segment registers
+};
+
+// Every register sorted by name, looked up with a binary search
+inline constexpr std::array<RegisterName, REGISTER_COUNT> REGISTER_NAMES = [] {
+    std::array<RegisterName, REGISTER_COUNT> names = {{
+        { "AL",    AsmRegister::AL,      8 },
+        { "AH",    AsmRegister::AH,      8 },
+        { "AX",    AsmRegister::AX,     16 },
+        { "EAX",   AsmRegister::EAX,    32 },
+        { "RAX",   AsmRegister::RAX,    64 },
+        { "BL",    AsmRegister::BL,      8 },
+        { "BH",    AsmRegister::BH,      8 },
+        { "BX",    AsmRegister::BX,     16 },
+        { "EBX",   AsmRegister::EBX,    32 },
+        { "RBX",   AsmRegister::RBX,    64 },
+        { "CL",    AsmRegister::CL,      8 },
+        { "CH",    AsmRegister::CH,      8 },
+        { "CX",    AsmRegister::CX,     16 },
+        { "ECX",   AsmRegister::ECX,    32 },
+        { "RCX",   AsmRegister::RCX,    64 },
+        { "DL",    AsmRegister::DL,      8 },
+        { "DH",    AsmRegister::DH,      8 },
+        { "DX",    AsmRegister::DX,     16 },
+        { "EDX",   AsmRegister::EDX,    32 },
+        { "RDX",   AsmRegister::RDX,    64 },
+        { "SIL",   AsmRegister::SIL,     8 },
+        { "SI",    AsmRegister::SI,     16 },
+        { "ESI",   AsmRegister::ESI,    32 },
+        { "RSI",   AsmRegister::RSI,    64 },
+        { "DIL",   AsmRegister::DIL,     8 },
+        { "DI",    AsmRegister::DI,     16 },
+        { "EDI",   AsmRegister::EDI,    32 },
+        { "RDI",   AsmRegister::RDI,    64 },
+        { "SPL",   AsmRegister::SPL,     8 },
+        { "SP",    AsmRegister::SP,     16 },
+        { "ESP",   AsmRegister::ESP,    32 },
+        { "RSP",   AsmRegister::RSP,    64 },
+        { "BPL",   AsmRegister::BPL,     8 },
+        { "BP",    AsmRegister::BP,     16 },
+        { "EBP",   AsmRegister::EBP,    32 },
+        { "RBP",   AsmRegister::RBP,    64 },
+        { "R8B",   AsmRegister::R8B,     8 },
+        { "R8W",   AsmRegister::R8W,    16 },
+        { "R8D",   AsmRegister::R8D,    32 },
+        { "R8",    AsmRegister::R8,     64 },
+        { "R9B",   AsmRegister::R9B,     8 },
+        { "R9W",   AsmRegister::R9W,    16 },
+        { "R9D",   AsmRegister::R9D,    32 },
+        { "R9",    AsmRegister::R9,     64 },
+        { "R10B",  AsmRegister::R10B,    8 },
+        { "R10W",  AsmRegister::R10W,   16 },
+        { "R10D",  AsmRegister::R10D,   32 },
+        { "R10",   AsmRegister::R10,    64 },
+        { "R11B",  AsmRegister::R11B,    8 },
+        { "R11W",  AsmRegister::R11W,   16 },
+        { "R11D",  AsmRegister::R11D,   32 },
+        { "R11",   AsmRegister::R11,    64 },
+        { "R12B",  AsmRegister::R12B,    8 },
+        { "R12W",  AsmRegister::R12W,   16 },
+        { "R12D",  AsmRegister::R12D,   32 },
+        { "R12",   AsmRegister::R12,    64 },
+        { "R13B",  AsmRegister::R13B,    8 },
+        { "R13W",  AsmRegister::R13W,   16 },
+        { "R13D",  AsmRegister::R13D,   32 },
+        { "R13",   AsmRegister::R13,    64 },
+        { "R14B",  AsmRegister::R14B,    8 },
+        { "R14W",  AsmRegister::R14W,   16 },
+        { "R14D",  AsmRegister::R14D,   32 },
+        { "R14",   AsmRegister::R14,    64 },
+        { "R15B",  AsmRegister::R15B,    8 },
+        { "R15W",  AsmRegister::R15W,   16 },
+        { "R15D",  AsmRegister::R15D,   32 },
+        { "R15",   AsmRegister::R15,    64 },
+        { "XMM0",  AsmRegister::XMM0,  128 },
+        { "XMM1",  AsmRegister::XMM1,  128 },
+        { "XMM2",  AsmRegister::XMM2,  128 },
+        { "XMM3",  AsmRegister::XMM3,  128 },
+        { "XMM4",  AsmRegister::XMM4,  128 },
+        { "XMM5",  AsmRegister::XMM5,  128 },
+        { "XMM6",  AsmRegister::XMM6,  128 },
+        { "XMM7",  AsmRegister::XMM7,  128 },
+        { "XMM8",  AsmRegister::XMM8,  128 },
+        { "XMM9",  AsmRegister::XMM9,  128 },
+        { "XMM10", AsmRegister::XMM10, 128 },
+        { "XMM11", AsmRegister::XMM11, 128 },
+        { "XMM12", AsmRegister::XMM12, 128 },
+        { "XMM13", AsmRegister::XMM13, 128 },
+        { "XMM14", AsmRegister::XMM14, 128 },
+        { "XMM15", AsmRegister::XMM15, 128 },
+        { "YMM0",  AsmRegister::YMM0,  256 },
+        { "YMM1",  AsmRegister::YMM1,  256 },
+        { "YMM2",  AsmRegister::YMM2,  256 },
+        { "YMM3",  AsmRegister::YMM3,  256 },
+        { "YMM4",  AsmRegister::YMM4,  256 },
+        { "YMM5",  AsmRegister::YMM5,  256 },
+        { "YMM6",  AsmRegister::YMM6,  256 },
+        { "YMM7",  AsmRegister::YMM7,  256 },
+        { "YMM8",  AsmRegister::YMM8,  256 },
+        { "YMM9",  AsmRegister::YMM9,  256 },
+        { "YMM10", AsmRegister::YMM10, 256 },
+        { "YMM11", AsmRegister::YMM11, 256 },
+        { "YMM12", AsmRegister::YMM12, 256 },
+        { "YMM13", AsmRegister::YMM13, 256 },
+        { "YMM14", AsmRegister::YMM14, 256 },
+        { "YMM15", AsmRegister::YMM15, 256 },
+        { "CS",    AsmRegister::CS,     -1 },
+        { "DS",    AsmRegister::DS,     -1 },
+        { "ES",    AsmRegister::ES,     -1 },
+        { "FS",    AsmRegister::FS,     -1 },
+        { "GS",    AsmRegister::GS,     -1 },
+        { "SS",    AsmRegister::SS,     -1 }
+    }};
+
+    std::sort(names.begin(), names.end(), [](const RegisterName& a, const RegisterName& b) {
+        return a.name < b.name;
+    });
+    return names;
+}();
+
+static_assert(
+    std::adjacent_find(REGISTER_NAMES.begin(), REGISTER_NAMES.end(), [](const RegisterName& a, const RegisterName& b) {
+        return a.name == b.name;
+    }) == REGISTER_NAMES.end() && !REGISTER_NAMES.front().name.empty(),
+    "A register is listed twice, or not at all, in REGISTER_NAMES"
+);
+
+// Returns nullptr if `name` is not a register
+constexpr const RegisterName* find_register(const std::string_view& name) {
+    const auto it = std::lower_bound(REGISTER_NAMES.begin(), REGISTER_NAMES.end(), name, [](const RegisterName& entry, const std::string_view& name) {
+        return entry.name < name;
+    });
+
+    return it != REGISTER_NAMES.end() && it->name == name ? &*it : nullptr;
+}
+
+// The same entries indexed by AsmRegister
+inline constexpr std::array<RegisterName, REGISTER_COUNT> REGISTERS_BY_ID = [] {
+    std::array<RegisterName, REGISTER_COUNT> table = {};
+    for (const RegisterName& entry : REGISTER_NAMES) {
+        table[(size_t)entry.reg] = entry;
+    }
+    return table;
+}();
+
+constexpr const RegisterName& register_info(AsmRegister reg) {
+    return REGISTERS_BY_ID[(size_t)reg];
+}
+
+struct RegisterEncoding {
+    AsmRegister reg;
+    uint8_t     encoding;
+};
+
+// Indexed by AsmRegister
+inline constexpr std::array<uint8_t, REGISTER_COUNT> REGISTER_ENCODINGS = [] {
+    constexpr RegisterEncoding ENCODINGS[] = {
+        { AsmRegister::AL, 0b0000 }, { AsmRegister::AX, 0b0000 }, { AsmRegister::EAX, 0b0000 }, { AsmRegister::RAX, 0b0000 },
+        { AsmRegister::CL, 0b0001 }, { AsmRegister::CX, 0b0001 }, { AsmRegister::ECX, 0b0001 }, { AsmRegister::RCX, 0b0001 },
+        { AsmRegister::DL, 0b0010 }, { AsmRegister::DX, 0b0010 }, { AsmRegister::EDX, 0b0010 }, { AsmRegister::RDX, 0b0010 },
+        { AsmRegister::BL, 0b0011 }, { AsmRegister::BX, 0b0011 }, { AsmRegister::EBX, 0b0011 }, { AsmRegister::RBX, 0b0011 },
+        { AsmRegister::SPL, 0b0100 | REG_REX_REQUIRED }, { AsmRegister::SP, 0b0100 }, { AsmRegister::ESP, 0b0100 }, { AsmRegister::RSP, 0b0100 },
+        { AsmRegister::BPL, 0b0101 | REG_REX_REQUIRED }, { AsmRegister::BP, 0b0101 }, { AsmRegister::EBP, 0b0101 }, { AsmRegister::RBP, 0b0101 },
+        { AsmRegister::SIL, 0b0110 | REG_REX_REQUIRED }, { AsmRegister::SI, 0b0110 }, { AsmRegister::ESI, 0b0110 }, { AsmRegister::RSI, 0b0110 },
+        { AsmRegister::DIL, 0b0111 | REG_REX_REQUIRED }, { AsmRegister::DI, 0b0111 }, { AsmRegister::EDI, 0b0111 }, { AsmRegister::RDI, 0b0111 },
+        { AsmRegister::AH, 0b0100 | REG_REX_FORBIDDEN },
+        { AsmRegister::CH, 0b0101 | REG_REX_FORBIDDEN },
+        { AsmRegister::DH, 0b0110 | REG_REX_FORBIDDEN },
+        { AsmRegister::BH, 0b0111 | REG_REX_FORBIDDEN },
+        { AsmRegister::R8B, 0b1000 }, { AsmRegister::R8W, 0b1000 }, { AsmRegister::R8D, 0b1000 }, { AsmRegister::R8, 0b1000 },
+        { AsmRegister::R9B, 0b1001 }, { AsmRegister::R9W, 0b1001 }, { AsmRegister::R9D, 0b1001 }, { AsmRegister::R9, 0b1001 },
+        { AsmRegister::R10B, 0b1010 }, { AsmRegister::R10W, 0b1010 }, { AsmRegister::R10D, 0b1010 }, { AsmRegister::R10, 0b1010 },
+        { AsmRegister::R11B, 0b1011 }, { AsmRegister::R11W, 0b1011 }, { AsmRegister::R11D, 0b1011 }, { AsmRegister::R11, 0b1011 },
+        { AsmRegister::R12B, 0b1100 }, { AsmRegister::R12W, 0b1100 }, { AsmRegister::R12D, 0b1100 }, { AsmRegister::R12, 0b1100 },
+        { AsmRegister::R13B, 0b1101 }, { AsmRegister::R13W, 0b1101 }, { AsmRegister::R13D, 0b1101 }, { AsmRegister::R13, 0b1101 },
+        { AsmRegister::R14B, 0b1110 }, { AsmRegister::R14W, 0b1110 }, { AsmRegister::R14D, 0b1110 }, { AsmRegister::R14, 0b1110 },
+        { AsmRegister::R15B, 0b1111 }, { AsmRegister::R15W, 0b1111 }, { AsmRegister::R15D, 0b1111 }, { AsmRegister::R15, 0b1111 },
+        { AsmRegister::XMM0, 0b0000 }, { AsmRegister::YMM0, 0b0000 },
+        { AsmRegister::XMM1, 0b0001 }, { AsmRegister::YMM1, 0b0001 },
+        { AsmRegister::XMM2, 0b0010 }, { AsmRegister::YMM2, 0b0010 },
+        { AsmRegister::XMM3, 0b0011 }, { AsmRegister::YMM3, 0b0011 },
+        { AsmRegister::XMM4, 0b0100 }, { AsmRegister::YMM4, 0b0100 },
+        { AsmRegister::XMM5, 0b0101 }, { AsmRegister::YMM5, 0b0101 },
+        { AsmRegister::XMM6, 0b0110 }, { AsmRegister::YMM6, 0b0110 },
+        { AsmRegister::XMM7, 0b0111 }, { AsmRegister::YMM7, 0b0111 },
+        { AsmRegister::XMM8, 0b1000 }, { AsmRegister::YMM8, 0b1000 },
+        { AsmRegister::XMM9, 0b1001 }, { AsmRegister::YMM9, 0b1001 },
+        { AsmRegister::XMM10, 0b1010 }, { AsmRegister::YMM10, 0b1010 },
+        { AsmRegister::XMM11, 0b1011 }, { AsmRegister::YMM11, 0b1011 },
+        { AsmRegister::XMM12, 0b1100 }, { AsmRegister::YMM12, 0b1100 },
+        { AsmRegister::XMM13, 0b1101 }, { AsmRegister::YMM13, 0b1101 },
+        { AsmRegister::XMM14, 0b1110 }, { AsmRegister::YMM14, 0b1110 },
+        { AsmRegister::XMM15, 0b1111 }, { AsmRegister::YMM15, 0b1111 },
+        { AsmRegister::ES, 0b0000 },
+        { AsmRegister::CS, 0b0001 },
+        { AsmRegister::SS, 0b0010 },
+        { AsmRegister::DS, 0b0011 },
+        { AsmRegister::FS, 0b0100 },
+        { AsmRegister::GS, 0b0101 }
+    };
+    static_assert(std::size(ENCODINGS) == REGISTER_COUNT, "Every register needs exactly one encoding");
+
+    std::array<uint8_t, REGISTER_COUNT> table = {};
+    for (const auto& [reg, encoding] : ENCODINGS) {
+        table[(size_t)reg] = encoding;
+    }
+    return table;
+}();
+
+constexpr uint8_t register_encoding(AsmRegister reg) {
+    return REGISTER_ENCODINGS[(size_t)reg];
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+#include "context.hpp"
+
+// Assembles the lines of `input` one at a time in the same context, the bits mode, pending prefixes and preprocessor
+// state carry over. Every line is answered with exactly one line on `output`, flushed right away:
+//
+//     <offset> <size> <form> [<byte> ...]
+//
+// The offset and the bytes are in hex, the size in decimal. The form names the encoders that emitted the bytes, joined
+// with `+` in StatsFormat order when a macro expands to several instructions. It is `-` for data, padding and lines
+// without bytes, and `error` for failed lines.
+// Errors and warnings go to ctx.diagnostics before the answer and do not end the session.
+// Returns false if the input ends inside a %MACRO, %REP or %IF block, or after a lone prefix.
+bool run_repl(Context& ctx, std::istream& input, std::ostream& output);
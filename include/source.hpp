@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_io.hpp"
+
+struct RunStats;
+
+struct SourceLine {
+    std::string_view    raw;            // trimmed line, original case (points into the mapped file)
+    std::string_view    normalized;     // trimmed, upper-cased line (points into SourceFile::normalized)
+    size_t              line_no;
+};
+
+struct SourceFile {
+    std::string             path;
+    const char*             data;
+    size_t                  size;
+    std::string             fallback;   // file contents when the file is read instead of mapped, or the source is in memory
+    std::string             normalized;
+    std::vector<SourceLine> lines;      // non-blank lines only
+
+    SourceFile() = default;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    ~SourceFile();
+};
+
+// Every file is mapped and split into normalized lines once per run, no matter how often it is included
+struct SourceCache {
+    std::unordered_map<std::string, std::unique_ptr<SourceFile>>    files;
+    std::vector<const SourceFile*>                                  load_order;
+    IOBackend                                                       io_backend = IOBackend::DEFAULT;
+};
+
+const SourceFile* load_source(SourceCache& cache, const std::string& path, RunStats* stats = nullptr);
+const SourceFile* add_source(SourceCache& cache, const std::string& path, const std::string_view& contents, RunStats* stats = nullptr);
+// Trims and upper-cases a line that is not part of a file, the returned line points into `line` and `normalized`
+SourceLine normalize_line(const std::string_view& line, size_t line_no, std::string& normalized);
+bool write_dependency_file(const SourceCache& cache, const std::string& dep_path, const std::string& target);
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "context.hpp"
+#include "encoding.hpp"
+
+// Phases are exclusive, a nested phase's time is taken out of the phase it interrupted
+enum StatsPhase {
+    PHASE_READ,
+    PHASE_NORMALIZE,
+    PHASE_LEX,          // expect_arguments, without the memory operands
+    PHASE_MEMORY,       // parse_memory and make_modrm_sib
+    PHASE_ENCODE,       // everything else done for a line: preprocessing, dispatch and encoding
+    PHASE_WRITE,
+
+    PHASE_COUNT,
+    PHASE_NONE = PHASE_COUNT
+};
+
+enum StatsFormat {
+    FORMAT_I,
+    FORMAT_RI,
+    FORMAT_MI,
+    FORMAT_RR,
+    FORMAT_MR,
+    FORMAT_ZO,
+    FORMAT_SSE,
+    FORMAT_VEX,
+
+    FORMAT_COUNT
+};
+
+constexpr std::string_view FORMAT_NAMES[FORMAT_COUNT] = {
+    "I", "RI", "MI", "RR", "MR", "ZO", "SSE", "VEX"
+};
+
+struct EmitCount {
+    uint64_t    count;
+    uint64_t    bytes;
+};
+
+struct SlowLine {
+    uint64_t    ticks;
+    std::string path;
+    size_t      line_no;
+    std::string text;
+};
+
+constexpr size_t STATS_SLOWEST_LINES = 10;
+
+// Lines are only timed, and their phases broken down, for one line out of STATS_SAMPLE_INTERVAL: a tick read costs
+// as much as lexing a short line. The report scales the sampled lines up to all of them, and the slowest lines are
+// the slowest of the sampled ones.
+constexpr uint64_t STATS_SAMPLE_INTERVAL = 16;
+
+struct RunStats {
+    // The extra slot absorbs the PHASE_NONE bookkeeping
+    uint64_t                phase_ticks[PHASE_COUNT + 1];   // outside of lines: reading, normalization, writing
+    uint64_t                sampled_ticks[PHASE_COUNT + 1]; // inside of the sampled lines
+    uint64_t*               scope_ticks;                    // the array scopes are charged to
+    StatsPhase              current_phase;
+    bool                    sampling;                       // phase scopes are active, always true outside of lines
+
+    uint64_t                lines;
+    uint64_t                sampled_lines;
+    uint64_t                line_start;                     // start of the current line, when it is sampled
+
+    std::vector<EmitCount>  mnemonics;                      // indexed like INSTRUCTION_NAMES
+    EmitCount               formats[FORMAT_COUNT];
+    std::vector<SlowLine>   slowest;                        // min-heap on `ticks`
+
+    // Tick to nanosecond calibration, taken when the run starts and when the report is printed
+    uint64_t                start_ticks;
+    std::chrono::steady_clock::time_point start_time;
+};
+
+// Time stamp counter where there is one, the steady clock elsewhere
+inline uint64_t stats_ticks() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Charges the time spent in its scope to `phase`, does nothing when stats are disabled or the line is not sampled.
+// The scopes are constexpr so the encoders keep them in constant evaluation, where there are never any stats.
+struct StatsScope {
+    RunStats*   stats;
+    StatsPhase  phase;
+    StatsPhase  parent;
+    uint64_t    start;
+
+    constexpr StatsScope(RunStats* stats, StatsPhase phase) :
+        stats(stats),
+        phase(phase),
+        parent(PHASE_NONE),
+        start(0)
+    {
+        if (stats != nullptr && stats->sampling) {
+            parent = stats->current_phase;
+            stats->current_phase = phase;
+            start = stats_ticks();
+        }
+    }
+
+    constexpr ~StatsScope() {
+        if (stats != nullptr && stats->sampling) {
+            const uint64_t elapsed = stats_ticks() - start;
+            stats->scope_ticks[phase] += elapsed;
+            stats->scope_ticks[parent] -= elapsed;
+            stats->current_phase = parent;
+        }
+    }
+
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+};
+
+// Counts the bytes an encoder added to `ins` in its scope, encoders that bail out add none and are not counted
+struct FormatScope {
+    RunStats*                   stats;
+    const EncodedInstruction&   ins;
+    StatsFormat                 format;
+    uint8_t                     start_length;
+
+    constexpr FormatScope(Context& ctx, const EncodedInstruction& ins, StatsFormat format) :
+        stats(ctx.stats),
+        ins(ins),
+        format(format),
+        start_length(ins.length)
+    {}
+
+    constexpr ~FormatScope() {
+        if (stats != nullptr && ins.length != start_length) {
+            stats->formats[format].count += 1;
+            stats->formats[format].bytes += ins.length - start_length;
+        }
+    }
+
+    FormatScope(const FormatScope&) = delete;
+    FormatScope& operator=(const FormatScope&) = delete;
+};
+
+void init_run_stats(RunStats& stats);
+void record_line_time(RunStats& stats, uint64_t ticks, const std::string& path, size_t line_no, const std::string_view& text);
+void print_run_stats(const RunStats& stats, std::ostream& out);
+
+// `mnemonic` is the index of the instruction in INSTRUCTION_NAMES
+inline void record_instruction(RunStats& stats, size_t mnemonic, uint64_t bytes) {
+    stats.mnemonics[mnemonic].count += 1;
+    stats.mnemonics[mnemonic].bytes += bytes;
+}
+
+inline void begin_line_stats(RunStats* stats) {
+    if (stats != nullptr) {
+        stats->sampling = stats->lines++ % STATS_SAMPLE_INTERVAL == 0;
+        if (stats->sampling) {
+            stats->scope_ticks = stats->sampled_ticks;
+            stats->line_start = stats_ticks();
+        }
+    }
+}
+
+inline void end_line_stats(RunStats* stats, const std::string& path, size_t line_no, const std::string_view& text) {
+    if (stats != nullptr) {
+        if (stats->sampling) {
+            const uint64_t elapsed = stats_ticks() - stats->line_start;
+            stats->sampled_lines += 1;
+            stats->scope_ticks = stats->phase_ticks;
+
+            if (stats->slowest.size() < STATS_SLOWEST_LINES || elapsed > stats->slowest.front().ticks) {
+                record_line_time(*stats, elapsed, path, line_no, text);
+            }
+        }
+
+        stats->sampling = true;
+    }
+}
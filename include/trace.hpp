@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// Scoped trace points, compiled in by configuring with -DAUDASM_TRACE=ON and compiled to nothing otherwise.
+// Each thread records into its own ring buffer, the buffers are written as Chrome trace-event JSON at exit to
+// the file named by AUDASM_TRACE_FILE, or audasm_trace.json. The trace opens in chrome://tracing and Perfetto.
+#if defined(AUDASM_TRACE)
+
+constexpr int64_t TRACE_NO_LINE = -1;
+
+struct TraceEvent {
+    const char* name;           // a string literal, only the pointer is recorded
+    uint64_t    start_ns;
+    uint64_t    duration_ns;
+    int64_t     line_no;        // TRACE_NO_LINE if the event is not tied to a source line
+};
+
+uint64_t trace_now();
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t line_no);
+
+struct TraceScope {
+    const char* name;
+    int64_t     line_no;
+    uint64_t    start_ns;
+
+    // Scopes in the encoders are also entered in constant evaluation, where they record nothing
+    constexpr explicit TraceScope(const char* name, int64_t line_no = TRACE_NO_LINE) :
+        name(name),
+        line_no(line_no),
+        start_ns(0)
+    {
+        if !consteval {
+            start_ns = trace_now();
+        }
+    }
+
+    constexpr ~TraceScope() {
+        if !consteval {
+            trace_record(name, start_ns, trace_now(), line_no);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_LINE(name, line_no) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, (int64_t)(line_no))
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_LINE(name, line_no) ((void)0)
+
+#endif
@@ -0,0 +1,350 @@
+#include "alloc_stats.hpp"
+
+#if defined(AUDASM_ALLOC_STATS)
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <malloc.h>
+
+namespace {
+    constexpr int ALLOC_STACK_DEPTH = 8;        // frames kept per allocation, the first ones are usually allocator internals
+    constexpr int ALLOC_SKIPPED_FRAMES = 2;     // allocate() and the operator itself
+    constexpr size_t ALLOC_STACK_SLOTS = 1 << 12;
+    constexpr size_t ALLOC_TOP_SITES = 15;
+
+    struct AllocStack {
+        void*       frames[ALLOC_STACK_DEPTH];
+        int         depth;
+        uint64_t    count;
+        uint64_t    bytes;
+    };
+
+    // Updated from inside operator new, nothing here may allocate. Sizes are the usable sizes of the blocks,
+    // which is what the heap actually hands out.
+    struct AllocCounters {
+        std::atomic<bool>       enabled;
+        std::atomic<uint64_t>   allocations;
+        std::atomic<uint64_t>   frees;
+        std::atomic<uint64_t>   bytes;
+        std::atomic<int64_t>    live_bytes;
+        std::atomic<int64_t>    peak_live_bytes;
+        std::atomic<uint64_t>   unattributed;   // allocations whose stack did not fit in the table
+
+        std::atomic_flag        stacks_lock;
+        AllocStack              stacks[ALLOC_STACK_SLOTS];
+    };
+
+    AllocCounters counters;
+
+    // Set while an allocation is being recorded, backtrace() may allocate the first time it runs
+    thread_local bool in_hook = false;
+
+    static size_t hash_stack(void* const* frames, int depth) {
+        size_t h = 14695981039346656037ull;
+        for (int i = 0; i < depth; ++i) {
+            h = (h ^ (size_t)frames[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static void record_stack(void* const* frames, int depth, uint64_t size) {
+        while (counters.stacks_lock.test_and_set(std::memory_order_acquire)) {}
+
+        const size_t h = hash_stack(frames, depth);
+        bool recorded = false;
+
+        for (size_t probe = 0; probe < ALLOC_STACK_SLOTS; ++probe) {
+            AllocStack& stack = counters.stacks[(h + probe) % ALLOC_STACK_SLOTS];
+
+            if (stack.count == 0) {
+                std::copy(frames, frames + depth, stack.frames);
+                stack.depth = depth;
+            }
+            else if (stack.depth != depth || !std::equal(frames, frames + depth, stack.frames)) {
+                continue;
+            }
+
+            stack.count += 1;
+            stack.bytes += size;
+            recorded = true;
+            break;
+        }
+
+        counters.stacks_lock.clear(std::memory_order_release);
+
+        if (!recorded) {
+            counters.unattributed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void record_allocation(void* p) {
+        const uint64_t size = malloc_usable_size(p);
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(size, std::memory_order_relaxed);
+
+        const int64_t live = counters.live_bytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+        int64_t peak = counters.peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !counters.peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+
+        void* frames[ALLOC_STACK_DEPTH + ALLOC_SKIPPED_FRAMES];
+        const int depth = backtrace(frames, (int)std::size(frames));
+        if (depth > ALLOC_SKIPPED_FRAMES) {
+            record_stack(frames + ALLOC_SKIPPED_FRAMES, depth - ALLOC_SKIPPED_FRAMES, size);
+        }
+        else {
+            counters.unattributed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Kept out of line so the frames to skip are always allocate() and the operator
+    [[gnu::noinline]] static void* allocate(size_t size, size_t alignment, bool nothrow) {
+        if (size == 0) {
+            size = 1;
+        }
+
+        for (;;) {
+            void* p = nullptr;
+            if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+                p = std::malloc(size);
+            }
+            else if (posix_memalign(&p, alignment, size) != 0) {
+                p = nullptr;
+            }
+
+            if (p != nullptr) {
+                if (counters.enabled.load(std::memory_order_relaxed) && !in_hook) {
+                    in_hook = true;
+                    record_allocation(p);
+                    in_hook = false;
+                }
+                return p;
+            }
+
+            std::new_handler handler = std::get_new_handler();
+            if (handler == nullptr) {
+                if (nothrow) {
+                    return nullptr;
+                }
+                throw std::bad_alloc();
+            }
+
+            if (nothrow) {
+                try {
+                    handler();
+                }
+                catch (const std::bad_alloc&) {
+                    return nullptr;
+                }
+            }
+            else {
+                handler();
+            }
+        }
+    }
+
+    static void release(void* p) {
+        if (p == nullptr) {
+            return;
+        }
+
+        if (counters.enabled.load(std::memory_order_relaxed)) {
+            const uint64_t size = malloc_usable_size(p);
+            counters.frees.fetch_add(1, std::memory_order_relaxed);
+            counters.live_bytes.fetch_sub((int64_t)size, std::memory_order_relaxed);
+        }
+        std::free(p);
+    }
+
+    // Allocator internals (the operators, std:: containers and strings) are skipped to find the code that asked
+    static bool is_allocator_frame(const std::string_view& name) {
+        const std::string_view qualified = name.substr(0, name.find('('));
+        return qualified.starts_with("operator new")
+            || qualified.find("std::") != std::string_view::npos
+            || qualified.find("__gnu_cxx::") != std::string_view::npos;
+    }
+
+    // Functions without a dynamic symbol (static ones, or the executable without -rdynamic) are shown as an offset
+    // into their module, `addr2line -f -C -e <module> <offset>` resolves them
+    static std::string describe_frame(void* frame, bool& allocator_frame) {
+        // Return addresses point past the call, step back into it
+        const uintptr_t address = (uintptr_t)frame - 1;
+        allocator_frame = false;
+
+        Dl_info info;
+        if (dladdr((void*)address, &info) == 0) {
+            return std::format("{:#x}", address);
+        }
+
+        if (info.dli_sname != nullptr) {
+            int status;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            std::string name = status == 0 ? demangled : info.dli_sname;
+            std::free(demangled);
+
+            allocator_frame = is_allocator_frame(name);
+            return name.substr(0, name.find('('));
+        }
+
+        std::string_view module = info.dli_fname != nullptr ? info.dli_fname : "?";
+        allocator_frame = module.find("libstdc++") != std::string_view::npos;
+        module = module.substr(module.find_last_of('/') + 1);
+        return std::format("{}+{:#x}", module, address - (uintptr_t)info.dli_fbase);
+    }
+
+    static std::string describe_site(const AllocStack& stack) {
+        std::string innermost;
+        for (int i = 0; i < stack.depth; ++i) {
+            bool allocator_frame;
+            std::string frame = describe_frame(stack.frames[i], allocator_frame);
+            if (!allocator_frame) {
+                return frame;
+            }
+
+            if (innermost.empty()) {
+                innermost = std::move(frame);
+            }
+        }
+
+        // The whole captured stack is allocator code, show where it starts
+        return innermost.empty() ? "?" : innermost;
+    }
+}
+
+bool alloc_stats_available() {
+    return true;
+}
+
+void start_alloc_stats() {
+    counters.enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop_alloc_stats() {
+    counters.enabled.store(false, std::memory_order_relaxed);
+}
+
+void print_alloc_stats(uint64_t lines) {
+    stop_alloc_stats();
+
+    struct SiteCount {
+        uint64_t    count;
+        uint64_t    bytes;
+    };
+
+    std::unordered_map<std::string, SiteCount> sites;
+    for (const AllocStack& stack : counters.stacks) {
+        if (stack.count != 0) {
+            SiteCount& site = sites[describe_site(stack)];
+            site.count += stack.count;
+            site.bytes += stack.bytes;
+        }
+    }
+
+    std::vector<std::pair<std::string, SiteCount>> sorted(sites.begin(), sites.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.count != b.second.count ? a.second.count > b.second.count : a.first < b.first;
+    });
+
+    const uint64_t allocations = counters.allocations.load(std::memory_order_relaxed);
+
+    std::cout << "Allocation statistics:" << std::endl;
+    std::cout << std::format("  {:<24} {:>14}", "allocations", allocations) << std::endl;
+    std::cout << std::format("  {:<24} {:>14}", "frees", counters.frees.load(std::memory_order_relaxed)) << std::endl;
+    std::cout << std::format("  {:<24} {:>14}", "bytes allocated", counters.bytes.load(std::memory_order_relaxed)) << std::endl;
+    std::cout << std::format("  {:<24} {:>14}", "peak live bytes", counters.peak_live_bytes.load(std::memory_order_relaxed)) << std::endl;
+    std::cout << std::format(
+        "  {:<24} {:>14.2f} ({} source lines)",
+        "allocations per line",
+        lines != 0 ? (double)allocations / lines : 0.0,
+        lines
+    ) << std::endl;
+
+    const uint64_t unattributed = counters.unattributed.load(std::memory_order_relaxed);
+    if (unattributed != 0) {
+        std::cout << std::format("  {:<24} {:>14}", "unattributed", unattributed) << std::endl;
+    }
+
+    std::cout << "Top allocation sites:" << std::endl;
+    for (size_t i = 0; i < sorted.size() && i < ALLOC_TOP_SITES; ++i) {
+        const auto& [site, counted] = sorted[i];
+        std::cout << std::format(
+            "  {:>10} allocations {:>12} bytes {:>8.2f}/line  {}",
+            counted.count,
+            counted.bytes,
+            lines != 0 ? (double)counted.count / lines : 0.0,
+            site
+        ) << std::endl;
+    }
+}
+
+void* operator new(size_t size) {
+    return allocate(size, 0, false);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size, 0, false);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, 0, true);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, 0, true);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocate(size, (size_t)alignment, false);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocate(size, (size_t)alignment, false);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, (size_t)alignment, true);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, (size_t)alignment, true);
+}
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+
+#else
+
+bool alloc_stats_available() {
+    return false;
+}
+
+void start_alloc_stats() {}
+void stop_alloc_stats() {}
+void print_alloc_stats(uint64_t) {}
+
+#endif
@@ -0,0 +1,178 @@
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "assembler.hpp"
+#include "context.hpp"
+#include "preprocessor.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+namespace {
+    static void assemble_source(
+        Context& ctx,
+        SourceCache& cache,
+        Preprocessor& pp,
+        const SourceFile& file,
+        std::vector<const SourceFile*>& include_stack
+    );
+
+    static void assemble_include(
+        Context& ctx,
+        SourceCache& cache,
+        Preprocessor& pp,
+        const SourceFile& includer,
+        const SourceLine& line,
+        std::vector<const SourceFile*>& include_stack
+    ) {
+        TRACE_SCOPE_LINE("assemble_include", line.line_no);
+
+        // The file name is taken from the raw line, upper-casing it would break case-sensitive file systems
+        constexpr size_t prefix_length = 8;
+        const std::string_view arg = trim_string(line.raw.substr(prefix_length));
+
+        const size_t closing_pos = arg.empty() ? std::string_view::npos : arg.find(arg.front(), 1);
+        const std::string_view trailing = closing_pos != std::string_view::npos ? trim_string(arg.substr(closing_pos + 1)) : "";
+
+        if (
+            closing_pos == std::string_view::npos
+            || (arg.front() != '"' && arg.front() != '\'')
+            || (!trailing.empty() && !trailing.starts_with(";"))
+        ) {
+            diagnose(ctx,
+                "Error on line {}: Expected a quoted file name after `%INCLUDE`, found `{}`",
+                ctx.line_no,
+                arg
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        std::filesystem::path included = arg.substr(1, closing_pos - 1);
+        if (included.is_relative()) {
+            std::filesystem::path sibling = std::filesystem::path(includer.path).parent_path() / included;
+            if (std::filesystem::exists(sibling)) {
+                included = std::move(sibling);
+            }
+        }
+
+        const SourceFile* file = load_source(cache, included.string(), ctx.stats);
+        if (file == nullptr) {
+            diagnose(ctx,
+                "Error on line {}: Could not open included file `{}`",
+                ctx.line_no,
+                included.string()
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        if (std::find(include_stack.cbegin(), include_stack.cend(), file) != include_stack.cend()) {
+            diagnose(ctx,
+                "Error on line {}: Recursive inclusion of `{}`",
+                ctx.line_no,
+                file->path
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        const size_t include_line_no = ctx.line_no;
+        const bool had_error = ctx.on_error;
+
+        include_stack.push_back(file);
+        assemble_source(ctx, cache, pp, *file, include_stack);
+        include_stack.pop_back();
+
+        ctx.line_no = include_line_no;
+        if (ctx.on_error && !had_error) {
+            diagnose(ctx,
+                "Note: in file `{}` included from `{}` on line {}",
+                file->path,
+                includer.path,
+                include_line_no
+            );
+        }
+    }
+
+    static void assemble_source(
+        Context& ctx,
+        SourceCache& cache,
+        Preprocessor& pp,
+        const SourceFile& file,
+        std::vector<const SourceFile*>& include_stack
+    ) {
+        for (size_t i = 0; i < file.lines.size(); ++i) {
+            const SourceLine& line = file.lines[i];
+            ctx.line_no = line.line_no;
+
+            if (line.normalized.starts_with("%INCLUDE ") && preprocessor_passes_through(pp)) {
+                assemble_include(ctx, cache, pp, file, line, include_stack);
+            }
+            else {
+                begin_line_stats(ctx.stats);
+                {
+                    StatsScope scope(ctx.stats, PHASE_ENCODE);
+                    preprocess_line(ctx, pp, line.normalized, assemble_line);
+                }
+                end_line_stats(ctx.stats, file.path, line.line_no, line.raw);
+            }
+
+            if (ctx.output_buffer.size() >= OUTPUT_FLUSH_THRESHOLD) {
+                flush_output(ctx);
+            }
+
+            // Lines of a false conditional branch are never lexed, jump straight to the next directive
+            if (preprocessor_is_skipping(pp)) {
+                i = skip_to_next_directive(file, i + 1) - 1;
+            }
+        }
+    }
+
+    static void finish_input(Context& ctx, const Preprocessor& pp) {
+        finish_preprocessing(ctx, pp);
+
+        if (ctx.contextual_prefixes != PREFIX_NONE) {
+            diagnose(ctx, "Error: Prefix at the end of the input is not followed by an instruction");
+            ctx.on_error = true;
+        }
+    }
+}
+
+
+void assemble_input(Context& ctx, SourceCache& cache, const SourceFile& input) {
+    Preprocessor pp = {};
+    std::vector<const SourceFile*> include_stack = { &input };
+    assemble_source(ctx, cache, pp, input, include_stack);
+    finish_input(ctx, pp);
+    flush_output(ctx);
+}
+
+void begin_line_session(LineSession& session, const std::string& name) {
+    session.pp = {};
+    session.input = add_source(session.cache, name, "");
+}
+
+void assemble_session_line(Context& ctx, LineSession& session, const SourceLine& line) {
+    ctx.line_no = line.line_no;
+
+    if (line.normalized.starts_with("%INCLUDE ") && preprocessor_passes_through(session.pp)) {
+        std::vector<const SourceFile*> include_stack = { session.input };
+        assemble_include(ctx, session.cache, session.pp, *session.input, line, include_stack);
+    }
+    else {
+        StatsScope scope(ctx.stats, PHASE_ENCODE);
+        preprocess_line(ctx, session.pp, line.normalized, assemble_line);
+    }
+}
+
+void end_line_session(Context& ctx, LineSession& session) {
+    finish_input(ctx, session.pp);
+}
@@ -0,0 +1,33 @@
+#include <sstream>
+#include <string_view>
+#include <utility>
+
+#include "assembler.hpp"
+#include "audasm.hpp"
+#include "context.hpp"
+#include "source.hpp"
+
+namespace audasm {
+    Result assemble(std::string_view source, const Options& options) {
+        std::ostringstream diagnostics;
+        Context ctx = {
+            .b_mode         = options.b_mode,
+            .line_no        = 1,
+            .output_file    = nullptr,
+            .diagnostics    = &diagnostics,
+            .on_error       = false,
+            .optimize       = options.optimize
+        };
+
+        SourceCache sources;
+        const SourceFile* input_file = add_source(sources, options.source_name, source);
+        assemble_input(ctx, sources, *input_file);
+
+        return Result {
+            .success        = !ctx.on_error,
+            .bytes          = std::move(ctx.output_buffer),
+            .diagnostics    = std::move(diagnostics).str(),
+            .peephole_stats = ctx.peephole_stats
+        };
+    }
+}
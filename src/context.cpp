@@ -1,33 +1,22 @@
-#include <charconv>
-#include <format>
-#include <iostream>
-#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
 
 #include "context.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
-void change_bits_mode(Context& ctx, const std::string_view& s) {
-    unsigned int bits;
-    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), bits);
+void write_output(Context& ctx, const uint8_t* data, size_t n) {
+    TRACE_SCOPE("write_output");
+    StatsScope scope(ctx.stats, PHASE_WRITE);
+    ctx.output_file->write((const char*)data, n);
+}
 
-    if (ec == std::errc{} && ptr == s.data() + s.size()) {
-        if (bits == 16) {
-            ctx.b_mode = BitsMode::M16;
-            return;
-        }
-        else if (bits == 32) {
-            ctx.b_mode = BitsMode::M32;
-            return;
-        }
-        else if (bits == 64) {
-            ctx.b_mode = BitsMode::M64;
-            return;
-        }
+void flush_output(Context& ctx) {
+    if (ctx.output_file == nullptr) {
+        return;
     }
 
-    std::cerr << std::format(
-        "Error on line {}: Invalid mode '{}' for BITS directive (accepted widths are 16, 32 and 64)",
-        ctx.line_no,
-        s
-    ) << std::endl;
-    ctx.on_error = true;
+    write_output(ctx, ctx.output_buffer.data(), ctx.output_buffer.size());
+    ctx.output_buffer.clear();
 }
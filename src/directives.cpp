@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "argument.hpp"
+#include "context.hpp"
+#include "directives.hpp"
+#include "parsing_utils.hpp"
+
+namespace {
+    constexpr size_t MAX_NOP_LENGTH = 15;
+    constexpr size_t PADDING_CHUNK  = MAX_NOP_LENGTH * 273;
+
+    using NopTable = std::array<std::array<uint8_t, MAX_NOP_LENGTH>, MAX_NOP_LENGTH + 1>;
+
+    // Recommended multi-byte NOP sequences, indexed by length ; the 0F 1F /0 forms use a 32-bit ModRM/SIB
+    constexpr NopTable NOPS_32 = {{
+        {},
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x66, 0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x66, 0x66, 0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 }
+    }};
+
+    // 16-bit ModRM has no SIB byte: short forms address [BX+SI], longer ones reuse the 32-bit forms behind 0x67
+    constexpr NopTable make_nops_16() {
+        NopTable table = {{
+            {},
+            { 0x90 },
+            { 0x66, 0x90 },
+            { 0x0F, 0x1F, 0x00 },
+            { 0x0F, 0x1F, 0x40, 0x00 },
+            { 0x0F, 0x1F, 0x80, 0x00, 0x00 }
+        }};
+
+        for (size_t n = 6; n <= MAX_NOP_LENGTH; ++n) {
+            table[n][0] = 0x67;
+            for (size_t i = 0; i < n - 1; ++i) {
+                table[n][i + 1] = NOPS_32[n - 1][i];
+            }
+        }
+
+        return table;
+    }
+
+    constexpr NopTable NOPS_16 = make_nops_16();
+
+    // A run of back-to-back 15-byte NOPs, so that large paddings are emitted in a handful of writes
+    constexpr std::array<uint8_t, PADDING_CHUNK> make_nop_chunk(const NopTable& table) {
+        std::array<uint8_t, PADDING_CHUNK> chunk = {};
+        for (size_t i = 0; i < PADDING_CHUNK; ++i) {
+            chunk[i] = table[MAX_NOP_LENGTH][i % MAX_NOP_LENGTH];
+        }
+        return chunk;
+    }
+
+    constexpr std::array<uint8_t, PADDING_CHUNK> NOP_CHUNK_16 = make_nop_chunk(NOPS_16);
+    constexpr std::array<uint8_t, PADDING_CHUNK> NOP_CHUNK_32 = make_nop_chunk(NOPS_32);
+
+    // Replicated items are grown in the output buffer up to this size, then streamed block by block
+    constexpr size_t REPLICATION_BLOCK = 1 << 20;
+
+    // Bound on the bytes of one `TIMES` line, past the size of any flat binary and well within a 64-bit offset
+    constexpr uint64_t MAX_REPLICATED_SIZE = (uint64_t)1 << 32;
+
+    constexpr uint8_t NOT_A_DIGIT = 0xFF;
+
+    constexpr std::array<uint8_t, 256> make_digit_values() {
+        std::array<uint8_t, 256> table = {};
+        for (size_t c = 0; c < table.size(); ++c) {
+            table[c] =
+                (c >= '0' && c <= '9') ? (uint8_t)(c - '0') :
+                (c >= 'A' && c <= 'F') ? (uint8_t)(c - 'A' + 10) :
+                NOT_A_DIGIT;
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> DIGIT_VALUES = make_digit_values();
+
+    static inline const char* skip_blanks(const char* p, const char* end) {
+        while (p != end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        return p;
+    }
+
+    // Parses one `[-](0X|0O|0B)?digits` literal, leaves `p` on the first character after it
+    static bool scan_literal(const char*& p, const char* end, uint64_t& res) {
+        bool negative = false;
+        if (p != end && *p == '-') {
+            negative = true;
+            ++p;
+        }
+
+        uint64_t base = 10;
+        if (end - p > 2 && p[0] == '0') {
+            switch (p[1]) {
+                case 'X': base = 16; p += 2; break;
+                case 'O': base =  8; p += 2; break;
+                case 'B': base =  2; p += 2; break;
+                default: break;
+            }
+        }
+
+        const char* digits = p;
+        uint64_t value = 0;
+        bool overflow = false;
+
+        for (; p != end; ++p) {
+            const uint64_t d = DIGIT_VALUES[(uint8_t)*p];
+            if (d >= base) {
+                break;
+            }
+
+            overflow |= value > (std::numeric_limits<uint64_t>::max() - d) / base;
+            value = value * base + d;
+        }
+
+        if (p == digits || overflow || (negative && value > (uint64_t)std::numeric_limits<int64_t>::max() + 1)) {
+            return false;
+        }
+
+        res = negative ? 0 - value : value;
+        return true;
+    }
+
+    static bool fits_data_width(uint64_t value, size_t width) {
+        switch (width) {
+            case 1: return test_number<int8_t>(value);
+            case 2: return test_number<int16_t>(value);
+            case 4: return test_number<int32_t>(value);
+            default: return true;
+        }
+    }
+
+    static void emit_fill_padding(Context& ctx, size_t n, uint8_t fill) {
+        uint8_t buffer[PADDING_CHUNK];
+        std::memset(buffer, fill, std::min(n, PADDING_CHUNK));
+
+        while (n > 0) {
+            const size_t len = std::min(n, PADDING_CHUNK);
+            emit_bytes(ctx, buffer, len);
+            n -= len;
+        }
+    }
+}
+
+void emit_nop_padding(Context& ctx, size_t n) {
+    const bool legacy_16 = ctx.b_mode == BitsMode::M16;
+    const NopTable& table = legacy_16 ? NOPS_16 : NOPS_32;
+    const auto& chunk = legacy_16 ? NOP_CHUNK_16 : NOP_CHUNK_32;
+
+    while (n >= PADDING_CHUNK) {
+        emit_bytes(ctx, chunk.data(), PADDING_CHUNK);
+        n -= PADDING_CHUNK;
+    }
+
+    const size_t full = n - n % MAX_NOP_LENGTH;
+    emit_bytes(ctx, chunk.data(), full);
+    emit_bytes(ctx, table[n - full].data(), n - full);
+}
+
+void assemble_align(Context& ctx, const std::string_view& args) {
+    std::vector<AsmArg> parsed_args = expect_arguments(ctx, args, 1);
+    if (parsed_args.empty() && !ctx.on_error) {
+        parsed_args = expect_arguments(ctx, args, 2);
+    }
+
+    if (parsed_args.empty() || ctx.on_error) {
+        diagnose(ctx,
+            "Error on line {}: Invalid arguments for `ALIGN`: `{}`, expected `ALIGN boundary [, fill]`",
+            ctx.line_no,
+            args
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    if (parsed_args[0].type != AsmArgType::IMMEDIATE) {
+        diagnose(ctx,
+            "Error on line {}: `ALIGN` boundary must be an immediate value",
+            ctx.line_no
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    const uint64_t boundary = parsed_args[0].imm;
+    if (boundary == 0 || (boundary & (boundary - 1)) != 0) {
+        diagnose(ctx,
+            "Error on line {}: `ALIGN` boundary `{}` is not a power of two",
+            ctx.line_no,
+            boundary
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    const size_t padding = (size_t)((0 - ctx.offset) & (boundary - 1));
+
+    if (parsed_args.size() == 2) {
+        if (parsed_args[1].type != AsmArgType::IMMEDIATE || !test_number<int8_t>(parsed_args[1].imm)) {
+            diagnose(ctx,
+                "Error on line {}: `ALIGN` fill value must be an 8-bit immediate",
+                ctx.line_no
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        emit_fill_padding(ctx, padding, (uint8_t)parsed_args[1].imm);
+    }
+    else {
+        emit_nop_padding(ctx, padding);
+    }
+}
+
+void assemble_data(Context& ctx, const std::string_view& directive, size_t width, const std::string_view& args) {
+    std::vector<uint8_t>& out = ctx.output_buffer;
+    const size_t start = out.size();
+
+    const char* p = args.data();
+    const char* const end = p + args.size();
+
+    // Every item takes at least one digit and one separator
+    out.reserve(start + (args.size() / 2 + 1) * width);
+
+    while (true) {
+        p = skip_blanks(p, end);
+        const char* item = p;
+
+        uint64_t value;
+        if (!scan_literal(p, end, value)) {
+            const char* item_end = item;
+            while (item_end != end && *item_end != ',' && *item_end != ';') {
+                ++item_end;
+            }
+
+            const std::string_view literal = trim_string(std::string_view(item, item_end - item));
+            if (literal.empty()) {
+                diagnose(ctx,
+                    "Error on line {}: Missing item in `{}` list",
+                    ctx.line_no,
+                    directive
+                );
+            }
+            else {
+                diagnose(ctx,
+                    "Error on line {}: Invalid literal `{}` in `{}` list",
+                    ctx.line_no,
+                    literal,
+                    directive
+                );
+            }
+            ctx.on_error = true;
+            break;
+        }
+
+        if (!fits_data_width(value, width)) {
+            diagnose(ctx,
+                "Warning on line {}: Value `{}` too large to fit within {} bits, truncating to {} bits",
+                ctx.line_no,
+                std::string_view(item, p - item),
+                width * 8,
+                width * 8
+            );
+        }
+
+        const size_t pos = out.size();
+        out.resize(pos + width);
+        std::memcpy(out.data() + pos, &value, width);
+
+        p = skip_blanks(p, end);
+        if (p == end || *p == ';') {
+            break;
+        }
+        else if (*p != ',') {
+            diagnose(ctx,
+                "Error on line {}: Expected `,` between `{}` items, found `{}`",
+                ctx.line_no,
+                directive,
+                std::string_view(p, end - p)
+            );
+            ctx.on_error = true;
+            break;
+        }
+        ++p;
+    }
+
+    ctx.offset += out.size() - start;
+}
+
+void replicate_output(Context& ctx, uint64_t start_offset, uint64_t count) {
+    std::vector<uint8_t>& out = ctx.output_buffer;
+    const size_t item_size = (size_t)(ctx.offset - start_offset);
+
+    if (item_size > out.size()) {
+        diagnose(ctx,
+            "Error on line {}: `TIMES` item of {} bytes is too large to be replicated",
+            ctx.line_no,
+            item_size
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    // Checked by division, `count * item_size` may not fit in 64 bits
+    if (item_size != 0 && count > MAX_REPLICATED_SIZE / item_size) {
+        diagnose(ctx,
+            "Error on line {}: `TIMES {}` of a {}-byte item exceeds the limit of {} bytes",
+            ctx.line_no,
+            count,
+            item_size,
+            MAX_REPLICATED_SIZE
+        );
+        ctx.on_error = true;
+        return;
+    }
+
+    const size_t start = out.size() - item_size;
+
+    if (count == 0) {
+        out.resize(start);
+        ctx.offset = start_offset;
+        return;
+    }
+    else if (item_size == 0 || count == 1) {
+        return;
+    }
+
+    // Grow the single encoded copy into a block of copies, doubling the copied range on each step
+    const uint64_t block_copies = std::min<uint64_t>(count, std::max<size_t>(1, REPLICATION_BLOCK / item_size));
+    const size_t block_size = (size_t)block_copies * item_size;
+
+    out.resize(start + block_size);
+    uint8_t* block = out.data() + start;
+
+    if (item_size == 1) {
+        std::memset(block + 1, block[0], block_size - 1);
+    }
+    else {
+        for (size_t filled = item_size; filled < block_size;) {
+            const size_t n = std::min(filled, block_size - filled);
+            std::memcpy(block + filled, block, n);
+            filled += n;
+        }
+    }
+
+    const uint64_t remaining = count - block_copies;
+    ctx.offset = start_offset + count * item_size;
+
+    if (remaining == 0) {
+        return;
+    }
+    else if (ctx.output_file == nullptr) {
+        // Nowhere to stream to, every copy stays in the buffer
+        const size_t total_size = (size_t)(count * item_size);
+        out.resize(start + total_size);
+        block = out.data() + start;
+
+        for (size_t filled = block_size; filled < total_size;) {
+            const size_t n = std::min(filled, total_size - filled);
+            std::memcpy(block + filled, block, n);
+            filled += n;
+        }
+        return;
+    }
+
+    // Stream the remaining whole blocks straight to the output, only the tail goes back into the buffer
+    write_output(ctx, out.data(), out.size());
+    for (uint64_t i = 0; i < remaining / block_copies; ++i) {
+        write_output(ctx, block, block_size);
+    }
+
+    const size_t tail = (size_t)(remaining % block_copies) * item_size;
+    std::memmove(out.data(), block, tail);
+    out.resize(tail);
+}
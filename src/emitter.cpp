@@ -0,0 +1,299 @@
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <ostream>
+#include <utility>
+
+#include "emitter.hpp"
+#include "formats.hpp"
+#include "genformats.hpp"
+#include "memory.hpp"
+
+namespace audasm {
+    Emitter::Emitter(BitsMode b_mode, bool optimize) :
+        ctx {
+            .b_mode         = b_mode,
+            .line_no        = 0,
+            .output_file    = nullptr,
+            .diagnostics    = &diagnostics,
+            .on_error       = false,
+            .optimize       = optimize
+        }
+    {}
+
+    Emitter& Emitter::bits(BitsMode b_mode) {
+        ctx.b_mode = b_mode;
+        return *this;
+    }
+
+    Emitter& Emitter::prefix(uint16_t prefixes) {
+        ctx.contextual_prefixes |= prefixes;
+        return *this;
+    }
+
+    uint64_t Emitter::offset() const {
+        return ctx.offset;
+    }
+
+    Field Emitter::imm_field() const {
+        return imm;
+    }
+
+    Field Emitter::disp_field() const {
+        return disp;
+    }
+
+    Result Emitter::finish() {
+        if (ctx.contextual_prefixes != PREFIX_NONE) {
+            diagnose(ctx, "Error: Prefix at the end of the input is not followed by an instruction");
+            ctx.on_error = true;
+        }
+
+        Result result = {
+            .success        = !ctx.on_error,
+            .bytes          = std::move(ctx.output_buffer),
+            .diagnostics    = std::move(diagnostics).str(),
+            .peephole_stats = ctx.peephole_stats
+        };
+
+        diagnostics.str({});
+        ctx.output_buffer.clear();
+        ctx.line_no = 0;
+        ctx.on_error = false;
+        ctx.contextual_prefixes = PREFIX_NONE;
+        ctx.peephole_stats = {};
+        ctx.offset = 0;
+        imm = {};
+        disp = {};
+        return result;
+    }
+
+    Emitter& Emitter::zo(ZOMnemonic id) {
+        ++ctx.line_no;
+
+        EncodedInstruction ins;
+        return emit(encode_zo(ctx, ZO_NAMES[id], id, ins), ins);
+    }
+
+    Emitter& Emitter::alu(ALUMnemonic id, const Operand& dest, const Operand& source) {
+        ++ctx.line_no;
+
+        bool valid = true;
+        const AsmArg args[2] = { to_argument(dest, valid), to_argument(source, valid) };
+
+        EncodedInstruction ins;
+        return emit(valid && encode_alu(ctx, ALU_NAMES[id], id, args, ins), ins);
+    }
+
+    Emitter& Emitter::simd(SIMDMnemonic id, const Operand& a, const Operand& b, const Operand* c) {
+        ++ctx.line_no;
+
+        const size_t expected = simd_operand_count(SIMD_TABLE[id]);
+        if (expected != (c != nullptr ? 3 : 2)) {
+            diagnose(ctx,
+                "Error on line {}: Invalid number of arguments for `{}`, expected {}",
+                ctx.line_no,
+                SIMD_NAMES[id],
+                expected
+            );
+            ctx.on_error = true;
+            return emit(false, EncodedInstruction {});
+        }
+
+        bool valid = true;
+        const AsmArg args[3] = {
+            to_argument(a, valid),
+            to_argument(b, valid),
+            c != nullptr ? to_argument(*c, valid) : AsmArg { .type = AsmArgType::IMMEDIATE, .imm = 0 }
+        };
+
+        EncodedInstruction ins;
+        return emit(valid && encode_simd(ctx, SIMD_NAMES[id], id, args, ins), ins);
+    }
+
+    // Field offsets are relative to the instruction, which starts at the current offset
+    Emitter& Emitter::emit(bool encoded, const EncodedInstruction& ins) {
+        imm = {};
+        disp = {};
+
+        if (encoded) {
+            if (ins.imm_offset != NO_FIELD) {
+                imm = { ctx.offset + ins.imm_offset, ins.imm_size };
+            }
+            if (ins.disp_offset != NO_FIELD) {
+                disp = { ctx.offset + ins.disp_offset, ins.disp_size };
+            }
+            emit_instruction(ctx, ins);
+        }
+        return *this;
+    }
+
+    AsmArg Emitter::to_argument(const Operand& operand, bool& valid) {
+        switch (operand.type) {
+            case AsmArgType::REGISTER: {
+                return AsmArg {
+                    .type = AsmArgType::REGISTER,
+                    .reg = { operand.reg, register_info(operand.reg).size }
+                };
+            }
+            case AsmArgType::MEMORY: {
+                MemoryOperandDescriptor mdesc = {};
+                valid &= to_descriptor(operand.mem, mdesc);
+                return AsmArg {
+                    .type = AsmArgType::MEMORY,
+                    .mem = { mdesc, operand.mem.size }
+                };
+            }
+            default: {
+                return AsmArg {
+                    .type = AsmArgType::IMMEDIATE,
+                    .imm = operand.imm
+                };
+            }
+        }
+    }
+
+    // Fills the descriptor parse_memory() gives `[BASE + SCALE * INDEX + DISP]`
+    bool Emitter::to_descriptor(const Mem& mem, MemoryOperandDescriptor& mdesc) {
+        mdesc = {
+            .size   = 0,
+            .bx     = false,
+            .bp     = false,
+            .si     = false,
+            .di     = false,
+            .disp   = mem.disp,
+            .index  = 0xFF,
+            .scale  = 0,
+            .base   = 0xFF,
+            .rip    = false
+        };
+
+        if (mem.size != 0 && mem.size != 8 && mem.size != 16 && mem.size != 32 && mem.size != 64) {
+            diagnose(ctx,
+                "Error on line {}: Invalid size override of {} bits for a memory operand, expected 8, 16, 32 or 64",
+                ctx.line_no,
+                mem.size
+            );
+            ctx.on_error = true;
+            return false;
+        }
+
+        if (mem.rip) {
+            if (ctx.b_mode != BitsMode::M64) {
+                diagnose(ctx,
+                    "Error on line {}: RIP-relative addressing is only available in 64-bit mode",
+                    ctx.line_no
+                );
+                ctx.on_error = true;
+                return false;
+            }
+            else if (mem.base.has_value() || mem.index.has_value()) {
+                diagnose(ctx,
+                    "Error on line {}: RIP can only be combined with a displacement in a memory operand",
+                    ctx.line_no
+                );
+                ctx.on_error = true;
+                return false;
+            }
+
+            mdesc.rip = true;
+            mdesc.size = 64;
+            return true;
+        }
+
+        if (mem.base.has_value() && !add_address_register(*mem.base, false, 1, mdesc)) {
+            return false;
+        }
+        if (mem.index.has_value() && !add_address_register(*mem.index, true, mem.scale, mdesc)) {
+            return false;
+        }
+
+        // A displacement alone takes the size parse_memory() gives it
+        if (!has_address_registers(mdesc)) {
+            mdesc.size = ctx.b_mode == BitsMode::M64 ? 64 : 16;
+        }
+        return true;
+    }
+
+    bool Emitter::add_address_register(Reg reg, bool is_index, uint8_t scale, MemoryOperandDescriptor& mdesc) {
+        const auto& [name, r, rsize] = register_info(reg);
+
+        if (rsize != 16 && rsize != 32 && rsize != 64) {
+            diagnose(ctx,
+                "Error on line {}: Register `{}` cannot address memory",
+                ctx.line_no,
+                name
+            );
+            ctx.on_error = true;
+            return false;
+        }
+        else if (has_address_registers(mdesc) && mdesc.size != rsize) {
+            diagnose(ctx,
+                "Error on line {}: Invalid combination of {}-bit register `{}` in {}-bit memory operand",
+                ctx.line_no,
+                rsize,
+                name,
+                mdesc.size
+            );
+            ctx.on_error = true;
+            return false;
+        }
+        else if (is_index && !(scale == 1 || (rsize != 16 && (scale == 2 || scale == 4 || scale == 8)))) {
+            diagnose(ctx,
+                "Error on line {}: Invalid scale `{}` for index `{}` in memory operand, valid values are {}",
+                ctx.line_no,
+                scale,
+                name,
+                rsize == 16 ? "1 for a 16-bit index" : "1, 2, 4 and 8"
+            );
+            ctx.on_error = true;
+            return false;
+        }
+
+        mdesc.size = (uint8_t)rsize;
+
+        if (rsize != 16) {
+            if (is_index) {
+                mdesc.index = register_encoding(reg);
+                mdesc.scale = scale;
+            }
+            else {
+                mdesc.base = register_encoding(reg);
+            }
+            return true;
+        }
+
+        // The 16-bit forms pair BX or BP with SI or DI
+        bool* used = nullptr;
+        bool* excluded = nullptr;
+        switch (reg) {
+            case AsmRegister::BX: used = &mdesc.bx; excluded = &mdesc.bp; break;
+            case AsmRegister::BP: used = &mdesc.bp; excluded = &mdesc.bx; break;
+            case AsmRegister::SI: used = &mdesc.si; excluded = &mdesc.di; break;
+            case AsmRegister::DI: used = &mdesc.di; excluded = &mdesc.si; break;
+            default: {
+                diagnose(ctx,
+                    "Error on line {}: Use of invalid 16-bit register `{}` in 16-bit memory operand",
+                    ctx.line_no,
+                    name
+                );
+                ctx.on_error = true;
+                return false;
+            }
+        }
+
+        if (*used || *excluded) {
+            diagnose(ctx,
+                "Error on line {}: Illegal {} of register `{}` in 16-bit memory operand",
+                ctx.line_no,
+                *used ? "repetition" : "combination",
+                name
+            );
+            ctx.on_error = true;
+            return false;
+        }
+
+        *used = true;
+        return true;
+    }
+}
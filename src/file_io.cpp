@@ -0,0 +1,678 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "file_io.hpp"
+#include "trace.hpp"
+
+namespace {
+    constexpr size_t READ_BLOCK_SIZE = 1 << 20;
+    constexpr unsigned READ_QUEUE_DEPTH = 8;    // blocks read ahead of the prefix handed to the caller
+    constexpr size_t WRITE_BLOCK_SIZE = 1 << 18;
+    constexpr unsigned WRITE_BLOCKS = 4;        // one is filled while the others are being written
+
+#if !defined(_WIN32)
+    // Retries short and interrupted reads, fails if the file ends early
+    static bool read_fully(int fd, char* data, size_t size, off_t offset) {
+        while (size != 0) {
+            const ssize_t n = pread(fd, data, size, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+
+            data += n;
+            size -= (size_t)n;
+            offset += n;
+        }
+        return true;
+    }
+
+    static bool write_fully(int fd, const char* data, size_t size) {
+        while (size != 0) {
+            const ssize_t n = write(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    class PosixOutputBuffer final : public std::streambuf {
+    public:
+        explicit PosixOutputBuffer(int fd) :
+            fd(fd),
+            failed(false),
+            buffer(new char[WRITE_BLOCK_SIZE])
+        {
+            setp(buffer.get(), buffer.get() + WRITE_BLOCK_SIZE);
+        }
+
+        ~PosixOutputBuffer() override {
+            flush_buffer();
+            close(fd);
+        }
+
+    protected:
+        int overflow(int c) override {
+            if (!flush_buffer()) {
+                return traits_type::eof();
+            }
+
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        // Blocks at least as large as the buffer are written without being copied into it
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            if ((size_t)n < WRITE_BLOCK_SIZE) {
+                return std::streambuf::xsputn(s, n);
+            }
+
+            if (!flush_buffer() || !write_fully(fd, s, (size_t)n)) {
+                failed = true;
+                return 0;
+            }
+            return n;
+        }
+
+        int sync() override {
+            return flush_buffer() ? 0 : -1;
+        }
+
+    private:
+        bool flush_buffer() {
+            if (!failed && pptr() != pbase()) {
+                failed = !write_fully(fd, pbase(), (size_t)(pptr() - pbase()));
+            }
+
+            setp(buffer.get(), buffer.get() + WRITE_BLOCK_SIZE);
+            return !failed;
+        }
+
+        int                     fd;
+        bool                    failed;
+        std::unique_ptr<char[]> buffer;
+    };
+#endif
+
+#if defined(__linux__)
+    // Submission and completion rings driven through the raw system calls, no liburing needed
+    struct Uring {
+        int             fd = -1;
+
+        void*           sq_ring = MAP_FAILED;
+        size_t          sq_ring_size = 0;
+        void*           cq_ring = MAP_FAILED;
+        size_t          cq_ring_size = 0;
+        io_uring_sqe*   sqes = (io_uring_sqe*)MAP_FAILED;
+        size_t          sqes_size = 0;
+
+        unsigned*       sq_head;
+        unsigned*       sq_tail;
+        unsigned        sq_mask;
+        unsigned        sq_entries;
+        unsigned        sq_local_tail = 0;  // entries filled, published to the kernel by submit()
+        unsigned        to_submit = 0;
+
+        unsigned*       cq_head;
+        unsigned*       cq_tail;
+        unsigned        cq_mask;
+        io_uring_cqe*   cqes;
+
+        Uring() = default;
+        Uring(const Uring&) = delete;
+        Uring& operator=(const Uring&) = delete;
+
+        ~Uring() {
+            if (sqes != MAP_FAILED) {
+                munmap(sqes, sqes_size);
+            }
+            if (cq_ring != MAP_FAILED) {
+                munmap(cq_ring, cq_ring_size);
+            }
+            if (sq_ring != MAP_FAILED) {
+                munmap(sq_ring, sq_ring_size);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool init(unsigned entries) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+            if (fd < 0) {
+                return false;
+            }
+
+            sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+            sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+                return false;
+            }
+
+            char* sq = (char*)sq_ring;
+            sq_head     = (unsigned*)(sq + params.sq_off.head);
+            sq_tail     = (unsigned*)(sq + params.sq_off.tail);
+            sq_mask     = *(unsigned*)(sq + params.sq_off.ring_mask);
+            sq_entries  = params.sq_entries;
+            sq_local_tail = *sq_tail;
+
+            // Submission slot i always holds sqes[i]
+            unsigned* sq_array = (unsigned*)(sq + params.sq_off.array);
+            for (unsigned i = 0; i < sq_entries; ++i) {
+                sq_array[i] = i;
+            }
+
+            char* cq = (char*)cq_ring;
+            cq_head     = (unsigned*)(cq + params.cq_off.head);
+            cq_tail     = (unsigned*)(cq + params.cq_off.tail);
+            cq_mask     = *(unsigned*)(cq + params.cq_off.ring_mask);
+            cqes        = (io_uring_cqe*)(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        bool register_buffers(const iovec* buffers, unsigned count) {
+            return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+        }
+
+        // Returns nullptr when every submission slot is taken
+        io_uring_sqe* next_sqe() {
+            const unsigned head = std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire);
+            if (sq_local_tail - head >= sq_entries) {
+                return nullptr;
+            }
+
+            io_uring_sqe* sqe = &sqes[sq_local_tail & sq_mask];
+            std::memset(sqe, 0, sizeof(*sqe));
+            ++sq_local_tail;
+            ++to_submit;
+            return sqe;
+        }
+
+        // Hands the filled entries to the kernel and waits until `wait_nr` completions are available
+        bool submit(unsigned wait_nr) {
+            std::atomic_ref<unsigned>(*sq_tail).store(sq_local_tail, std::memory_order_release);
+
+            while (to_submit != 0 || wait_nr != 0) {
+                const int n = (int)syscall(
+                    __NR_io_uring_enter,
+                    fd,
+                    to_submit,
+                    wait_nr,
+                    wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0,
+                    nullptr,
+                    0
+                );
+                if (n < 0) {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                        continue;
+                    }
+                    return false;
+                }
+
+                to_submit -= (unsigned)n;
+                wait_nr = 0;
+            }
+            return true;
+        }
+
+        // Waits for `wait_nr` completions without handing over the entries not yet submitted
+        bool wait(unsigned wait_nr) {
+            for (;;) {
+                const int n = (int)syscall(__NR_io_uring_enter, fd, 0, wait_nr, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (n >= 0) {
+                    return true;
+                }
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    return false;
+                }
+            }
+        }
+
+        // Returns false if no completion is available
+        bool pop_cqe(io_uring_cqe& cqe) {
+            const unsigned head = *cq_head;
+            if (head == std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            cqe = cqes[head & cq_mask];
+            std::atomic_ref<unsigned>(*cq_head).store(head + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    // Keeps READ_QUEUE_DEPTH blocks in flight, the rest of a short read is queued again. Blocks complete in any order,
+    // `on_read` gets the length of the prefix of `data` read so far whenever it grows, while the next blocks are being
+    // read. Returns false if io_uring is unavailable or a read failed, no read is in flight by then.
+    static bool uring_read(int fd, char* data, size_t size, const ReadProgress& on_read) {
+        TRACE_SCOPE("uring_read");
+
+        Uring ring;
+        if (!ring.init(READ_QUEUE_DEPTH)) {
+            return false;
+        }
+
+        struct ReadRequest {
+            size_t offset;
+            size_t length;
+            bool   busy;
+        };
+
+        ReadRequest requests[READ_QUEUE_DEPTH] = {};
+        unsigned free_slots[READ_QUEUE_DEPTH];
+        unsigned free_count = READ_QUEUE_DEPTH;
+        for (unsigned i = 0; i < READ_QUEUE_DEPTH; ++i) {
+            free_slots[i] = i;
+        }
+
+        unsigned in_flight = 0;
+        size_t next_offset = 0;
+        size_t reported = 0;
+        bool failed = false;
+
+        auto queue_read = [&](unsigned slot) {
+            io_uring_sqe* sqe = ring.next_sqe();
+            sqe->opcode     = IORING_OP_READ;
+            sqe->fd         = fd;
+            sqe->addr       = (uint64_t)(uintptr_t)(data + requests[slot].offset);
+            sqe->len        = (uint32_t)requests[slot].length;
+            sqe->off        = requests[slot].offset;
+            sqe->user_data  = slot;
+            ++in_flight;
+        };
+
+        // Every byte before the next block to queue has been read, except those of the blocks still busy
+        auto read_prefix = [&] {
+            size_t prefix = next_offset;
+            for (const ReadRequest& request : requests) {
+                if (request.busy) {
+                    prefix = std::min(prefix, request.offset);
+                }
+            }
+            return prefix;
+        };
+
+        for (;;) {
+            while (!failed && free_count != 0 && next_offset < size) {
+                const unsigned slot = free_slots[--free_count];
+                requests[slot] = ReadRequest {
+                    .offset = next_offset,
+                    .length = std::min(READ_BLOCK_SIZE, size - next_offset),
+                    .busy   = true
+                };
+                next_offset += requests[slot].length;
+                queue_read(slot);
+            }
+
+            if (in_flight == 0) {
+                break;
+            }
+
+            // The kernel reads the queued blocks while the caller goes through those that completed
+            if (!ring.submit(0)) {
+                failed = true;
+                break;
+            }
+            if (const size_t prefix = read_prefix(); !failed && on_read && prefix > reported) {
+                reported = prefix;
+                on_read(std::string_view(data, size), reported);
+            }
+
+            if (!ring.submit(1)) {
+                failed = true;
+                break;
+            }
+
+            io_uring_cqe cqe;
+            while (ring.pop_cqe(cqe)) {
+                --in_flight;
+
+                const unsigned slot = (unsigned)cqe.user_data;
+                ReadRequest& request = requests[slot];
+                if (cqe.res <= 0) {
+                    failed = true;
+                }
+                else if ((size_t)cqe.res < request.length && !failed) {
+                    request.offset += (size_t)cqe.res;
+                    request.length -= (size_t)cqe.res;
+                    queue_read(slot);
+                    continue;
+                }
+
+                request.busy = false;
+                free_slots[free_count++] = slot;
+            }
+        }
+
+        // After a failed submission the kernel may still be writing into `data`, the caller reads the file again into
+        // it. The reads it accepted are waited for, those it did not are dropped with the ring.
+        while (in_flight > ring.to_submit) {
+            if (!ring.wait(1)) {
+                std::abort();   // cannot tell when `data` is safe to reuse
+            }
+
+            io_uring_cqe cqe;
+            while (ring.pop_cqe(cqe)) {
+                --in_flight;
+            }
+        }
+
+        if (!failed && on_read && reported < size) {
+            on_read(std::string_view(data, size), size);
+        }
+        return !failed;
+    }
+
+    // Fills WRITE_BLOCKS registered buffers in turn, a full one is written asynchronously while the next is filled.
+    // The writes carry their file offset, so they may complete in any order.
+    class UringOutputBuffer final : public std::streambuf {
+    public:
+        UringOutputBuffer(int fd, std::unique_ptr<Uring> ring) :
+            fd(fd),
+            buffers(new char[WRITE_BLOCKS * WRITE_BLOCK_SIZE]),
+            ring(std::move(ring)),
+            current(0),
+            file_offset(0),
+            failed(false)
+        {
+            iovec iovecs[WRITE_BLOCKS];
+            for (unsigned i = 0; i < WRITE_BLOCKS; ++i) {
+                iovecs[i] = iovec { .iov_base = block(i), .iov_len = WRITE_BLOCK_SIZE };
+                blocks[i] = WriteRequest {};
+            }
+
+            // Registration can fail on RLIMIT_MEMLOCK, unregistered buffers only cost a page pinning per write
+            fixed_buffers = this->ring->register_buffers(iovecs, WRITE_BLOCKS);
+            setp(block(current), block(current) + WRITE_BLOCK_SIZE);
+        }
+
+        ~UringOutputBuffer() override {
+            sync();
+            close(fd);
+        }
+
+    protected:
+        int overflow(int c) override {
+            if (pptr() != pbase()) {
+                submit_block(current, (size_t)(pptr() - pbase()));
+                current = (current + 1) % WRITE_BLOCKS;
+                wait_block(current);
+                setp(block(current), block(current) + WRITE_BLOCK_SIZE);
+            }
+
+            if (failed) {
+                return traits_type::eof();
+            }
+
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            if (pptr() != pbase()) {
+                submit_block(current, (size_t)(pptr() - pbase()));
+            }
+
+            for (unsigned i = 0; i < WRITE_BLOCKS; ++i) {
+                wait_block(i);
+            }
+
+            setp(block(current), block(current) + WRITE_BLOCK_SIZE);
+            return failed ? -1 : 0;
+        }
+
+    private:
+        struct WriteRequest {
+            uint64_t    offset;
+            size_t      length;
+            size_t      written;
+            bool        busy;
+        };
+
+        char* block(unsigned index) {
+            return buffers.get() + index * WRITE_BLOCK_SIZE;
+        }
+
+        void queue_write(unsigned index) {
+            const WriteRequest& request = blocks[index];
+
+            io_uring_sqe* sqe = ring->next_sqe();
+            sqe->opcode     = fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe->fd         = fd;
+            sqe->addr       = (uint64_t)(uintptr_t)(block(index) + request.written);
+            sqe->len        = (uint32_t)(request.length - request.written);
+            sqe->off        = request.offset + request.written;
+            sqe->buf_index  = fixed_buffers ? (uint16_t)index : 0;
+            sqe->user_data  = index;
+
+            if (!ring->submit(0)) {
+                failed = true;
+            }
+        }
+
+        void submit_block(unsigned index, size_t length) {
+            if (failed) {
+                return;
+            }
+
+            blocks[index] = WriteRequest {
+                .offset     = file_offset,
+                .length     = length,
+                .written    = 0,
+                .busy       = true
+            };
+            file_offset += length;
+            queue_write(index);
+        }
+
+        // The rest of a short write is queued again. Blocks are waited for even after a failure, the kernel may
+        // still be reading them.
+        void wait_block(unsigned index) {
+            while (blocks[index].busy) {
+                if (!ring->submit(1)) {
+                    failed = true;
+                    break;
+                }
+
+                io_uring_cqe cqe;
+                while (ring->pop_cqe(cqe)) {
+                    WriteRequest& request = blocks[cqe.user_data];
+                    if (cqe.res <= 0) {
+                        failed = true;
+                    }
+                    else {
+                        request.written += (size_t)cqe.res;
+                    }
+
+                    request.busy = !failed && request.written < request.length;
+                    if (request.busy) {
+                        queue_write((unsigned)cqe.user_data);
+                    }
+                }
+            }
+        }
+
+        int                     fd;
+        std::unique_ptr<char[]> buffers;
+        std::unique_ptr<Uring>  ring;           // declared after the buffers so it is torn down first
+        WriteRequest            blocks[WRITE_BLOCKS];
+        unsigned                current;        // the block being filled
+        uint64_t                file_offset;    // where the next submitted block goes
+        bool                    fixed_buffers;
+        bool                    failed;
+    };
+#endif
+}
+
+bool parse_io_backend(std::string_view name, IOBackend& backend) {
+    for (const auto& info : IO_BACKENDS) {
+        if (info.name == name) {
+            backend = info.backend;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool io_uring_available() {
+#if defined(__linux__)
+    static const bool available = [] {
+        Uring ring;
+        return ring.init(1);
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+#if !defined(_WIN32)
+bool read_until_eof(int fd, std::string& contents) {
+    contents.clear();
+    for (;;) {
+        const size_t used = contents.size();
+        ssize_t n = 0;
+        contents.resize_and_overwrite(used + READ_BLOCK_SIZE, [&](char* data, size_t size) {
+            n = read(fd, data + used, size - used);
+            return used + (n > 0 ? (size_t)n : 0);
+        });
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0;
+        }
+    }
+}
+#endif
+
+bool read_file(const std::string& path, IOBackend backend, std::string& contents, const ReadProgress& on_read) {
+    TRACE_SCOPE("read_file");
+
+#if !defined(_WIN32)
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Pipes and character devices report no size
+    if (!S_ISREG(st.st_mode)) {
+        const bool success = read_until_eof(fd, contents);
+        close(fd);
+        if (success && on_read) {
+            on_read(contents, contents.size());
+        }
+        return success;
+    }
+
+    bool success = false;
+    contents.resize_and_overwrite((size_t)st.st_size, [&](char* data, size_t size) {
+#if defined(__linux__)
+        success = backend == IOBackend::URING && uring_read(fd, data, size, on_read);
+#endif
+        if (!success) {
+            success = read_fully(fd, data, size, 0);
+            if (success && on_read) {
+                on_read(std::string_view(data, size), size);
+            }
+        }
+        return success ? size : 0;
+    });
+
+    close(fd);
+    return success;
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return false;
+    }
+
+    contents.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    if (on_read) {
+        on_read(contents, contents.size());
+    }
+    return true;
+#endif
+}
+
+std::unique_ptr<std::streambuf> open_output_file(const std::string& path, IOBackend backend) {
+#if !defined(_WIN32)
+    if (backend != IOBackend::DEFAULT) {
+        const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+#if defined(__linux__)
+        if (backend == IOBackend::URING) {
+            auto ring = std::make_unique<Uring>();
+            if (ring->init(WRITE_BLOCKS)) {
+                return std::make_unique<UringOutputBuffer>(fd, std::move(ring));
+            }
+        }
+#endif
+        return std::make_unique<PosixOutputBuffer>(fd);
+    }
+#endif
+
+    auto file = std::make_unique<std::filebuf>();
+    if (file->open(path, std::ios::out | std::ios::binary | std::ios::trunc) == nullptr) {
+        return nullptr;
+    }
+    return file;
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "audasm.hpp"
+#include "emitter.hpp"
+#include "jit.hpp"
+
+namespace {
+    constexpr uint8_t INT3 = 0xCC;
+
+    static size_t page_size() {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (size_t)info.dwPageSize;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    static bool map_chunk(size_t size, audasm::CodeChunk& chunk) {
+#if defined(_WIN32)
+        void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (p == nullptr) {
+            return false;
+        }
+#else
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+#endif
+        chunk.base = (uint8_t*)p;
+        chunk.size = size;
+        return true;
+    }
+
+    static void unmap_chunk(const audasm::CodeChunk& chunk) {
+#if defined(_WIN32)
+        VirtualFree(chunk.base, 0, MEM_RELEASE);
+#else
+        munmap(chunk.base, chunk.size);
+#endif
+    }
+
+    static bool protect_chunk(const audasm::CodeChunk& chunk, bool executable) {
+#if defined(_WIN32)
+        DWORD previous;
+        return VirtualProtect(chunk.base, chunk.size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous) != 0;
+#else
+        return mprotect(chunk.base, chunk.size, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) == 0;
+#endif
+    }
+
+    static void flush_instruction_cache(const audasm::CodeChunk& chunk) {
+#if defined(_WIN32)
+        FlushInstructionCache(GetCurrentProcess(), chunk.base, chunk.size);
+#else
+        __builtin___clear_cache((char*)chunk.base, (char*)chunk.base + chunk.size);
+#endif
+    }
+
+    // Makes room for `size` bytes at an aligned offset of the last pending chunk, taking a new one if needed
+    static uint8_t* reserve_code(audasm::CodeArena& arena, size_t size) {
+        if (!arena.pending.empty()) {
+            audasm::CodeChunk& chunk = arena.pending.back();
+            const size_t aligned = (arena.pending_used + audasm::JIT_ENTRY_ALIGNMENT - 1) & ~(audasm::JIT_ENTRY_ALIGNMENT - 1);
+
+            if (aligned + size <= chunk.size) {
+                std::memset(chunk.base + arena.pending_used, INT3, aligned - arena.pending_used);
+                arena.pending_used = aligned + size;
+                return chunk.base + aligned;
+            }
+        }
+
+        const size_t page = page_size();
+        const size_t needed = std::max(arena.chunk_size, (size + page - 1) & ~(page - 1));
+
+        audasm::CodeChunk chunk;
+        auto pooled = std::find_if(arena.pool.begin(), arena.pool.end(), [needed](const audasm::CodeChunk& c) {
+            return c.size >= needed;
+        });
+
+        if (pooled != arena.pool.end()) {
+            chunk = *pooled;
+            arena.pool.erase(pooled);
+        }
+        else if (!map_chunk(needed, chunk)) {
+            return nullptr;
+        }
+
+        arena.pending.push_back(chunk);
+        arena.pending_used = size;
+        return chunk.base;
+    }
+
+    // Copies assembled code into the pending chunk of `arena`
+    static audasm::JitResult load_code(audasm::CodeArena& arena, audasm::Result assembled) {
+        if (!assembled.success) {
+            return audasm::JitResult {
+                .success        = false,
+                .entry          = nullptr,
+                .size           = 0,
+                .diagnostics    = std::move(assembled.diagnostics)
+            };
+        }
+
+        const size_t size = assembled.bytes.size();
+        uint8_t* entry = reserve_code(arena, size);
+        if (entry == nullptr) {
+            assembled.diagnostics += "Error: Could not map memory for the code arena\n";
+            return audasm::JitResult {
+                .success        = false,
+                .entry          = nullptr,
+                .size           = 0,
+                .diagnostics    = std::move(assembled.diagnostics)
+            };
+        }
+
+        std::memcpy(entry, assembled.bytes.data(), size);
+        return audasm::JitResult {
+            .success        = true,
+            .entry          = entry,
+            .size           = size,
+            .diagnostics    = std::move(assembled.diagnostics)
+        };
+    }
+}
+
+namespace audasm {
+    CodeArena::CodeArena(size_t chunk_size) :
+        chunk_size(chunk_size),
+        pending_used(0)
+    {}
+
+    CodeArena::~CodeArena() {
+        for (const auto* chunks : { &pending, &committed, &pool }) {
+            for (const CodeChunk& chunk : *chunks) {
+                unmap_chunk(chunk);
+            }
+        }
+    }
+
+    JitResult assemble_jit(CodeArena& arena, std::string_view source, const Options& options) {
+        return load_code(arena, assemble(source, options));
+    }
+
+    JitResult assemble_jit(CodeArena& arena, Emitter& emitter) {
+        return load_code(arena, emitter.finish());
+    }
+
+    bool commit(CodeArena& arena) {
+        size_t switched = 0;
+        for (; switched < arena.pending.size(); ++switched) {
+            if (!protect_chunk(arena.pending[switched], true)) {
+                break;
+            }
+            flush_instruction_cache(arena.pending[switched]);
+        }
+
+        if (switched < arena.pending.size()) {
+            // Later routines are written to the pending chunks, the ones already made executable are switched back
+            // and those that cannot be are committed as they are
+            size_t writable = 0;
+            for (size_t i = 0; i < switched; ++i) {
+                if (protect_chunk(arena.pending[i], false)) {
+                    arena.pending[writable++] = arena.pending[i];
+                }
+                else {
+                    arena.committed.push_back(arena.pending[i]);
+                }
+            }
+            arena.pending.erase(arena.pending.begin() + writable, arena.pending.begin() + switched);
+            return false;
+        }
+
+        arena.committed.insert(arena.committed.end(), arena.pending.begin(), arena.pending.end());
+        arena.pending.clear();
+        arena.pending_used = 0;
+        return true;
+    }
+
+    void reset(CodeArena& arena) {
+        for (const auto* chunks : { &arena.pending, &arena.committed }) {
+            for (const CodeChunk& chunk : *chunks) {
+                if (protect_chunk(chunk, false)) {
+                    arena.pool.push_back(chunk);
+                }
+                else {
+                    unmap_chunk(chunk);
+                }
+            }
+        }
+
+        arena.pending.clear();
+        arena.committed.clear();
+        arena.pending_used = 0;
+    }
+}
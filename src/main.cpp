@@ -1,109 +1,186 @@
 #include <cstdint>
-#include <cstddef>
-
-#include <algorithm>
-#include <charconv>
-#include <format>
-#include <fstream>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <streambuf>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
-#include "argument.hpp"
+#include "alloc_stats.hpp"
+#include "assembler.hpp"
 #include "context.hpp"
-#include "formats.hpp"
-#include "memory.hpp"
-#include "parsing_utils.hpp"
-#include "registers.hpp"
+#include "file_io.hpp"
+#include "output_format.hpp"
+#include "peephole.hpp"
+#include "repl.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
-namespace {
-    static void assemble_line(Context& ctx, const std::string_view& s) {
-        if (s.empty() || s.starts_with("//") || s.starts_with(";") || s.starts_with("#")) {
-            return;
+int main(int argc, char* argv[]) {
+    std::vector<const char*> positional_args;
+    bool optimize = false;
+    bool print_stats = false;
+    bool alloc_stats = false;
+    bool repl = false;
+    bool write_dependencies = false;
+    std::string dependency_file_path;
+    IOBackend io_backend = IOBackend::DEFAULT;
+    OutputFormat output_format = OutputFormat::BINARY;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        if (arg == "-O") {
+            optimize = true;
         }
-        else if (s.starts_with("BITS ")) {
-            constexpr size_t prefix_length = 5;
-            change_bits_mode(ctx, s.substr(prefix_length));
+        else if (arg == "--stats") {
+            print_stats = true;
         }
-        else if (s.starts_with("[BITS ")) {
-            constexpr size_t prefix_length = 6;
-            change_bits_mode(ctx, s.substr(prefix_length, s.size() - prefix_length - 1));
+        else if (arg == "--alloc-stats") {
+            alloc_stats = true;
         }
-        else {
-            size_t delimiter_pos = s.find(" ");
-            std::string_view instruction = s.substr(0, delimiter_pos);
-            std::string_view args = delimiter_pos != std::string_view::npos ? s.substr(delimiter_pos + 1) : "";
-
-            if (ZOTable.contains(instruction)) {
-                assemble_zo(ctx, instruction, args);
-            }
-            else if (ALUTable.contains(instruction)) {
-                assemble_alu(ctx, instruction, args);
+        else if (arg == "-f" && i + 1 < argc) {
+            if (!parse_output_format(argv[++i], output_format)) {
+                std::cerr << "Error: Unknown output format " << argv[i] << " (accepted are bin, hex, carray and ihex)" << std::endl;
+                return -1;
             }
-            else {
-                std::cerr << std::format(
-                    "Error on line {}: Unknown instruction `{}`",
-                    ctx.line_no,
-                    instruction.data()
-                ) << std::endl;
-                ctx.on_error = true;
-                return;
+        }
+        else if (arg == "--repl") {
+            repl = true;
+        }
+        else if (arg == "-MD") {
+            write_dependencies = true;
+        }
+        else if (arg == "-MF" && i + 1 < argc) {
+            write_dependencies = true;
+            dependency_file_path = argv[++i];
+        }
+        else if (arg == "--io" && i + 1 < argc) {
+            if (!parse_io_backend(argv[++i], io_backend)) {
+                std::cerr << "Error: Unknown I/O backend " << argv[i] << " (accepted are default, posix and uring)" << std::endl;
+                return -1;
             }
         }
+        else {
+            positional_args.push_back(argv[i]);
+        }
     }
-}
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: aus <input file> <output file>" << std::endl;
+    if (positional_args.size() != (repl ? 0 : 2)) {
+        std::cerr << "Usage: aus [-O] [--stats] [--alloc-stats] [-MD] [-MF <dependency file>] [--io default|posix|uring] [-f bin|hex|carray|ihex] <input file> <output file>" << std::endl;
+        std::cerr << "       aus --repl [-O] [--stats]" << std::endl;
         return -1;
     }
 
-    const char* input_file_path     = argv[1];
-    const char* output_file_path    = argv[2];
+    if (alloc_stats) {
+        if (!alloc_stats_available()) {
+            std::cerr << "Error: --alloc-stats needs a build configured with -DAUDASM_ALLOC_STATS=ON" << std::endl;
+            return -1;
+        }
+        start_alloc_stats();
+    }
+
+    RunStats run_stats;
+    if (print_stats) {
+        init_run_stats(run_stats);
+    }
+
+    if (repl) {
+        // Lines are answered as soon as they arrive, stdio buffering would only add a copy
+        std::ios::sync_with_stdio(false);
+
+        Context ctx = {
+            .b_mode         = M16,
+            .line_no        = 1,
+            .output_file    = nullptr,
+            .diagnostics    = &std::cerr,
+            .on_error       = false,
+            .optimize       = optimize,
+            .stats          = print_stats ? &run_stats : nullptr
+        };
+
+        const bool success = run_repl(ctx, std::cin, std::cout);
+
+        // stdout carries the line protocol, the reports go with the diagnostics
+        if (ctx.optimize) {
+            print_peephole_stats(ctx.peephole_stats, *ctx.diagnostics);
+        }
+
+        if (ctx.stats != nullptr) {
+            print_run_stats(*ctx.stats, *ctx.diagnostics);
+        }
+
+        return success ? 0 : -1;
+    }
+
+    const char* input_file_path     = positional_args[0];
+    const char* output_file_path    = positional_args[1];
 
-    std::ifstream input_file(input_file_path);
-    if (!input_file) {
+    SourceCache sources;
+    sources.io_backend = io_backend;
+    const SourceFile* input_file = load_source(sources, input_file_path, print_stats ? &run_stats : nullptr);
+    if (input_file == nullptr) {
         std::cerr << "Error: Could not open " << input_file_path << std::endl;
         return -1;
     }
 
-    std::ofstream output_file(output_file_path, std::ios::binary);
-    if (!output_file) {
+    std::unique_ptr<std::streambuf> output_buffer = open_output_file(output_file_path, io_backend);
+    if (output_buffer == nullptr) {
         std::cerr << "Error: could not open " << output_file_path << std::endl;
         return -1;
     }
 
+    // Text formats sit between the encoder's output and the file
+    std::unique_ptr<TextOutputBuffer> text_output;
+    if (output_format != OutputFormat::BINARY) {
+        text_output = std::make_unique<TextOutputBuffer>(output_buffer.get(), output_format, carray_name(output_file_path));
+    }
+    std::ostream output_file(text_output != nullptr ? (std::streambuf*)text_output.get() : output_buffer.get());
+
     Context ctx = {
         .b_mode         = M16,
         .line_no        = 1,
-        .output_file    = std::move(output_file),
-        .on_error       = false
+        .output_file    = &output_file,
+        .diagnostics    = &std::cerr,
+        .on_error       = false,
+        .optimize       = optimize,
+        .stats          = print_stats ? &run_stats : nullptr
     };
 
-    std::string line;
-    while (std::getline(input_file, line)) {
-        size_t endpos   = line.find_last_not_of(" \t\n");
-        size_t startpos = line.find_first_not_of(" \t");
-
-        if (endpos == std::string::npos) {
-            ++ctx.line_no;
-            continue;
+    assemble_input(ctx, sources, *input_file);
+    {
+        TRACE_SCOPE("close_output");
+        StatsScope scope(ctx.stats, PHASE_WRITE);
+        if (text_output != nullptr && !text_output->finish()) {
+            output_file.setstate(std::ios::badbit);
         }
+        output_file.flush();
+        text_output.reset();
+        output_buffer.reset();
+    }
+
+    // Asynchronous writes only report their errors once flushed
+    if (!output_file) {
+        std::cerr << "Error: could not write " << output_file_path << std::endl;
+        ctx.on_error = true;
+    }
 
-        std::string normalized = line.substr(startpos, endpos - startpos + 1);
+    if (alloc_stats) {
+        uint64_t lines = 0;
+        for (const SourceFile* file : sources.load_order) {
+            lines += file->lines.size();
+        }
+        print_alloc_stats(lines);
+    }
 
-        std::transform(
-            normalized.begin(),
-            normalized.end(),
-            normalized.begin(),
-            [](unsigned char c) { return std::toupper(c); }
-        );
+    if (ctx.optimize) {
+        print_peephole_stats(ctx.peephole_stats, std::cout);
+    }
 
-        assemble_line(ctx, normalized);
-        ++ctx.line_no;
+    if (ctx.stats != nullptr) {
+        print_run_stats(*ctx.stats, std::cout);
     }
 
     if (ctx.on_error) {
@@ -111,5 +188,16 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    if (write_dependencies) {
+        if (dependency_file_path.empty()) {
+            dependency_file_path = std::filesystem::path(output_file_path).replace_extension(".d").string();
+        }
+
+        if (!write_dependency_file(sources, dependency_file_path, output_file_path)) {
+            std::cerr << "Error: could not write " << dependency_file_path << std::endl;
+            return -1;
+        }
+    }
+
     return 0;
 }
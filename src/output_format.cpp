@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#include "output_format.hpp"
+#include "trace.hpp"
+
+namespace {
+    constexpr size_t TEXT_BUFFER_SIZE = 1 << 18;
+    constexpr size_t FORMAT_CHUNK = 1 << 14;        // bytes formatted between two checks of the space left
+    constexpr size_t MAX_TEXT_PER_BYTE = 8;         // CARRAY's `, 0x00` plus its share of the line breaks
+    constexpr size_t TEXT_MARGIN = 64;              // an IHEX address record and the end of a line
+
+    constexpr size_t HEX_BYTES_PER_LINE = 32;
+    constexpr size_t CARRAY_BYTES_PER_LINE = 12;
+    constexpr size_t IHEX_RECORD_SIZE = 16;
+
+    constexpr uint8_t IHEX_DATA = 0x00;
+    constexpr uint8_t IHEX_END_OF_FILE = 0x01;
+    constexpr uint8_t IHEX_EXTENDED_LINEAR_ADDRESS = 0x04;
+
+    // Both hex digits of every byte value
+    constexpr std::array<std::array<char, 2>, 256> make_hex_table(const char* digits) {
+        std::array<std::array<char, 2>, 256> table = {};
+        for (size_t i = 0; i < 256; ++i) {
+            table[i] = { digits[i >> 4], digits[i & 0xF] };
+        }
+        return table;
+    }
+
+    // Every CARRAY item with the separator in front of it, the first item of a line skips the separator
+    constexpr std::array<std::array<char, 6>, 256> make_carray_table() {
+        constexpr const char* digits = "0123456789abcdef";
+
+        std::array<std::array<char, 6>, 256> table = {};
+        for (size_t i = 0; i < 256; ++i) {
+            table[i] = { ',', ' ', '0', 'x', digits[i >> 4], digits[i & 0xF] };
+        }
+        return table;
+    }
+
+    constexpr auto HEX_LOWER = make_hex_table("0123456789abcdef");
+    constexpr auto HEX_UPPER = make_hex_table("0123456789ABCDEF");
+    constexpr auto CARRAY_ITEMS = make_carray_table();
+
+    static char* put_hex(char* out, const std::array<std::array<char, 2>, 256>& table, uint8_t b) {
+        std::memcpy(out, table[b].data(), 2);
+        return out + 2;
+    }
+}
+
+bool parse_output_format(std::string_view name, OutputFormat& format) {
+    for (const auto& info : OUTPUT_FORMATS) {
+        if (info.name == name) {
+            format = info.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string carray_name(const std::string& path) {
+    std::string name = std::filesystem::path(path).filename().string();
+    for (char& c : name) {
+        if (!std::isalnum((unsigned char)c)) {
+            c = '_';
+        }
+    }
+
+    if (name.empty() || std::isdigit((unsigned char)name.front())) {
+        name.insert(0, "__");
+    }
+    return name;
+}
+
+TextOutputBuffer::TextOutputBuffer(std::streambuf* sink, OutputFormat format, std::string_view array_name) :
+    sink(sink),
+    format(format),
+    array_name(array_name),
+    text(new char[TEXT_BUFFER_SIZE]),
+    text_size(0),
+    byte_count(0),
+    column(0),
+    record{},
+    upper_address(0),
+    failed(false)
+{
+    if (format == OutputFormat::CARRAY) {
+        append(std::format("unsigned char {}[] = {{\n", this->array_name));
+    }
+}
+
+TextOutputBuffer::~TextOutputBuffer() {
+    flush_text();
+}
+
+bool TextOutputBuffer::finish() {
+    TRACE_SCOPE("finish_text_output");
+
+    switch (format) {
+        case OutputFormat::BINARY:
+            break;
+        case OutputFormat::HEX:
+            if (column != 0) {
+                append("\n");
+            }
+            break;
+        case OutputFormat::CARRAY:
+            append(std::format(
+                "{}}};\nunsigned int {}_len = {};\n",
+                byte_count != 0 ? "\n" : "",
+                array_name,
+                byte_count
+            ));
+            break;
+        case OutputFormat::IHEX:
+            if (byte_count % IHEX_RECORD_SIZE != 0) {
+                const size_t n = byte_count % IHEX_RECORD_SIZE;
+                write_ihex_data(byte_count - n, record, n);
+            }
+            write_ihex_record(IHEX_END_OF_FILE, 0, nullptr, 0);
+            break;
+    }
+
+    flush_text();
+    return !failed;
+}
+
+std::streamsize TextOutputBuffer::xsputn(const char* s, std::streamsize n) {
+    TRACE_SCOPE("format_text_output");
+
+    const uint8_t* data = (const uint8_t*)s;
+    size_t left = (size_t)n;
+
+    while (left != 0) {
+        const size_t chunk = std::min(left, FORMAT_CHUNK);
+        if (text_size + chunk * MAX_TEXT_PER_BYTE + TEXT_MARGIN > TEXT_BUFFER_SIZE) {
+            flush_text();
+        }
+
+        format_bytes(data, chunk);
+        data += chunk;
+        left -= chunk;
+    }
+
+    return failed ? 0 : n;
+}
+
+int TextOutputBuffer::overflow(int c) {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        const char b = traits_type::to_char_type(c);
+        if (xsputn(&b, 1) != 1) {
+            return traits_type::eof();
+        }
+    }
+    return traits_type::not_eof(c);
+}
+
+int TextOutputBuffer::sync() {
+    flush_text();
+    return failed || sink->pubsync() == -1 ? -1 : 0;
+}
+
+void TextOutputBuffer::format_bytes(const uint8_t* data, size_t n) {
+    switch (format) {
+        case OutputFormat::BINARY:
+            std::memcpy(text.get() + text_size, data, n);
+            text_size += n;
+            byte_count += n;
+            break;
+        case OutputFormat::HEX: format_hex(data, n); break;
+        case OutputFormat::CARRAY: format_carray(data, n); break;
+        case OutputFormat::IHEX: format_ihex(data, n); break;
+    }
+}
+
+void TextOutputBuffer::format_hex(const uint8_t* data, size_t n) {
+    char* out = text.get() + text_size;
+    byte_count += n;
+
+    while (n != 0) {
+        const size_t run = std::min(n, HEX_BYTES_PER_LINE - column);
+        for (size_t i = 0; i < run; ++i) {
+            out = put_hex(out, HEX_LOWER, data[i]);
+        }
+
+        data += run;
+        n -= run;
+        column += run;
+        if (column == HEX_BYTES_PER_LINE) {
+            *out++ = '\n';
+            column = 0;
+        }
+    }
+
+    text_size = (size_t)(out - text.get());
+}
+
+void TextOutputBuffer::format_carray(const uint8_t* data, size_t n) {
+    char* out = text.get() + text_size;
+
+    while (n != 0) {
+        // A line starts with the two-space indent instead of the separator, the previous one ends with a comma
+        if (column == 0) {
+            if (byte_count != 0) {
+                std::memcpy(out, ",\n", 2);
+                out += 2;
+            }
+            std::memcpy(out, "  ", 2);
+            std::memcpy(out + 2, CARRAY_ITEMS[*data].data() + 2, 4);
+            out += 6;
+
+            ++data;
+            --n;
+            ++byte_count;
+            column = 1;
+            continue;
+        }
+
+        const size_t run = std::min(n, CARRAY_BYTES_PER_LINE - column);
+        for (size_t i = 0; i < run; ++i) {
+            std::memcpy(out, CARRAY_ITEMS[data[i]].data(), 6);
+            out += 6;
+        }
+
+        data += run;
+        n -= run;
+        byte_count += run;
+        column = (column + run) % CARRAY_BYTES_PER_LINE;
+    }
+
+    text_size = (size_t)(out - text.get());
+}
+
+void TextOutputBuffer::format_ihex(const uint8_t* data, size_t n) {
+    while (n != 0) {
+        const size_t filled = byte_count % IHEX_RECORD_SIZE;
+        const size_t take = std::min(n, IHEX_RECORD_SIZE - filled);
+
+        // Whole records are formatted straight from the input
+        const uint8_t* record_data = data;
+        if (filled != 0 || take != IHEX_RECORD_SIZE) {
+            std::memcpy(record + filled, data, take);
+            record_data = record;
+        }
+
+        data += take;
+        n -= take;
+        byte_count += take;
+
+        if (byte_count % IHEX_RECORD_SIZE == 0) {
+            write_ihex_data(byte_count - IHEX_RECORD_SIZE, record_data, IHEX_RECORD_SIZE);
+        }
+    }
+}
+
+void TextOutputBuffer::write_ihex_data(uint64_t address, const uint8_t* data, size_t n) {
+    if (address > UINT32_MAX) {
+        // Past the 4 GiB an Intel HEX file can address
+        failed = true;
+        return;
+    }
+
+    if ((uint32_t)(address >> 16) != upper_address) {
+        upper_address = (uint32_t)(address >> 16);
+        const uint8_t upper[2] = { (uint8_t)(upper_address >> 8), (uint8_t)upper_address };
+        write_ihex_record(IHEX_EXTENDED_LINEAR_ADDRESS, 0, upper, 2);
+    }
+    write_ihex_record(IHEX_DATA, (uint16_t)address, data, n);
+}
+
+// :LLAAAATT<data>CC, CC makes the sum of every byte of the record zero
+void TextOutputBuffer::write_ihex_record(uint8_t type, uint16_t address, const uint8_t* data, size_t n) {
+    char* out = text.get() + text_size;
+
+    uint8_t checksum = (uint8_t)(n + (address >> 8) + address + type);
+    *out++ = ':';
+    out = put_hex(out, HEX_UPPER, (uint8_t)n);
+    out = put_hex(out, HEX_UPPER, (uint8_t)(address >> 8));
+    out = put_hex(out, HEX_UPPER, (uint8_t)address);
+    out = put_hex(out, HEX_UPPER, type);
+    for (size_t i = 0; i < n; ++i) {
+        out = put_hex(out, HEX_UPPER, data[i]);
+        checksum += data[i];
+    }
+    out = put_hex(out, HEX_UPPER, (uint8_t)-checksum);
+    *out++ = '\n';
+
+    text_size = (size_t)(out - text.get());
+}
+
+void TextOutputBuffer::append(std::string_view s) {
+    if (text_size + s.size() + TEXT_MARGIN > TEXT_BUFFER_SIZE) {
+        flush_text();
+    }
+
+    // Only an array name longer than the buffer gets here with the buffer empty
+    if (s.size() + TEXT_MARGIN > TEXT_BUFFER_SIZE) {
+        failed |= sink->sputn(s.data(), (std::streamsize)s.size()) != (std::streamsize)s.size();
+        return;
+    }
+
+    std::memcpy(text.get() + text_size, s.data(), s.size());
+    text_size += s.size();
+}
+
+void TextOutputBuffer::flush_text() {
+    if (text_size != 0 && !failed) {
+        failed = sink->sputn(text.get(), (std::streamsize)text_size) != (std::streamsize)text_size;
+    }
+    text_size = 0;
+}
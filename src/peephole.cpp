@@ -0,0 +1,43 @@
+#include <cstddef>
+#include <format>
+#include <ostream>
+#include <string_view>
+
+#include "peephole.hpp"
+
+namespace {
+    constexpr std::string_view RULE_NAMES[PEEPHOLE_RULE_COUNT] = {
+        "cmp-zero-to-test",
+        "accumulator-imm8",
+        "sign-extended-imm8"
+    };
+}
+
+void record_peephole_hit(PeepholeStats& stats, PeepholeRule rule, size_t bytes_saved) {
+    ++stats.hits[rule];
+    stats.bytes_saved[rule] += bytes_saved;
+}
+
+void print_peephole_stats(const PeepholeStats& stats, std::ostream& out) {
+    size_t total_hits = 0;
+    size_t total_saved = 0;
+
+    out << "Peephole optimizer summary:" << std::endl;
+    for (size_t i = 0; i < PEEPHOLE_RULE_COUNT; ++i) {
+        out << std::format(
+            "  {:<20} {:>10} hits {:>10} bytes saved",
+            RULE_NAMES[i],
+            stats.hits[i],
+            stats.bytes_saved[i]
+        ) << std::endl;
+
+        total_hits += stats.hits[i];
+        total_saved += stats.bytes_saved[i];
+    }
+    out << std::format(
+        "  {:<20} {:>10} hits {:>10} bytes saved",
+        "total",
+        total_hits,
+        total_saved
+    ) << std::endl;
+}
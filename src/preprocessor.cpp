@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "context.hpp"
+#include "parsing_utils.hpp"
+#include "preprocessor.hpp"
+#include "source.hpp"
+
+namespace {
+    constexpr size_t MAX_EXPANSION_DEPTH = 64;
+
+    static inline bool is_identifier_start(char c) {
+        return (c >= 'A' && c <= 'Z') || c == '_' || c == '.' || c == '$' || c == '?' || c == '@';
+    }
+
+    static inline bool is_identifier_char(char c) {
+        return is_identifier_start(c) || (c >= '0' && c <= '9');
+    }
+
+    static inline bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    // Splits `line` into tokens relative to `base`, consecutive plain characters are merged into TEXT runs. The lines of
+    // a block are stored back to back, a run never extends into the previous line.
+    static void tokenize_line(const std::string_view& line, uint32_t base, std::vector<Token>& tokens) {
+        const size_t first_token = tokens.size();
+        const auto push_text = [&](size_t start, size_t end) {
+            if (tokens.size() > first_token && tokens.back().kind == TokenKind::TEXT && tokens.back().offset + tokens.back().length == base + start) {
+                tokens.back().length += (uint32_t)(end - start);
+            }
+            else {
+                tokens.push_back(Token { .kind = TokenKind::TEXT, .offset = (uint32_t)(base + start), .length = (uint32_t)(end - start) });
+            }
+        };
+
+        size_t i = 0;
+        while (i < line.size()) {
+            const size_t start = i;
+            const char c = line[i];
+
+            if (c == '%' && i + 1 < line.size() && is_digit(line[i + 1])) {
+                uint32_t n = 0;
+                for (++i; i < line.size() && is_digit(line[i]); ++i) {
+                    n = n * 10 + (uint32_t)(line[i] - '0');
+                }
+                tokens.push_back(Token {
+                    .kind   = n == 0 ? TokenKind::PARAMETER_COUNT : TokenKind::PARAMETER,
+                    .offset = n,
+                    .length = 0
+                });
+            }
+            else if (c == '%' || is_digit(c)) {
+                // Size keywords (`%DWORD`) and numeric literals (`0X1F`) are never substituted
+                for (++i; i < line.size() && is_identifier_char(line[i]); ++i);
+                push_text(start, i);
+            }
+            else if (is_identifier_start(c)) {
+                for (++i; i < line.size() && is_identifier_char(line[i]); ++i);
+                tokens.push_back(Token {
+                    .kind   = TokenKind::IDENTIFIER,
+                    .offset = (uint32_t)(base + start),
+                    .length = (uint32_t)(i - start)
+                });
+            }
+            else {
+                for (++i; i < line.size() && !is_identifier_start(line[i]) && !is_digit(line[i]) && line[i] != '%'; ++i);
+                push_text(start, i);
+            }
+        }
+    }
+
+    static void record_line(TokenizedBlock& block, const std::string_view& line) {
+        const uint32_t base = (uint32_t)block.text.size();
+        const uint32_t first_token = (uint32_t)block.tokens.size();
+
+        block.text.append(line);
+        tokenize_line(line, base, block.tokens);
+        block.lines.push_back(TokenizedLine {
+            .first_token = first_token,
+            .token_count = (uint32_t)(block.tokens.size() - first_token)
+        });
+    }
+
+    static void substitute_defines(Context& ctx, const Preprocessor& pp, const std::string_view& text, std::string& out, size_t depth);
+
+    static void append_identifier(Context& ctx, const Preprocessor& pp, const std::string_view& ident, std::string& out, size_t depth) {
+        auto it = pp.defines.find(ident);
+        if (it == pp.defines.end()) {
+            out.append(ident);
+        }
+        else if (depth >= MAX_EXPANSION_DEPTH) {
+            diagnose(ctx,
+                "Error on line {}: `%DEFINE` expansion of `{}` is too deep, is it recursive?",
+                ctx.line_no,
+                ident
+            );
+            ctx.on_error = true;
+        }
+        else {
+            substitute_defines(ctx, pp, it->second, out, depth + 1);
+        }
+    }
+
+    static void substitute_defines(Context& ctx, const Preprocessor& pp, const std::string_view& text, std::string& out, size_t depth) {
+        size_t i = 0;
+        while (i < text.size()) {
+            const size_t start = i;
+            const char c = text[i];
+
+            if (is_identifier_start(c)) {
+                for (++i; i < text.size() && is_identifier_char(text[i]); ++i);
+                append_identifier(ctx, pp, text.substr(start, i - start), out, depth);
+            }
+            else if (c == '%' || is_digit(c)) {
+                for (++i; i < text.size() && is_identifier_char(text[i]); ++i);
+                out.append(text.substr(start, i - start));
+            }
+            else {
+                for (++i; i < text.size() && !is_identifier_start(text[i]) && !is_digit(text[i]) && text[i] != '%'; ++i);
+                out.append(text.substr(start, i - start));
+            }
+        }
+    }
+
+    static void expand_tokens(
+        Context& ctx,
+        const Preprocessor& pp,
+        const TokenizedBlock& block,
+        const TokenizedLine& line,
+        const std::vector<std::string_view>& args,
+        std::string& out
+    ) {
+        const Token* tokens = block.tokens.data() + line.first_token;
+        const std::string_view text = block.text;
+
+        for (uint32_t i = 0; i < line.token_count; ++i) {
+            const Token& tok = tokens[i];
+            switch (tok.kind) {
+                case TokenKind::TEXT: {
+                    out.append(text.substr(tok.offset, tok.length));
+                    break;
+                }
+                case TokenKind::IDENTIFIER: {
+                    append_identifier(ctx, pp, text.substr(tok.offset, tok.length), out, 0);
+                    break;
+                }
+                case TokenKind::PARAMETER: {
+                    if (tok.offset > args.size()) {
+                        diagnose(ctx,
+                            "Error on line {}: Macro parameter `%{}` is out of range, the macro takes {} parameters",
+                            ctx.line_no,
+                            tok.offset,
+                            args.size()
+                        );
+                        ctx.on_error = true;
+                        return;
+                    }
+                    out.append(args[tok.offset - 1]);
+                    break;
+                }
+                case TokenKind::PARAMETER_COUNT: {
+                    out.append(std::to_string(args.size()));
+                    break;
+                }
+            }
+        }
+    }
+
+    static bool enter_expansion(Context& ctx, Preprocessor& pp, const std::string_view& what) {
+        if (pp.expansion_depth >= MAX_EXPANSION_DEPTH) {
+            diagnose(ctx,
+                "Error on line {}: Expansion of `{}` is nested too deeply, is it recursive?",
+                ctx.line_no,
+                what
+            );
+            ctx.on_error = true;
+            return false;
+        }
+
+        ++pp.expansion_depth;
+        return true;
+    }
+
+    static void run_block(
+        Context& ctx,
+        Preprocessor& pp,
+        const TokenizedBlock& block,
+        const std::vector<std::string_view>& args,
+        LineSink sink
+    ) {
+        std::string expanded;
+        for (const auto& line : block.lines) {
+            expanded.clear();
+            expand_tokens(ctx, pp, block, line, args, expanded);
+            preprocess_line(ctx, pp, expanded, sink);
+        }
+    }
+
+    static void expand_macro(
+        Context& ctx,
+        Preprocessor& pp,
+        const std::string_view& name,
+        std::shared_ptr<const Macro> macro,
+        const std::string_view& args_text,
+        LineSink sink
+    ) {
+        std::string_view normalized = trim_string(args_text);
+        size_t comment_pos = normalized.find(';');
+        if (comment_pos != std::string_view::npos) {
+            normalized = trim_string(normalized.substr(0, comment_pos));
+        }
+
+        std::vector<std::string_view> args;
+        if (!normalized.empty()) {
+            for (const auto& arg : split_string(normalized, ',')) {
+                args.push_back(trim_string(arg));
+            }
+        }
+
+        if (args.size() != macro->n_params) {
+            diagnose(ctx,
+                "Error on line {}: Macro `{}` expects {} parameters, found {}",
+                ctx.line_no,
+                name,
+                macro->n_params,
+                args.size()
+            );
+            ctx.on_error = true;
+            return;
+        }
+
+        if (enter_expansion(ctx, pp, name)) {
+            run_block(ctx, pp, macro->body, args, sink);
+            --pp.expansion_depth;
+        }
+    }
+
+    static bool evaluate_condition(Context& ctx, const Preprocessor& pp, const std::string_view& expr) {
+        std::string substituted;
+        substitute_defines(ctx, pp, expr, substituted, 0);
+
+        const std::string_view s = trim_string(substituted);
+        constexpr std::string_view operators[] = { "==", "!=", "<=", ">=", "<", ">" };
+
+        for (const auto& op : operators) {
+            size_t op_pos = s.find(op);
+            if (op_pos == std::string_view::npos) {
+                continue;
+            }
+
+            uint64_t lhs, rhs;
+            if (!parse_number(ctx, trim_string(s.substr(0, op_pos)), lhs) || !parse_number(ctx, trim_string(s.substr(op_pos + op.size())), rhs)) {
+                return false;
+            }
+
+            const int64_t l = (int64_t)lhs;
+            const int64_t r = (int64_t)rhs;
+            switch (op[0]) {
+                case '=': return l == r;
+                case '!': return l != r;
+                case '<': return op.size() == 2 ? l <= r : l < r;
+                default:  return op.size() == 2 ? l >= r : l > r;
+            }
+        }
+
+        uint64_t value;
+        return parse_number(ctx, s, value) && value != 0;
+    }
+
+    static bool is_active(const Preprocessor& pp) {
+        return pp.conditionals.empty() || pp.conditionals.back().active;
+    }
+
+    static void push_conditional(Preprocessor& pp, bool condition) {
+        const bool parent_active = is_active(pp);
+        pp.conditionals.push_back(Conditional {
+            .parent_active  = parent_active,
+            .taken          = parent_active && condition,
+            .active         = parent_active && condition,
+            .in_else        = false
+        });
+    }
+
+    static bool check_identifier(Context& ctx, const std::string_view& directive, const std::string_view& name) {
+        if (name.empty() || !is_identifier_start(name.front()) || !std::all_of(name.begin(), name.end(), is_identifier_char)) {
+            diagnose(ctx,
+                "Error on line {}: Invalid name `{}` for `{}`",
+                ctx.line_no,
+                name,
+                directive
+            );
+            ctx.on_error = true;
+            return false;
+        }
+        return true;
+    }
+
+    static void finish_recording(Context& ctx, Preprocessor& pp, LineSink sink) {
+        Recording recording = std::move(pp.recording);
+        pp.recording = Recording { .kind = RecordingKind::NONE };
+
+        if (recording.kind == RecordingKind::MACRO) {
+            pp.macros.insert_or_assign(recording.name, std::make_shared<const Macro>(Macro {
+                .n_params   = recording.n_params,
+                .body       = std::move(recording.block)
+            }));
+        }
+        else if (enter_expansion(ctx, pp, "%REP")) {
+            const std::vector<std::string_view> no_args;
+            for (uint64_t i = 0; i < recording.count && !ctx.on_error; ++i) {
+                run_block(ctx, pp, recording.block, no_args, sink);
+            }
+            --pp.expansion_depth;
+        }
+    }
+
+    static void record(Context& ctx, Preprocessor& pp, const std::string_view& directive, const std::string_view& line, LineSink sink) {
+        Recording& rec = pp.recording;
+
+        if (directive == "%MACRO" || directive == "%REP") {
+            ++rec.depth;
+        }
+        else if (directive == "%ENDMACRO" || directive == "%ENDREP") {
+            if (--rec.depth == 0) {
+                const bool is_macro_end = directive == "%ENDMACRO";
+                if (is_macro_end != (rec.kind == RecordingKind::MACRO)) {
+                    diagnose(ctx,
+                        "Error on line {}: `{}` does not close the `{}` opened on line {}",
+                        ctx.line_no,
+                        directive,
+                        rec.kind == RecordingKind::MACRO ? "%MACRO" : "%REP",
+                        rec.line_no
+                    );
+                    ctx.on_error = true;
+                    pp.recording = Recording { .kind = RecordingKind::NONE };
+                    return;
+                }
+
+                return finish_recording(ctx, pp, sink);
+            }
+        }
+
+        record_line(rec.block, line);
+    }
+
+    static void handle_directive(Context& ctx, Preprocessor& pp, const std::string_view& directive, const std::string_view& args) {
+        // Conditionals are tracked even inside skipped blocks so that nesting stays balanced
+        if (directive == "%IF" || directive == "%IFDEF" || directive == "%IFNDEF") {
+            if (!is_active(pp)) {
+                push_conditional(pp, false);
+            }
+            else if (directive == "%IF") {
+                push_conditional(pp, evaluate_condition(ctx, pp, args));
+            }
+            else if (check_identifier(ctx, directive, args)) {
+                push_conditional(pp, pp.defines.contains(args) == (directive == "%IFDEF"));
+            }
+            return;
+        }
+        else if (directive == "%ELSE" || directive == "%ENDIF") {
+            if (pp.conditionals.empty() || (directive == "%ELSE" && pp.conditionals.back().in_else)) {
+                diagnose(ctx,
+                    "Error on line {}: `{}` without a matching `%IF`",
+                    ctx.line_no,
+                    directive
+                );
+                ctx.on_error = true;
+                return;
+            }
+
+            if (directive == "%ENDIF") {
+                pp.conditionals.pop_back();
+            }
+            else {
+                Conditional& cond = pp.conditionals.back();
+                cond.active = cond.parent_active && !cond.taken;
+                cond.taken = true;
+                cond.in_else = true;
+            }
+            return;
+        }
+
+        if (!is_active(pp)) {
+            return;
+        }
+
+        if (directive == "%DEFINE") {
+            const size_t delimiter_pos = args.find_first_of(" \t");
+            const std::string_view name = args.substr(0, delimiter_pos);
+            const std::string_view value = delimiter_pos != std::string_view::npos ? trim_string(args.substr(delimiter_pos)) : "";
+
+            if (check_identifier(ctx, directive, name)) {
+                pp.defines.insert_or_assign(std::string(name), std::string(value));
+            }
+        }
+        else if (directive == "%UNDEF") {
+            if (check_identifier(ctx, directive, args)) {
+                pp.defines.erase(std::string(args));
+            }
+        }
+        else if (directive == "%MACRO") {
+            const size_t delimiter_pos = args.find_first_of(" \t");
+            const std::string_view name = args.substr(0, delimiter_pos);
+            const std::string_view count = delimiter_pos != std::string_view::npos ? trim_string(args.substr(delimiter_pos)) : "0";
+
+            uint64_t n_params;
+            if (check_identifier(ctx, directive, name) && parse_number(ctx, count, n_params)) {
+                pp.recording = Recording {
+                    .kind       = RecordingKind::MACRO,
+                    .name       = std::string(name),
+                    .n_params   = (size_t)n_params,
+                    .count      = 0,
+                    .depth      = 1,
+                    .line_no    = ctx.line_no
+                };
+            }
+        }
+        else if (directive == "%REP") {
+            std::string substituted;
+            substitute_defines(ctx, pp, args, substituted, 0);
+
+            uint64_t count;
+            if (parse_number(ctx, trim_string(substituted), count)) {
+                pp.recording = Recording {
+                    .kind       = RecordingKind::REP,
+                    .n_params   = 0,
+                    .count      = count,
+                    .depth      = 1,
+                    .line_no    = ctx.line_no
+                };
+            }
+        }
+        else {
+            diagnose(ctx,
+                "Error on line {}: Unknown or misplaced preprocessor directive `{}`",
+                ctx.line_no,
+                directive
+            );
+            ctx.on_error = true;
+        }
+    }
+}
+
+void preprocess_line(Context& ctx, Preprocessor& pp, const std::string_view& line, LineSink sink) {
+    const size_t delimiter_pos = line.find_first_of(" \t");
+    const std::string_view first_word = line.substr(0, delimiter_pos);
+    const std::string_view rest = delimiter_pos != std::string_view::npos ? trim_string(line.substr(delimiter_pos)) : "";
+
+    if (pp.recording.kind != RecordingKind::NONE) {
+        return record(ctx, pp, first_word, line, sink);
+    }
+
+    if (line.starts_with('%')) {
+        std::string_view args = rest;
+        if (size_t comment_pos = args.find(';'); comment_pos != std::string_view::npos) {
+            args = trim_string(args.substr(0, comment_pos));
+        }
+        return handle_directive(ctx, pp, first_word, args);
+    }
+
+    if (!is_active(pp)) {
+        return;
+    }
+
+    if (!pp.macros.empty()) {
+        if (auto it = pp.macros.find(first_word); it != pp.macros.end()) {
+            return expand_macro(ctx, pp, first_word, it->second, rest, sink);
+        }
+    }
+
+    if (pp.defines.empty()) {
+        return sink(ctx, line);
+    }
+
+    std::string substituted;
+    substitute_defines(ctx, pp, line, substituted, 0);
+    sink(ctx, substituted);
+}
+
+bool preprocessor_passes_through(const Preprocessor& pp) {
+    return pp.recording.kind == RecordingKind::NONE && is_active(pp);
+}
+
+bool preprocessor_is_skipping(const Preprocessor& pp) {
+    return pp.recording.kind == RecordingKind::NONE && !is_active(pp);
+}
+
+size_t skip_to_next_directive(const SourceFile& file, size_t i) {
+    if (i >= file.lines.size()) {
+        return file.lines.size();
+    }
+
+    // Normalized lines are stored back to back, so a directive is a '%' found exactly where a line starts
+    const char* p = file.lines[i].normalized.data();
+    const char* const end = file.normalized.data() + file.normalized.size();
+
+    while ((p = (const char*)std::memchr(p, '%', end - p)) != nullptr) {
+        auto it = std::lower_bound(
+            file.lines.cbegin() + i,
+            file.lines.cend(),
+            p,
+            [](const SourceLine& line, const char* q) { return line.normalized.data() < q; }
+        );
+
+        if (it != file.lines.cend() && it->normalized.data() == p) {
+            return (size_t)(it - file.lines.cbegin());
+        }
+
+        i = (size_t)(it - file.lines.cbegin());
+        ++p;
+    }
+
+    return file.lines.size();
+}
+
+void finish_preprocessing(Context& ctx, const Preprocessor& pp) {
+    if (pp.recording.kind != RecordingKind::NONE) {
+        diagnose(ctx,
+            "Error: `{}` opened on line {} is never closed",
+            pp.recording.kind == RecordingKind::MACRO ? "%MACRO" : "%REP",
+            pp.recording.line_no
+        );
+        ctx.on_error = true;
+    }
+
+    if (!pp.conditionals.empty()) {
+        diagnose(ctx,
+            "Error: {} `%IF` block(s) are never closed with `%ENDIF`",
+            pp.conditionals.size()
+        );
+        ctx.on_error = true;
+    }
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "assembler.hpp"
+#include "context.hpp"
+#include "repl.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+
+namespace {
+    // The encoders whose counters moved while the line was assembled
+    static void append_forms(std::string& answer, const EmitCount* before, const EmitCount* after) {
+        const size_t length = answer.size();
+
+        for (size_t i = 0; i < FORMAT_COUNT; ++i) {
+            if (after[i].count != before[i].count) {
+                if (answer.size() != length) {
+                    answer.push_back('+');
+                }
+                answer += FORMAT_NAMES[i];
+            }
+        }
+
+        if (answer.size() == length) {
+            answer.push_back('-');
+        }
+    }
+}
+
+bool run_repl(Context& ctx, std::istream& input, std::ostream& output) {
+    // The forms are read off the per-format counters, which need stats even when no report was asked for
+    RunStats session_stats;
+    RunStats* const caller_stats = ctx.stats;
+    if (ctx.stats == nullptr) {
+        init_run_stats(session_stats);
+        ctx.stats = &session_stats;
+    }
+
+    LineSession session;
+    begin_line_session(session, "<repl>");
+
+    std::string line;
+    std::string normalized;
+    std::string answer;
+    size_t line_no = 0;
+
+    while (std::getline(input, line)) {
+        const SourceLine source_line = normalize_line(line, ++line_no, normalized);
+
+        EmitCount formats_before[FORMAT_COUNT];
+        std::copy(std::begin(ctx.stats->formats), std::end(ctx.stats->formats), formats_before);
+        const uint64_t start_offset = ctx.offset;
+        ctx.on_error = false;
+
+        begin_line_stats(ctx.stats);
+        assemble_session_line(ctx, session, source_line);
+        end_line_stats(ctx.stats, session.input->path, line_no, source_line.raw);
+
+        answer.clear();
+        std::format_to(std::back_inserter(answer), "{:08X} {} ", start_offset, ctx.output_buffer.size());
+        if (ctx.on_error) {
+            answer += "error";
+        }
+        else {
+            append_forms(answer, formats_before, ctx.stats->formats);
+        }
+
+        for (uint8_t b : ctx.output_buffer) {
+            std::format_to(std::back_inserter(answer), " {:02X}", b);
+        }
+        output << answer << std::endl;
+
+        ctx.output_buffer.clear();
+    }
+
+    ctx.on_error = false;
+    end_line_session(ctx, session);
+
+    ctx.stats = caller_stats;
+    return !ctx.on_error;
+}
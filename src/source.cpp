@@ -0,0 +1,288 @@
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "source.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+namespace {
+    static bool map_file(SourceFile& file) {
+        TRACE_SCOPE("map_file");
+
+#if !defined(_WIN32)
+        int fd = open(file.path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+
+        // Pipes and character devices report no size and cannot be mapped
+        if (!S_ISREG(st.st_mode)) {
+            const bool success = read_until_eof(fd, file.fallback);
+            close(fd);
+            file.data = file.fallback.data();
+            file.size = file.fallback.size();
+            return success;
+        }
+
+        const size_t size = (size_t)st.st_size;
+        if (size == 0) {
+            close(fd);
+            file.data = "";
+            return true;
+        }
+
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+
+        madvise(p, size, MADV_SEQUENTIAL);
+        file.data = (const char*)p;
+        file.size = size;
+        return true;
+#else
+        std::ifstream input(file.path, std::ios::binary);
+        if (!input) {
+            return false;
+        }
+
+        file.fallback.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        file.data = file.fallback.data();
+        file.size = file.fallback.size();
+        return true;
+#endif
+    }
+
+    // Splits a file into normalized lines, each line as soon as its end has been read
+    class LineSplitter {
+    public:
+        explicit LineSplitter(SourceFile& file) : file(file) {}
+
+        // Splits the lines that end in the first `length` bytes of `text`, the contents of the whole file
+        void feed(std::string_view text, size_t length) {
+            if (file.normalized.capacity() < text.size()) {
+                file.normalized.reserve(text.size());
+            }
+
+            while (pos < length) {
+                const char* nl = (const char*)std::memchr(text.data() + pos, '\n', length - pos);
+                if (nl == nullptr) {
+                    break;
+                }
+                add_line(text, (size_t)(nl - text.data()));
+            }
+        }
+
+        // Splits the rest of the file, whose last line may not end in a newline
+        void finish() {
+            const std::string_view text(file.data, file.size);
+            feed(text, text.size());
+            if (pos < text.size()) {
+                add_line(text, text.size());
+            }
+
+            file.lines.reserve(bounds.size());
+            for (const auto& b : bounds) {
+                file.lines.push_back(SourceLine {
+                    .raw        = text.substr(b.raw_start, b.raw_length),
+                    .normalized = std::string_view(file.normalized).substr(b.normalized_start, b.raw_length),
+                    .line_no    = b.line_no
+                });
+            }
+        }
+
+    private:
+        struct LineBounds {
+            size_t raw_start;
+            size_t raw_length;
+            size_t normalized_start;
+            size_t line_no;
+        };
+
+        void add_line(std::string_view text, size_t eol) {
+            const std::string_view line = text.substr(pos, eol - pos);
+            pos = eol + 1;
+
+            const size_t endpos   = line.find_last_not_of(" \t\r\n");
+            const size_t startpos = line.find_first_not_of(" \t");
+            if (endpos != std::string_view::npos) {
+                const std::string_view trimmed = line.substr(startpos, endpos - startpos + 1);
+                bounds.push_back(LineBounds {
+                    .raw_start          = (size_t)(trimmed.data() - text.data()),
+                    .raw_length         = trimmed.size(),
+                    .normalized_start   = file.normalized.size(),
+                    .line_no            = line_no
+                });
+
+                for (unsigned char c : trimmed) {
+                    file.normalized.push_back((char)std::toupper(c));
+                }
+            }
+            ++line_no;
+        }
+
+        SourceFile&             file;
+        std::vector<LineBounds> bounds;
+        size_t                  pos     = 0;    // start of the first line not split yet
+        size_t                  line_no = 1;
+    };
+
+    static void split_lines(SourceFile& file) {
+        LineSplitter(file).finish();
+    }
+
+    static std::string escape_dependency_path(const std::string& path) {
+        std::string escaped;
+        for (char c : path) {
+            if (c == ' ' || c == '#') {
+                escaped.push_back('\\');
+            }
+            else if (c == '$') {
+                escaped.push_back('$');
+            }
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+}
+
+SourceFile::~SourceFile() {
+#if !defined(_WIN32)
+    if (fallback.empty() && size != 0) {
+        munmap((void*)data, size);
+    }
+#endif
+}
+
+const SourceFile* load_source(SourceCache& cache, const std::string& path, RunStats* stats) {
+    std::error_code ec;
+    std::string key = std::filesystem::weakly_canonical(path, ec).string();
+    if (ec) {
+        key = path;
+    }
+
+    if (auto it = cache.files.find(key); it != cache.files.end()) {
+        return it->second.get();
+    }
+
+    auto file = std::make_unique<SourceFile>();
+    file->path = path;
+    file->data = nullptr;
+    file->size = 0;
+
+    // With io_uring, the lines of the blocks already read are split while the rest of the file is being read
+    LineSplitter splitter(*file);
+    {
+        StatsScope scope(stats, PHASE_READ);
+        if (cache.io_backend == IOBackend::DEFAULT) {
+            if (!map_file(*file)) {
+                return nullptr;
+            }
+        }
+        else {
+            const bool read = read_file(file->path, cache.io_backend, file->fallback, [&](std::string_view contents, size_t length) {
+                StatsScope scope(stats, PHASE_NORMALIZE);
+                splitter.feed(contents, length);
+            });
+            if (!read) {
+                return nullptr;
+            }
+            file->data = file->fallback.data();
+            file->size = file->fallback.size();
+        }
+    }
+
+    StatsScope scope(stats, PHASE_NORMALIZE);
+    splitter.finish();
+
+    const SourceFile* loaded = file.get();
+    cache.files.emplace(std::move(key), std::move(file));
+    cache.load_order.push_back(loaded);
+    return loaded;
+}
+
+SourceLine normalize_line(const std::string_view& line, size_t line_no, std::string& normalized) {
+    normalized.clear();
+
+    const size_t endpos   = line.find_last_not_of(" \t\r\n");
+    const size_t startpos = line.find_first_not_of(" \t");
+    if (endpos == std::string_view::npos) {
+        return SourceLine { .raw = "", .normalized = normalized, .line_no = line_no };
+    }
+
+    const std::string_view trimmed = line.substr(startpos, endpos - startpos + 1);
+    for (unsigned char c : trimmed) {
+        normalized.push_back((char)std::toupper(c));
+    }
+
+    return SourceLine {
+        .raw        = trimmed,
+        .normalized = normalized,
+        .line_no    = line_no
+    };
+}
+
+const SourceFile* add_source(SourceCache& cache, const std::string& path, const std::string_view& contents, RunStats* stats) {
+    if (cache.files.contains(path)) {
+        return nullptr;
+    }
+
+    auto file = std::make_unique<SourceFile>();
+    file->path = path;
+    file->fallback = contents;
+    file->data = file->fallback.data();
+    file->size = file->fallback.size();
+
+    StatsScope scope(stats, PHASE_NORMALIZE);
+    split_lines(*file);
+
+    const SourceFile* added = file.get();
+    cache.files.emplace(path, std::move(file));
+    cache.load_order.push_back(added);
+    return added;
+}
+
+bool write_dependency_file(const SourceCache& cache, const std::string& dep_path, const std::string& target) {
+    TRACE_SCOPE("write_dependency_file");
+
+    std::ofstream dep_file(dep_path);
+    if (!dep_file) {
+        return false;
+    }
+
+    dep_file << escape_dependency_path(target) << ":";
+    for (const SourceFile* file : cache.load_order) {
+        dep_file << " \\\n  " << escape_dependency_path(file->path);
+    }
+    dep_file << "\n";
+
+    // Phony targets keep make working when an included file is deleted
+    for (size_t i = 1; i < cache.load_order.size(); ++i) {
+        dep_file << "\n" << escape_dependency_path(cache.load_order[i]->path) << ":\n";
+    }
+
+    return (bool)dep_file;
+}
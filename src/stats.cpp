@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "instructions.hpp"
+#include "stats.hpp"
+
+namespace {
+    constexpr std::string_view PHASE_NAMES[PHASE_COUNT] = {
+        "reading",
+        "normalization",
+        "lexing",
+        "memory operands",
+        "encoding",
+        "writing"
+    };
+
+    static bool slower(const SlowLine& a, const SlowLine& b) {
+        return a.ticks > b.ticks;
+    }
+}
+
+void init_run_stats(RunStats& stats) {
+    std::fill(std::begin(stats.phase_ticks), std::end(stats.phase_ticks), 0);
+    std::fill(std::begin(stats.sampled_ticks), std::end(stats.sampled_ticks), 0);
+    stats.scope_ticks = stats.phase_ticks;
+    stats.current_phase = PHASE_NONE;
+    stats.sampling = true;
+    stats.lines = 0;
+    stats.sampled_lines = 0;
+    stats.line_start = 0;
+    stats.mnemonics.assign(INSTRUCTION_COUNT, EmitCount {});
+    std::fill(std::begin(stats.formats), std::end(stats.formats), EmitCount {});
+    stats.slowest.clear();
+    stats.slowest.reserve(STATS_SLOWEST_LINES + 1);
+
+    stats.start_ticks = stats_ticks();
+    stats.start_time = std::chrono::steady_clock::now();
+}
+
+void record_line_time(RunStats& stats, uint64_t ticks, const std::string& path, size_t line_no, const std::string_view& text) {
+    stats.slowest.push_back(SlowLine {
+        .ticks      = ticks,
+        .path       = path,
+        .line_no    = line_no,
+        .text       = std::string(text)
+    });
+    std::push_heap(stats.slowest.begin(), stats.slowest.end(), slower);
+
+    if (stats.slowest.size() > STATS_SLOWEST_LINES) {
+        std::pop_heap(stats.slowest.begin(), stats.slowest.end(), slower);
+        stats.slowest.pop_back();
+    }
+}
+
+void print_run_stats(const RunStats& stats, std::ostream& out) {
+    const double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - stats.start_time).count();
+    const uint64_t elapsed_ticks = stats_ticks() - stats.start_ticks;
+    const double ns_per_tick = elapsed_ticks != 0 ? elapsed_ns / elapsed_ticks : 0.0;
+
+    // The sampled lines stand for all of them
+    const double line_scale = stats.sampled_lines != 0 ? (double)stats.lines / stats.sampled_lines : 0.0;
+
+    double phase_ticks[PHASE_COUNT];
+    double total_ticks = 0;
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        phase_ticks[i] = stats.phase_ticks[i] + stats.sampled_ticks[i] * line_scale;
+        total_ticks += phase_ticks[i];
+    }
+
+    out << std::format(
+        "Run statistics ({} lines, phases sampled on one line out of {}):",
+        stats.lines,
+        STATS_SAMPLE_INTERVAL
+    ) << std::endl;
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        out << std::format(
+            "  {:<20} {:>12.3f} ms {:>7.1f}%",
+            PHASE_NAMES[i],
+            phase_ticks[i] * ns_per_tick / 1e6,
+            total_ticks != 0 ? 100.0 * phase_ticks[i] / total_ticks : 0.0
+        ) << std::endl;
+    }
+    out << std::format("  {:<20} {:>12.3f} ms", "total", total_ticks * ns_per_tick / 1e6) << std::endl;
+
+    out << "Instructions by format:" << std::endl;
+    for (size_t i = 0; i < FORMAT_COUNT; ++i) {
+        if (stats.formats[i].count != 0) {
+            out << std::format(
+                "  {:<20} {:>10} instructions {:>12} bytes",
+                FORMAT_NAMES[i],
+                stats.formats[i].count,
+                stats.formats[i].bytes
+            ) << std::endl;
+        }
+    }
+
+    std::vector<std::pair<std::string_view, EmitCount>> mnemonics;
+    for (size_t i = 0; i < stats.mnemonics.size(); ++i) {
+        if (stats.mnemonics[i].count != 0) {
+            mnemonics.emplace_back(INSTRUCTION_NAMES[i].name, stats.mnemonics[i]);
+        }
+    }
+    std::sort(mnemonics.begin(), mnemonics.end(), [](const auto& a, const auto& b) {
+        return a.second.count != b.second.count ? a.second.count > b.second.count : a.first < b.first;
+    });
+
+    out << "Instructions by mnemonic:" << std::endl;
+    for (const auto& [mnemonic, emitted] : mnemonics) {
+        out << std::format(
+            "  {:<20} {:>10} instructions {:>12} bytes",
+            mnemonic,
+            emitted.count,
+            emitted.bytes
+        ) << std::endl;
+    }
+
+    std::vector<SlowLine> slowest = stats.slowest;
+    std::sort_heap(slowest.begin(), slowest.end(), slower);
+
+    out << "Slowest sampled lines:" << std::endl;
+    for (const auto& line : slowest) {
+        out << std::format(
+            "  {:>10.2f} us  {}:{}  {}",
+            line.ticks * ns_per_tick / 1e3,
+            line.path,
+            line.line_no,
+            line.text
+        ) << std::endl;
+    }
+}
@@ -0,0 +1,126 @@
+#include "trace.hpp"
+
+#if defined(AUDASM_TRACE)
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // Events per thread, the oldest ones are overwritten once a buffer wraps
+    constexpr size_t TRACE_BUFFER_EVENTS = 1 << 18;
+    constexpr const char* TRACE_DEFAULT_FILE = "audasm_trace.json";
+
+    // Only its thread writes to a buffer, `written` is published after each event so the dump never needs a lock
+    struct TraceBuffer {
+        uint32_t                tid;
+        std::atomic<uint64_t>   written;
+        TraceEvent              events[TRACE_BUFFER_EVENTS];
+    };
+
+    // Owns the buffers so they outlive their threads, and dumps them when the program exits
+    struct TraceRegistry {
+        std::chrono::steady_clock::time_point       epoch = std::chrono::steady_clock::now();
+        std::mutex                                  mutex;
+        std::vector<std::unique_ptr<TraceBuffer>>   buffers;
+
+        ~TraceRegistry();
+    };
+
+    static TraceRegistry& trace_registry() {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    static TraceBuffer* register_thread_buffer() {
+        TraceRegistry& registry = trace_registry();
+        std::lock_guard lock(registry.mutex);
+
+        // Default-initialized, the events are only touched as they are written
+        std::unique_ptr<TraceBuffer> buffer(new TraceBuffer);
+        buffer->tid = (uint32_t)registry.buffers.size() + 1;
+        buffer->written.store(0, std::memory_order_relaxed);
+
+        registry.buffers.push_back(std::move(buffer));
+        return registry.buffers.back().get();
+    }
+
+    static void write_trace(std::ostream& output, const std::vector<std::unique_ptr<TraceBuffer>>& buffers) {
+        uint64_t dropped = 0;
+        bool first = true;
+
+        output << "{\"traceEvents\":[";
+        for (const auto& buffer : buffers) {
+            output << std::format(
+                "{}\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"thread {}\"}}}}",
+                first ? "" : ",",
+                buffer->tid,
+                buffer->tid
+            );
+            first = false;
+
+            const uint64_t written = buffer->written.load(std::memory_order_acquire);
+            const uint64_t begin = written > TRACE_BUFFER_EVENTS ? written - TRACE_BUFFER_EVENTS : 0;
+            dropped += begin;
+
+            for (uint64_t i = begin; i < written; ++i) {
+                const TraceEvent& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+
+                output << std::format(
+                    ",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}",
+                    event.name,
+                    buffer->tid,
+                    event.start_ns / 1e3,
+                    event.duration_ns / 1e3
+                );
+                if (event.line_no != TRACE_NO_LINE) {
+                    output << std::format(",\"args\":{{\"line\":{}}}", event.line_no);
+                }
+                output << "}";
+            }
+        }
+        output << std::format("\n],\"displayTimeUnit\":\"ns\",\"otherData\":{{\"dropped_events\":{}}}}}\n", dropped);
+    }
+
+    TraceRegistry::~TraceRegistry() {
+        const char* path = std::getenv("AUDASM_TRACE_FILE");
+        if (path == nullptr || *path == '\0') {
+            path = TRACE_DEFAULT_FILE;
+        }
+
+        std::lock_guard lock(mutex);
+        std::ofstream output(path);
+        write_trace(output, buffers);
+        if (!output) {
+            std::cerr << "Error: could not write the trace to " << path << std::endl;
+        }
+    }
+}
+
+uint64_t trace_now() {
+    const auto elapsed = std::chrono::steady_clock::now() - trace_registry().epoch;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t line_no) {
+    thread_local TraceBuffer* buffer = register_thread_buffer();
+
+    const uint64_t index = buffer->written.load(std::memory_order_relaxed);
+    buffer->events[index % TRACE_BUFFER_EVENTS] = TraceEvent {
+        .name           = name,
+        .start_ns       = start_ns,
+        .duration_ns    = end_ns - start_ns,
+        .line_no        = line_no
+    };
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+#endif
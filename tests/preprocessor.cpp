@@ -0,0 +1,72 @@
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "audasm.hpp"
+
+namespace {
+    struct Case {
+        std::string_view    source;
+        audasm::Options     options;
+        std::string_view    expected;   // the bytes in hexadecimal
+    };
+
+    // The lines of a %REP or %MACRO body are recorded back to back, directives nested in a body must still be seen
+    // as directives
+    const Case CASES[] = {
+        {
+            "%REP 1\n%REP 1\nADD AL, 1\n%ENDREP\n%ENDREP\n",
+            {},
+            "04 01"
+        },
+        {
+            "%REP 2\nADD AL, 2\n%REP 1\nADD AL, 3\n%ENDREP\n%ENDREP\n",
+            {},
+            "04 02 04 03 04 02 04 03"
+        },
+        {
+            "%MACRO M 1\nADD EAX, [EBX]\n%IF %1\nADD AL, 1\n%ENDIF\n%ENDMACRO\nM 1\nM 0\n",
+            { .b_mode = M32 },
+            "03 03 04 01 03 03"
+        },
+        {
+            "%MACRO M 1\nADD AL, %1\nADD AL, %1\n%ENDMACRO\n%REP 2\nM 7\n%ENDREP\n",
+            {},
+            "04 07 04 07 04 07 04 07"
+        }
+    };
+
+    std::string hex(const std::vector<uint8_t>& bytes) {
+        std::string out;
+        for (uint8_t b : bytes) {
+            if (!out.empty()) {
+                out += ' ';
+            }
+            out += std::format("{:02X}", b);
+        }
+        return out;
+    }
+}
+
+int main() {
+    size_t failures = 0;
+    for (const Case& c : CASES) {
+        const audasm::Result result = audasm::assemble(c.source, c.options);
+        if (!result.success || hex(result.bytes) != c.expected) {
+            std::cerr << std::format(
+                "Error: Unexpected result for\n{}expected {}\ngot      {}\n{}",
+                c.source,
+                c.expected,
+                hex(result.bytes),
+                result.diagnostics
+            ) << std::endl;
+            ++failures;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "audasm.hpp"
+
+namespace {
+    constexpr size_t DEFAULT_THREADS = 16;
+    constexpr size_t REPETITIONS = 20;
+
+    struct Case {
+        std::string_view    source;
+        audasm::Options     options;
+    };
+
+    // Every bits mode, errors, warnings, the preprocessor and the peephole pass, so that each part of a Context is
+    // exercised while other threads assemble something else
+    const Case CASES[] = {
+        { "ADD AL, 1\nADD [BX+SI+4], AX\nSUB CX, 0x1234\nCLC\nREP MOVSB\n", { .b_mode = M16 } },
+        { "BITS 32\nADD EAX, [EBX+ECX*4+8]\nXOR EDX, EDX\nLOCK ADD [EAX], ECX\n", {} },
+        { "BITS 64\nADD RAX, 1\nADD [R12], R13\nVPADDD XMM0, XMM1, XMM2\nMOVAPS XMM3, [RIP+16]\nRET\n", {} },
+        { "ADD EAX, 1\nADD RAX, 1\nSUB CX, [BX+BP]\n", { .b_mode = M32 } },
+        { "ADD AL, 0x1234\nADD AX, 0x12345678\n", {} },
+        { "NOSUCH AX, 1\nADD AX,\nADD [EAX+2*SI], AL\nLOCK\n", { .b_mode = M64 } },
+        { "%DEFINE STEP 4\n%MACRO BUMP 2\nADD %1, %2\n%ENDMACRO\n%REP 3\nBUMP EAX, STEP\n%ENDREP\n", { .b_mode = M32 } },
+        { "%IFDEF MISSING\nADD AL, 1\n%ELSE\nSUB AL, 1\n%ENDIF\n%UNDEF X\n%BOGUS\n", {} },
+        { "BITS 64\nADD RAX, 0\nSUB RCX, 1\nADD EDX, 0x7F\nCMP R8, 0\n", { .optimize = true } },
+        { "BITS 16\nADD AX, 1\nBITS 32\nADD EAX, 1\nBITS 64\nADD RAX, 1\n", { .optimize = true } }
+    };
+
+    constexpr size_t N_CASES = sizeof(CASES) / sizeof(CASES[0]);
+
+    bool same_result(const audasm::Result& a, const audasm::Result& b) {
+        return a.success == b.success && a.bytes == b.bytes && a.diagnostics == b.diagnostics;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const size_t n_threads = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : DEFAULT_THREADS;
+    if (n_threads == 0) {
+        std::cerr << "Usage: thread_safety [threads]" << std::endl;
+        return -1;
+    }
+
+    std::vector<audasm::Result> expected;
+    expected.reserve(N_CASES);
+    for (const Case& c : CASES) {
+        expected.push_back(audasm::assemble(c.source, c.options));
+    }
+
+    // A test that only ever sees successes or only errors would not show a leak between the two
+    size_t n_failures = 0;
+    for (const audasm::Result& result : expected) {
+        n_failures += !result.success;
+    }
+    if (n_failures == 0 || n_failures == N_CASES) {
+        std::cerr << "Error: The cases should mix successful and failing sources" << std::endl;
+        return -1;
+    }
+
+    std::atomic<bool> start = false;
+    std::atomic<size_t> mismatches = 0;
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads);
+
+    for (size_t t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&, t] {
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+
+            // Each thread starts at a different case, so different sources are assembled at the same moment
+            for (size_t r = 0; r < REPETITIONS; ++r) {
+                for (size_t i = 0; i < N_CASES; ++i) {
+                    const size_t id = (t + i) % N_CASES;
+                    const audasm::Result result = audasm::assemble(CASES[id].source, CASES[id].options);
+                    if (!same_result(result, expected[id])) {
+                        std::cerr << std::format("Error: Case {} differs on thread {} from the serial run", id, t) << std::endl;
+                        ++mismatches;
+                    }
+                }
+            }
+        });
+    }
+
+    start = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if (mismatches != 0) {
+        std::cerr << std::format("{} mismatch(es) over {} threads", mismatches.load(), n_threads) << std::endl;
+        return 1;
+    }
+
+    std::cout << std::format("{} cases on {} threads x {} repetitions match the serial run", N_CASES, n_threads, REPETITIONS) << std::endl;
+    return 0;
+}